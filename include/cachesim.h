@@ -0,0 +1,43 @@
+#ifndef CACHESIM_H
+#define CACHESIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Cache levels simulated: L1, L2 and the last-level cache */
+#define CACHESIM_LEVELS 3
+
+/* Number of classes that accesses can be charged to (see cachesim_set_class) */
+#define CACHESIM_CLASSES 8
+
+/* The geometry of the simulated caches and TLB. Every size is a power of two. */
+typedef struct {
+    size_t line;                     /* bytes per cache line */
+    size_t page;                     /* bytes per page */
+    size_t size[CACHESIM_LEVELS];    /* bytes in each cache level */
+    unsigned ways[CACHESIM_LEVELS];  /* associativity of each cache level */
+    unsigned tlb_entries;
+    unsigned tlb_ways;
+} cachesim_config_t;
+
+/* What the accesses charged to one class did */
+typedef struct {
+    uint64_t accesses;                 /* cache lines accessed */
+    uint64_t misses[CACHESIM_LEVELS];  /* ... that missed in each level */
+    uint64_t tlb_misses;               /* pages accessed that missed in the TLB */
+} cachesim_counts_t;
+
+/* Are accesses being simulated? The hooks in instrumented code check this. */
+extern bool cachesim_on;
+
+extern const cachesim_config_t cachesim_default_config;
+
+bool cachesim_init(const cachesim_config_t *config);
+void cachesim_deinit(void);
+void cachesim_reset(void);
+void cachesim_set_class(int cls);
+void cachesim_access(const void *addr, size_t size);
+void cachesim_get_counts(int cls, cachesim_counts_t *counts);
+
+#endif /* CACHESIM_H */
@@ -0,0 +1,21 @@
+#ifndef CACHESIM_HOOKS_H
+#define CACHESIM_HOOKS_H
+
+/*
+ * Force-included (gcc -include) into an allocator built for the cache
+ * simulator, so that the block copies and clears it makes, which the
+ * compiler's instrumentation doesn't see, are simulated too. See cachesim.c.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+void *cachesim_memcpy(void *dst, const void *src, size_t n);
+void *cachesim_memmove(void *dst, const void *src, size_t n);
+void *cachesim_memset(void *dst, int c, size_t n);
+
+#define memcpy(dst, src, n) cachesim_memcpy(dst, src, n)
+#define memmove(dst, src, n) cachesim_memmove(dst, src, n)
+#define memset(dst, c, n) cachesim_memset(dst, c, n)
+
+#endif /* CACHESIM_HOOKS_H */
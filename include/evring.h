@@ -0,0 +1,115 @@
+#ifndef EVRING_H
+#define EVRING_H
+
+/*
+ * A continuous trace of allocator events in shared memory. While it is on,
+ * every mm_malloc, mm_free, mm_realloc and mem_sbrk call appends a 32-byte
+ * event to a ring owned by the calling thread, in a file that another
+ * process maps to follow the allocator live (see mevents.c). The rings are
+ * written without locks or system calls, and a full ring overwrites its
+ * oldest events rather than stall the allocator; the reader can tell how
+ * many it missed from the ring's head.
+ *
+ * The file is an evring_header_t followed by max_threads rings, each an
+ * evring_thread_t followed by num_slots events. A thread claims a ring the
+ * first time it records an event; threads beyond max_threads aren't traced.
+ *
+ * The allocators call MM_EVENT_START and MM_EVENT around each request.
+ * While the trace is off, this costs a flag test on each. Building with
+ * -DMM_NO_EVENTS removes even that.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define EVRING_MAGIC 0x31474e4952564545ULL /* "EEVRING1" */
+#define EVRING_VERSION 1
+
+/* Event types */
+enum {
+    EVRING_MALLOC,
+    EVRING_FREE,
+    EVRING_REALLOC,
+    EVRING_SBRK,
+    EVRING_NUM_OPS
+};
+
+/* One event. mm_realloc, mm_calloc and mm_memalign also record the
+   mm_malloc and mm_free calls they make, and those the mem_sbrk calls. */
+typedef struct {
+    uint64_t ticks;  /* when the call started, in evring_ticks */
+    uint64_t addr;   /* the block returned or freed, or the old break */
+    uint64_t size;   /* bytes requested, or the sbrk increment */
+    uint32_t cycles; /* ticks the call took, saturated */
+    uint32_t op;     /* EVRING_* */
+} evring_event_t;
+
+/* The header of a ring; events[i] is slot i % num_slots */
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t head; /* events ever written to the ring */
+    atomic_uint_fast64_t reserved;          /* events ever started (see evring.c) */
+    uint32_t tid;                           /* the owning thread */
+    uint32_t pid;                           /* the owning process */
+} evring_thread_t;
+
+/* The header of the file */
+typedef struct {
+    uint64_t magic;           /* EVRING_MAGIC */
+    uint32_t version;         /* EVRING_VERSION */
+    uint32_t event_size;      /* sizeof(evring_event_t) */
+    uint32_t max_threads;     /* rings in the file */
+    uint32_t num_slots;       /* events per ring, a power of two */
+    double ticks_per_sec;     /* rate of evring_ticks */
+    uint64_t start_ticks;     /* evring_ticks when the file was created */
+    uint32_t pid;             /* the process that created it */
+    atomic_uint num_threads;  /* rings claimed so far */
+    atomic_uint lost_threads; /* threads that found no free ring */
+} evring_header_t;
+
+/* Returns the ring of thread t in the file mapped at base */
+static inline evring_thread_t *evring_thread(const evring_header_t *base, unsigned t) {
+    size_t ring_size = sizeof(evring_thread_t) + base->num_slots * sizeof(evring_event_t);
+    size_t offset = (sizeof(evring_header_t) + 63) / 64 * 64;
+    return (evring_thread_t *) ((char *) base + offset + t * ring_size);
+}
+
+/* Returns the slots of a ring */
+static inline evring_event_t *evring_events(evring_thread_t *ring) {
+    return (evring_event_t *) (ring + 1);
+}
+
+/* The cheapest clock with a steady rate: the TSC on x86, else nanoseconds */
+static inline uint64_t evring_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+bool evring_open(const char *path, unsigned max_threads, size_t num_slots);
+void evring_close(void);
+
+/* Used by the hooks below; not part of the interface */
+extern bool evring_on;
+void evring_record(int op, size_t size, const void *addr, uint64_t start);
+
+#ifndef MM_NO_EVENTS
+/** Returns the start time of a call, if events are being recorded */
+#define MM_EVENT_START() (evring_on ? evring_ticks() : 0)
+/** Records a call that started at `start` */
+#define MM_EVENT(op, size, addr, start)                                                  \
+    do {                                                                                 \
+        if (evring_on) evring_record(op, size, addr, start);                             \
+    } while (0)
+#else
+#define MM_EVENT_START() 0
+#define MM_EVENT(op, size, addr, start) ((void) (start))
+#endif
+
+#endif /* EVRING_H */
@@ -0,0 +1,27 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* A parsed JSON value. Objects keep their members in file order. */
+typedef struct json_value {
+    enum { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT } type;
+    bool boolean;
+    double number;
+    char *string;               /* string value */
+    char *name;                 /* member name, for the members of an object */
+    struct json_value *members; /* array elements or object members */
+    size_t num_members;
+} json_value_t;
+
+json_value_t *json_parse_file(const char *path, char *err, size_t errlen);
+void json_free(json_value_t *value);
+const json_value_t *json_get(const json_value_t *object, const char *name);
+double json_get_number(const json_value_t *object, const char *name, double fallback);
+const char *json_get_string(const json_value_t *object, const char *name);
+
+void json_print_string(FILE *fp, const char *s);
+
+#endif /* JSON_H */
@@ -1,7 +1,15 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
+/* The mem_sbrk calls since the last mem_reset_brk */
+typedef struct {
+    uint64_t calls;
+    uint64_t bytes; /* the increments added up */
+    uint64_t pages; /* pages the break moved onto */
+} mem_sbrk_stats_t;
+
 void mem_init(void);
 void mem_deinit(void);
 void *mem_sbrk(ssize_t incr);
@@ -9,3 +17,7 @@ void mem_reset_brk(bool clear);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+void mem_release_pages(void);
+long mem_resident_pages(unsigned char *vec);
+void mem_get_sbrk_stats(mem_sbrk_stats_t *stats);
+void mem_set_sbrk_cost(unsigned long call_nsecs, unsigned long page_nsecs);
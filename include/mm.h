@@ -3,12 +3,100 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 bool mm_init(void);
 void *mm_malloc(size_t size);
 void mm_free(void *ptr);
 void *mm_realloc(void *ptr, size_t size);
 void *mm_calloc(size_t nmemb, size_t size);
+void *mm_memalign(size_t alignment, size_t size);
+void mm_free_sized(void *ptr, size_t size);
+size_t mm_usable_size(void *ptr);
 void mm_checkheap(void);
 
+/** Describes one block on the heap, as reported by mm_heap_walk */
+typedef struct {
+    void *block;         /* first byte of the block, including its metadata */
+    size_t size;         /* total size of the block in bytes */
+    void *payload;       /* first byte of the payload */
+    size_t payload_size; /* number of usable payload bytes */
+    bool allocated;      /* is the block allocated? */
+} mm_block_info_t;
+
+typedef void (*mm_walk_fn)(const mm_block_info_t *info, void *arg);
+
+void mm_heap_walk(mm_walk_fn visit, void *arg);
+size_t mm_padded_size(size_t size);
+
+/* Writes a snapshot of the heap layout to path (see mm_dump.h) */
+bool mm_heap_dump(const char *path);
+
+/** Number of free block size classes in struct mm_stats */
+#define MM_STATS_CLASSES 16
+
+/** Number of buckets in the work histograms of struct mm_stats */
+#define MM_STATS_HIST 16
+
+/**
+ * Allocator statistics, as reported by mm_get_stats. The counters are kept
+ * up to date as the allocator runs, so reading them is cheap; see
+ * mm_stats.h for compiling them out.
+ */
+struct mm_stats {
+    size_t heap_size;        /* bytes obtained from mem_sbrk */
+    size_t allocated_bytes;  /* payload bytes in allocated blocks */
+    size_t allocated_blocks; /* number of allocated blocks */
+    size_t free_bytes;       /* payload bytes in free blocks */
+    size_t largest_free;     /* payload bytes of the largest free block */
+    /* Free blocks by payload size: class k holds sizes in [16 << k, 32 << k),
+       except that class 0 also holds smaller and the last class larger ones */
+    size_t free_blocks[MM_STATS_CLASSES];
+
+    /* Event counts since mm_init. mm_realloc, mm_calloc and mm_memalign
+       count the mm_malloc and mm_free calls they make. */
+    uint64_t mallocs;
+    uint64_t frees;
+    uint64_t reallocs;
+    uint64_t splits;    /* blocks split to fit a request */
+    uint64_t coalesces; /* pairs of free blocks merged */
+    uint64_t sbrks;     /* calls to mem_sbrk */
+
+    /* What mm_realloc did with existing blocks (not NULL, nor resized to 0) */
+    uint64_t realloc_in_place;  /* calls that left the block where it was */
+    uint64_t realloc_moved;     /* calls that moved it to a new block */
+    uint64_t realloc_requested; /* bytes requested by all of them */
+    uint64_t realloc_copied;    /* bytes copied by the moves */
+
+    /* How much work the calls did. Each histogram counts calls by how many
+       units of work they did: bucket 0 counts calls that did none, bucket
+       k >= 1 calls that did [2^(k-1), 2^k), and the last bucket also counts
+       everything larger. */
+    uint64_t fit_searched[MM_STATS_HIST];  /* blocks examined per fit search */
+    uint64_t fit_searched_blocks;          /* ... added up */
+    uint64_t fit_searched_max;             /* ... in the longest search */
+    uint64_t free_merges[MM_STATS_HIST];   /* merges per mm_free */
+    uint64_t malloc_merges[MM_STATS_HIST]; /* merges per mm_malloc, for allocators
+                                              that coalesce while they search */
+};
+
+void mm_get_stats(struct mm_stats *stats);
+
+/**
+ * How much of the heap each mm_checkheap call checks. A full check walks
+ * the whole heap and also checks invariants of the heap as a whole, such
+ * as free-list length and the statistics; the other modes check the
+ * boundary tags, neighbours and list links of a bounded number of blocks,
+ * picking up where the last check stopped, so that over many calls they
+ * cover the whole heap without ever stopping the program for long.
+ */
+typedef enum {
+    MM_CHECK_FULL,        /* the whole heap on every call (the default) */
+    MM_CHECK_INCREMENTAL, /* the next `budget` blocks on every call */
+    MM_CHECK_SAMPLED,     /* the next `budget` blocks on about one call in `period` */
+} mm_check_mode_t;
+
+void mm_checkheap_mode(mm_check_mode_t mode, size_t budget, unsigned period);
+uint64_t mm_checkheap_errors(void);
+
 #endif /* MM_H */
@@ -0,0 +1,83 @@
+#ifndef MM_CHECK_H
+#define MM_CHECK_H
+
+/*
+ * Helpers shared by the allocators' heap checkers. Each allocator keeps an
+ * mm_check_t, asks mm_check_budget at the start of mm_checkheap how many
+ * blocks this call should check, and reports every broken invariant with
+ * mm_check_fail. See mm_checkheap_mode in mm.h for the modes.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mm.h"
+
+/** The state of an allocator's heap checker */
+typedef struct {
+    mm_check_mode_t mode;
+    size_t budget;      /* blocks per check, unless the mode is MM_CHECK_FULL */
+    unsigned period;    /* mean calls per check, in MM_CHECK_SAMPLED */
+    unsigned countdown; /* calls left until the next sampled check */
+    uint64_t rng;       /* xorshift64 state for drawing the countdown */
+    uint64_t errors;    /* broken invariants found so far */
+} mm_check_t;
+
+/** Draws the calls until the next sampled check, uniformly in [1, 2 * period - 1] */
+static inline unsigned mm_check_draw(mm_check_t *check) {
+    if (check->period <= 1) {
+        return 1;
+    }
+    check->rng ^= check->rng << 13;
+    check->rng ^= check->rng >> 7;
+    check->rng ^= check->rng << 17;
+    return 1 + (unsigned) (check->rng % (2 * (uint64_t) check->period - 1));
+}
+
+/** Sets the mode of a checker; errors found so far are still counted */
+static inline void mm_check_configure(mm_check_t *check, mm_check_mode_t mode,
+                                      size_t budget, unsigned period) {
+    check->mode = mode;
+    check->budget = (budget > 0) ? budget : 1;
+    check->period = (period > 0) ? period : 1;
+    if (check->rng == 0) {
+        check->rng = 0x9e3779b97f4a7c15ULL;
+    }
+    check->countdown = mm_check_draw(check);
+}
+
+/**
+ * Returns how many blocks this call of mm_checkheap should check: SIZE_MAX
+ * for the whole heap and its global invariants, or 0 for none at all
+ */
+static inline size_t mm_check_budget(mm_check_t *check) {
+    switch (check->mode) {
+        case MM_CHECK_INCREMENTAL:
+            return check->budget;
+        case MM_CHECK_SAMPLED:
+            if (--check->countdown > 0) {
+                return 0;
+            }
+            check->countdown = mm_check_draw(check);
+            return check->budget;
+        default:
+            return SIZE_MAX;
+    }
+}
+
+/** Reports a broken invariant on stderr and counts it */
+static inline void mm_check_fail(mm_check_t *check, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+static inline void mm_check_fail(mm_check_t *check, const char *fmt, ...) {
+    va_list ap;
+
+    fprintf(stderr, "mm_checkheap: ");
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+    check->errors++;
+}
+
+#endif /* MM_CHECK_H */
@@ -0,0 +1,137 @@
+#ifndef MM_DUMP_H
+#define MM_DUMP_H
+
+/*
+ * The heap snapshot format written by mm_heap_dump and read by mheap.c.
+ *
+ * A snapshot is an mm_dump_header_t followed by one mm_dump_block_t per
+ * block, in address order, all in the byte order of the machine that wrote
+ * it (MM_DUMP_MAGIC reads backwards on another one). Only the layout is
+ * recorded, never the payloads, so a snapshot of a large heap stays small
+ * and holds none of the program's data.
+ *
+ * The allocators write snapshots with mm_dump_write, which walks the heap
+ * with mm_heap_walk and marks the blocks that are on the free list.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm.h"
+
+#define MM_DUMP_MAGIC 0x31504d4448504d4dULL /* "MMPHDMP1" */
+#define MM_DUMP_VERSION 1
+
+/* Header flags */
+#define MM_DUMP_HAS_FREE_LIST 0x1 /* the allocator keeps a free list */
+
+/* Block flags */
+#define MM_DUMP_ALLOCATED 0x1 /* the block is allocated */
+#define MM_DUMP_LISTED 0x2    /* the block is on the free list */
+
+typedef struct {
+    uint64_t magic;         /* MM_DUMP_MAGIC */
+    uint32_t version;       /* MM_DUMP_VERSION */
+    uint32_t flags;         /* MM_DUMP_HAS_FREE_LIST, ... */
+    uint64_t heap_lo;       /* address of the first byte of the heap */
+    uint64_t heap_size;     /* bytes from mem_heap_lo to mem_heap_hi */
+    uint64_t num_blocks;    /* records that follow */
+    uint64_t num_listed;    /* blocks found on the free list, on the heap or not */
+} mm_dump_header_t;
+
+typedef struct {
+    uint64_t offset;        /* of the block from heap_lo */
+    uint64_t size;          /* of the whole block, metadata included */
+    uint32_t payload_delta; /* bytes from the block to its payload */
+    uint32_t flags;         /* MM_DUMP_ALLOCATED, MM_DUMP_LISTED */
+    uint64_t payload_size;  /* usable payload bytes */
+} mm_dump_block_t;
+
+/** The state of mm_dump_write while it walks the heap */
+typedef struct {
+    FILE *fp;
+    const mm_dump_header_t *header;
+    const uintptr_t *listed; /* payloads on the free list, sorted */
+    size_t num_listed;
+    uint64_t num_blocks;
+    bool failed;
+} mm_dump_state_t;
+
+static inline int mm_dump_compare(const void *a, const void *b) {
+    uintptr_t x = *(const uintptr_t *) a, y = *(const uintptr_t *) b;
+    return (x > y) - (x < y);
+}
+
+/** Is the payload at p on the (sorted) free list? */
+static inline bool mm_dump_is_listed(const mm_dump_state_t *state, uintptr_t p) {
+    return state->num_listed > 0 &&
+           bsearch(&p, state->listed, state->num_listed, sizeof(uintptr_t),
+                   mm_dump_compare) != NULL;
+}
+
+static inline void mm_dump_visit(const mm_block_info_t *info, void *arg) {
+    mm_dump_state_t *state = arg;
+    mm_dump_block_t record = {
+        .offset = (uintptr_t) info->block - state->header->heap_lo,
+        .size = info->size,
+        .payload_delta = (uint32_t) ((char *) info->payload - (char *) info->block),
+        .flags = info->allocated ? MM_DUMP_ALLOCATED : 0,
+        .payload_size = info->payload_size,
+    };
+
+    if (mm_dump_is_listed(state, (uintptr_t) info->payload)) {
+        record.flags |= MM_DUMP_LISTED;
+    }
+    if (fwrite(&record, sizeof(record), 1, state->fp) != 1) {
+        state->failed = true;
+    }
+    state->num_blocks++;
+}
+
+/**
+ * Writes a snapshot of the heap from heap_lo to heap_lo + heap_size to
+ * path. listed holds the payload addresses of the num_listed blocks on the
+ * free list and is sorted in place; allocators without a free list pass
+ * NULL and 0 and leave MM_DUMP_HAS_FREE_LIST out of flags. Returns false,
+ * with errno set, if the file couldn't be written.
+ */
+static inline bool mm_dump_write(const char *path, const void *heap_lo, size_t heap_size,
+                                 uint32_t flags, uintptr_t *listed, size_t num_listed) {
+    mm_dump_header_t header = {
+        .magic = MM_DUMP_MAGIC,
+        .version = MM_DUMP_VERSION,
+        .flags = flags,
+        .heap_lo = (uintptr_t) heap_lo,
+        .heap_size = heap_size,
+        .num_listed = num_listed,
+    };
+    mm_dump_state_t state = {
+        .header = &header,
+        .listed = listed,
+        .num_listed = num_listed,
+    };
+
+    if ((state.fp = fopen(path, "wb")) == NULL) {
+        return false;
+    }
+    if (num_listed > 0) {
+        qsort(listed, num_listed, sizeof(uintptr_t), mm_dump_compare);
+    }
+    // The header is rewritten with the block count once the walk is done
+    state.failed = fwrite(&header, sizeof(header), 1, state.fp) != 1;
+    mm_heap_walk(mm_dump_visit, &state);
+    header.num_blocks = state.num_blocks;
+    if (fseek(state.fp, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, state.fp) != 1) {
+        state.failed = true;
+    }
+    if (fclose(state.fp) != 0) {
+        state.failed = true;
+    }
+    return !state.failed;
+}
+
+#endif /* MM_DUMP_H */
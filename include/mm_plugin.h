@@ -0,0 +1,74 @@
+#ifndef MM_PLUGIN_H
+#define MM_PLUGIN_H
+
+/*
+ * The allocator plugin ABI. A plugin is a shared object exporting one
+ * mm_plugin_t named MM_PLUGIN_SYMBOL, which mdriver loads with dlopen to
+ * compare several allocators on the same traces in one run.
+ *
+ * Any of the mm-*.c allocators becomes a plugin with the shim in
+ * src/mm-plugin.c, e.g.
+ *
+ *   gcc -shared -fPIC -fvisibility=hidden -Iinclude -DMM_PLUGIN_NAME='"explicit"' \
+ *       src/mm-explicit.c src/mm-plugin.c src/mm-prof.c -o mm-explicit.so
+ *
+ * Hidden visibility keeps the plugin's mm_* functions, and the profiler
+ * hooks in src/mm-prof.c that they call, from binding to the ones linked
+ * into mdriver. The memlib functions are left undefined and
+ * bind to mdriver's simulated heap, which must be linked with -rdynamic.
+ * Allocators that manage their own memory, e.g. locally built third-party
+ * allocators, leave out MM_PLUGIN_USES_MEMLIB and are then evaluated like
+ * libc: for correctness and speed, but not for space utilization.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mm.h"
+
+/* The version of the ABI described here; mdriver rejects other versions */
+#define MM_PLUGIN_ABI_VERSION 1
+
+/* The name of the descriptor exported by every plugin */
+#define MM_PLUGIN_SYMBOL "mm_plugin"
+
+/* Plugin flags */
+#define MM_PLUGIN_USES_MEMLIB 0x1 /* the heap lives in memlib's simulated heap */
+
+/*
+ * An allocator's entry points. New optional hooks are only ever appended,
+ * and `size` tells which of them the plugin was built with, so check
+ * optional hooks with MM_PLUGIN_HAS.
+ */
+typedef struct {
+    uint32_t abi_version; /* MM_PLUGIN_ABI_VERSION */
+    uint32_t size;        /* sizeof(mm_plugin_t) when the plugin was built */
+    const char *name;     /* short name for reports */
+    uint32_t flags;       /* MM_PLUGIN_* flags */
+
+    /* Required */
+    bool (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void *(*calloc)(size_t nmemb, size_t size);
+
+    /* Optional, may be NULL */
+    void (*checkheap)(void);
+    void (*heap_walk)(mm_walk_fn visit, void *arg);
+    size_t (*padded_size)(size_t size);
+    void *(*memalign)(size_t alignment, size_t size);
+    void (*free_sized)(void *ptr, size_t size);
+    size_t (*usable_size)(void *ptr);
+    void (*get_stats)(struct mm_stats *stats);
+    void (*checkheap_mode)(mm_check_mode_t mode, size_t budget, unsigned period);
+    uint64_t (*checkheap_errors)(void);
+    bool (*heap_dump)(const char *path);
+} mm_plugin_t;
+
+/* Does plugin p provide the optional hook `field`? */
+#define MM_PLUGIN_HAS(p, field)                                                         \
+    ((p)->size >= offsetof(mm_plugin_t, field) + sizeof((p)->field) && (p)->field != NULL)
+
+#endif /* MM_PLUGIN_H */
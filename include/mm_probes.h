@@ -0,0 +1,41 @@
+#ifndef MM_PROBES_H
+#define MM_PROBES_H
+
+/*
+ * USDT probes on the allocators' hot paths, under the provider "mm":
+ *
+ *   mm:malloc    (size, ptr)               a request and the payload returned
+ *   mm:free      (ptr, size)               the payload freed and its size
+ *   mm:realloc   (old_ptr, size, new_ptr)
+ *   mm:find_fit  (size, block, searched)   the block found (NULL for none) and
+ *                                          the number of blocks looked at
+ *   mm:coalesce  (block, size)             one merge, and the merged size
+ *   mm:split     (block, size, remainder)  a block cut down to size, leaving
+ *                                          a free remainder
+ *   mm:sbrk      (incr, old_brk)
+ *
+ * They are defined with <sys/sdt.h> from SystemTap, where it is installed, so
+ * a probe is a single NOP plus an ELF note until a tracer attaches to it,
+ * e.g. to see how long fit searches are in a running process:
+ *
+ *   bpftrace -e 'usdt:./mdriver:mm:find_fit { @searched = hist(arg2); }'
+ *
+ * Without <sys/sdt.h>, or with -DMM_NO_PROBES, they compile to nothing.
+ */
+
+#if !defined(MM_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MM_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef MM_HAVE_PROBES
+#define MM_PROBE2(name, a, b) DTRACE_PROBE2(mm, name, a, b)
+#define MM_PROBE3(name, a, b, c) DTRACE_PROBE3(mm, name, a, b, c)
+#else
+#define MM_PROBE2(name, a, b) ((void) (a), (void) (b))
+#define MM_PROBE3(name, a, b, c) ((void) (a), (void) (b), (void) (c))
+#endif
+
+#endif /* MM_PROBES_H */
@@ -0,0 +1,74 @@
+#ifndef MM_PROF_H
+#define MM_PROF_H
+
+/*
+ * A sampling heap profiler for the allocators. While it is on, about one
+ * in every `interval` allocated bytes is sampled: the stack of the
+ * allocation is recorded, and its call site is charged with it in the live
+ * profile until it is freed and in the cumulative profile for good. The
+ * gaps between samples are drawn from an exponential distribution, so that
+ * every byte is equally likely to be sampled whatever the allocation
+ * pattern, and the profile can be scaled back up to estimate the heap.
+ *
+ * The allocators call MM_PROF_MALLOC and MM_PROF_FREE on every request.
+ * While the profiler is off, this costs a counter decrement in malloc and a
+ * counter test in free. The public entry points that allocate also note
+ * their caller with MM_PROF_ENTER and MM_PROF_LEAVE, so that a sample's
+ * stack starts at the caller however many allocator frames lie under it.
+ * Building with -DMM_NO_PROF removes all of it.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Formats of mm_prof_dump */
+typedef enum {
+    MM_PROF_TEXT, /* human-readable, symbolized, scaled to estimates of the heap */
+    MM_PROF_PPROF /* the legacy heap profile format that pprof reads */
+} mm_prof_format_t;
+
+void mm_prof_start(size_t interval);
+void mm_prof_stop(void);
+void mm_prof_reset(void);
+void mm_prof_forget_live(void);
+bool mm_prof_dump(const char *path, mm_prof_format_t format);
+
+/* Used by the hooks below; not part of the interface */
+extern long mm_prof_countdown;  /* bytes left until the next sample */
+extern size_t mm_prof_num_live; /* sampled blocks that are still allocated */
+extern void *mm_prof_caller;    /* return address into the allocator's caller */
+void mm_prof_sample(void *ptr, size_t size);
+void mm_prof_free(void *ptr);
+void mm_prof_move(void *old_ptr, void *new_ptr);
+
+#ifndef MM_NO_PROF
+/** Accounts for an allocation of `size` bytes at `ptr` */
+#define MM_PROF_MALLOC(ptr, size)                                                        \
+    do {                                                                                 \
+        if ((mm_prof_countdown -= (long) (size)) < 0) mm_prof_sample(ptr, size);         \
+    } while (0)
+/** Accounts for freeing the block at `ptr` */
+#define MM_PROF_FREE(ptr)                                                                \
+    do {                                                                                 \
+        if (mm_prof_num_live != 0) mm_prof_free(ptr);                                    \
+    } while (0)
+/** Accounts for an allocated block whose payload moved from `old_ptr` to `new_ptr` */
+#define MM_PROF_MOVE(old_ptr, new_ptr)                                                   \
+    do {                                                                                 \
+        if (mm_prof_num_live != 0) mm_prof_move(old_ptr, new_ptr);                      \
+    } while (0)
+/** Notes the caller of a public entry point, unless the allocator called it */
+#define MM_PROF_ENTER()                                                                  \
+    void *mm_prof_outer = mm_prof_caller;                                                \
+    if (mm_prof_outer == NULL) mm_prof_caller = __builtin_return_address(0)
+/** Forgets the caller again on the way out of the entry point */
+#define MM_PROF_LEAVE() (mm_prof_caller = mm_prof_outer)
+#else
+#define MM_PROF_MALLOC(ptr, size) ((void) (ptr), (void) (size))
+#define MM_PROF_FREE(ptr) ((void) 0)
+#define MM_PROF_MOVE(old_ptr, new_ptr) ((void) 0)
+#define MM_PROF_ENTER() ((void) 0)
+#define MM_PROF_LEAVE() ((void) 0)
+#endif
+
+#endif /* MM_PROF_H */
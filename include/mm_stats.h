@@ -0,0 +1,63 @@
+#ifndef MM_STATS_H
+#define MM_STATS_H
+
+/*
+ * Helpers for the allocators to keep the statistics reported by
+ * mm_get_stats up to date as they go. Building with -DMM_NO_STATS turns
+ * every update into a no-op, and mm_get_stats then reports only the heap
+ * size.
+ */
+
+#include "mm.h"
+
+/** Returns the size class of a free block with `size` payload bytes */
+static inline int mm_stats_class(size_t size) {
+    int k;
+    if (size < 32) {
+        return 0;
+    }
+    k = (int) (8 * sizeof(unsigned long)) - 1 - __builtin_clzl(size) - 4;
+    return k < MM_STATS_CLASSES ? k : MM_STATS_CLASSES - 1;
+}
+
+/** Returns the bucket of a work histogram that a call doing `n` units falls in */
+static inline int mm_stats_bucket(uint64_t n) {
+    int k;
+    if (n == 0) {
+        return 0;
+    }
+    k = 64 - __builtin_clzll(n);
+    return k < MM_STATS_HIST ? k : MM_STATS_HIST - 1;
+}
+
+#ifndef MM_NO_STATS
+/** Counts one more event of kind `field` */
+#define MM_STAT_INC(stats, field) ((stats).field++)
+/** Counts a free block of `size` payload bytes entering (+1) or leaving (-1) */
+#define MM_STAT_FREE_BLOCK(stats, size, delta)                                           \
+    ((stats).free_blocks[mm_stats_class(size)] += (delta),                              \
+     (stats).free_bytes += (size_t) (delta) * (size))
+/** Counts an allocated block of `size` payload bytes appearing (+1) or going (-1) */
+#define MM_STAT_ALLOC_BLOCK(stats, size, delta)                                          \
+    ((stats).allocated_blocks += (delta), (stats).allocated_bytes += (size_t) (delta) * (size))
+/** Counts a call that did `n` units of work in the histogram `field` */
+#define MM_STAT_HIST(stats, field, n) ((stats).field[mm_stats_bucket(n)]++)
+/** Counts a realloc of an existing block to `size` bytes that copied `copied` bytes */
+#define MM_STAT_REALLOC(stats, size, moved, copied)                                      \
+    ((moved) ? (stats).realloc_moved++ : (stats).realloc_in_place++,                    \
+     (stats).realloc_requested += (size), (stats).realloc_copied += (copied))
+/** Counts a fit search that examined `n` blocks */
+#define MM_STAT_FIT_SEARCH(stats, n)                                                     \
+    (MM_STAT_HIST(stats, fit_searched, n), (stats).fit_searched_blocks += (n),          \
+     (stats).fit_searched_max =                                                          \
+         ((n) > (stats).fit_searched_max) ? (n) : (stats).fit_searched_max)
+#else
+#define MM_STAT_INC(stats, field) ((void) 0)
+#define MM_STAT_FREE_BLOCK(stats, size, delta) ((void) 0)
+#define MM_STAT_ALLOC_BLOCK(stats, size, delta) ((void) 0)
+#define MM_STAT_HIST(stats, field, n) ((void) (n))
+#define MM_STAT_FIT_SEARCH(stats, n) ((void) (n))
+#define MM_STAT_REALLOC(stats, size, moved, copied) ((void) 0)
+#endif
+
+#endif /* MM_STATS_H */
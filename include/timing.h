@@ -0,0 +1,36 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* How timing_measure runs a benchmark */
+typedef struct {
+    int cpu;          /* CPU to pin to, or -1 to leave the affinity alone */
+    int warmups;      /* untimed runs before the timed ones */
+    int reps;         /* timed runs */
+    bool detect_freq; /* watch for CPU frequency changes during timed runs */
+} timing_config_t;
+
+/* The distribution of the timed runs of one benchmark, in seconds */
+typedef struct {
+    double median;
+    double mad;          /* median absolute deviation from the median */
+    double ci_lo, ci_hi; /* ~95% confidence interval for the median */
+    double min;
+    int reps;
+    int freq_changes; /* timed runs during which the frequency changed, or -1 */
+} timing_result_t;
+
+typedef void (*timing_funct)(void *);
+
+void timing_init(const timing_config_t *config);
+void timing_deinit(void);
+void timing_measure(timing_funct setup, timing_funct body, void *arg,
+                    timing_result_t *result);
+
+uint64_t timing_ticks(void);
+double timing_ticks_to_secs(uint64_t ticks);
+const char *timing_clock_name(void);
+
+#endif /* TIMING_H */
@@ -0,0 +1,1193 @@
+/*
+ * mbench.c - Classic single-threaded allocator workloads
+ *
+ * Runs a handful of well-known allocator benchmarks against the malloc
+ * package in mm.c and, optionally, against libc malloc. Unlike the
+ * trace files used by mdriver, these workloads compute something with
+ * the memory they allocate, so their allocation patterns (object
+ * lifetimes, size mixes, realloc growth) come from real data structures.
+ *
+ *   cfrac     - bignum arithmetic churning through short-lived digit arrays
+ *   espresso  - phases of mixed-size set objects with a few survivors
+ *   glibc     - glibc bench-malloc style random sizes in a fixed slot array
+ *   rbtree    - red-black tree build followed by a full teardown
+ *   parser    - tokenizer building a symbol table and growing string buffers
+ *
+ * For each workload we report the time, the peak number of live payload
+ * bytes, and (for mm only) mem_heapsize() together with the resulting
+ * utilization.
+ *
+ * With -S <secs>, mbench instead soaks mm for that long with a random
+ * workload whose live set is bounded, reporting the heap size, utilization,
+ * throughput and call latencies over time, and flags a heap that keeps
+ * growing or throughput that keeps falling once the heap has warmed up.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef __GCC__
+#define __attribute__(args)
+#endif
+
+#include "../include/memlib.h"
+#include "../include/mm.h"
+#include "../include/mm_prof.h"
+#include "../include/timing.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define DEFAULT_SCALE 1   /* multiplier for the amount of work per workload */
+#define DEFAULT_REPS 5    /* timed runs of each workload */
+#define DEFAULT_WARMUPS 1 /* untimed runs of each workload */
+#define DEFAULT_PROF_INTERVAL 65536 /* mean bytes between heap profile samples */
+
+#define DEFAULT_SOAK_LIVE (16 << 20) /* bound on the soak's live payload bytes */
+#define SOAK_SLOTS (1 << 16)         /* ... and on its live blocks */
+#define SOAK_PHASE_OPS 1000000       /* calls between changes of the live target */
+#define SOAK_RECENT 64               /* short-lived blocks are freed from the newest */
+#define SOAK_LATENCY_BUCKETS 512     /* log-linear latency histogram (see soak_bucket) */
+#define SOAK_DRIFT 0.05              /* tolerated heap growth after the warm-up */
+#define SOAK_SLOWDOWN 0.10           /* tolerated drop in throughput after the warm-up */
+
+/*****************************
+ * The allocators under test
+ ****************************/
+
+/* The operations a workload may perform on an allocator */
+typedef struct {
+    const char *name;
+    bool (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    bool uses_memlib; /* does the heap live in memlib.c? */
+} allocator_t;
+
+static bool libc_init(void) {
+    return true;
+}
+
+static const allocator_t mm_allocator = {"mm", mm_init, mm_malloc, mm_free, mm_realloc,
+                                         true};
+static const allocator_t libc_allocator = {"libc", libc_init, malloc, free, realloc,
+                                           false};
+
+/* Summarizes one run of a workload on an allocator */
+typedef struct {
+    double secs;       /* time needed to run the workload (median of runs) */
+    double secs_mad;   /* median absolute deviation of the runs */
+    double ops;        /* number of malloc/free/realloc calls */
+    size_t peak_live;  /* high water mark of live payload bytes */
+    size_t heapsize;   /* mem_heapsize() at the end (mm only) */
+    unsigned checksum; /* result of the computation, to keep it honest */
+} result_t;
+
+/********************
+ * Global variables
+ *******************/
+
+static const allocator_t *alloc; /* the allocator the workloads run against */
+static int scale = DEFAULT_SCALE;
+/* cpu -2 means "pin to whichever CPU we start on" */
+static timing_config_t timing_config = {-2, DEFAULT_WARMUPS, DEFAULT_REPS, false};
+static char *prof_path = NULL; /* where to write a heap profile of mm, if anywhere */
+static size_t prof_interval = DEFAULT_PROF_INTERVAL;
+static mm_prof_format_t prof_format = MM_PROF_TEXT;
+static double soak_secs = 0;     /* soak for this long instead of running the workloads */
+static double soak_interval = 0; /* seconds between soak reports; 0: soak_secs / 20 */
+static size_t soak_live = DEFAULT_SOAK_LIVE;
+
+/* Accounting for the current run, maintained by the b_* wrappers below */
+static size_t live_bytes;
+static size_t peak_bytes;
+static unsigned long num_calls;
+static unsigned checksum;
+
+/*********************
+ * Function prototypes
+ *********************/
+
+static void usage(void);
+static void app_error(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2), noreturn));
+
+/***********************************************
+ * Allocation wrappers used by all the workloads
+ **********************************************/
+
+/*
+ * The workloads always know the size of the objects they release, so the
+ * wrappers can keep exact live-byte accounting without storing anything
+ * in the blocks themselves. The b_try_* wrappers return NULL, with the
+ * accounting unchanged, when the allocator fails; the others give up.
+ */
+static void *b_try_malloc(size_t size) {
+    void *p = alloc->malloc(size);
+    if (p == NULL) {
+        return NULL;
+    }
+    num_calls++;
+    live_bytes += size;
+    if (live_bytes > peak_bytes) {
+        peak_bytes = live_bytes;
+    }
+    return p;
+}
+
+static void *b_malloc(size_t size) {
+    void *p = b_try_malloc(size);
+    if (p == NULL) {
+        app_error("%s: malloc(%zu) failed", alloc->name, size);
+    }
+    return p;
+}
+
+static void b_free(void *ptr, size_t size) {
+    alloc->free(ptr);
+    num_calls++;
+    live_bytes -= size;
+}
+
+static void *b_try_realloc(void *ptr, size_t old_size, size_t size) {
+    void *p = alloc->realloc(ptr, size);
+    if (p == NULL) {
+        return NULL;
+    }
+    num_calls++;
+    live_bytes += size - old_size;
+    if (live_bytes > peak_bytes) {
+        peak_bytes = live_bytes;
+    }
+    return p;
+}
+
+static void *b_realloc(void *ptr, size_t old_size, size_t size) {
+    void *p = b_try_realloc(ptr, old_size, size);
+    if (p == NULL) {
+        app_error("%s: realloc(%zu) failed", alloc->name, size);
+    }
+    return p;
+}
+
+/*
+ * A small xorshift generator, so the workloads do the same thing on every
+ * run regardless of what else uses random().
+ */
+static uint64_t rng_state;
+
+static void rng_seed(uint64_t seed) {
+    rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+}
+
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t) (rng_state >> 16);
+}
+
+/* Returns a random number in [lo, hi] */
+static size_t rng_range(size_t lo, size_t hi) {
+    return lo + rng_next() % (hi - lo + 1);
+}
+
+/*****************************************************************
+ * cfrac - bignum churn. Numbers are arrays of 16-bit limbs and every
+ * arithmetic result is a freshly allocated number, so most blocks live
+ * for only a few operations.
+ ****************************************************************/
+
+#define CFRAC_MAX_LIMBS 48
+
+typedef struct {
+    size_t len;        /* number of limbs in use */
+    uint16_t limbs[];  /* little-endian limbs */
+} bignum_t;
+
+static size_t bn_bytes(size_t len) {
+    return sizeof(bignum_t) + len * sizeof(uint16_t);
+}
+
+static bignum_t *bn_new(size_t len) {
+    bignum_t *n = b_malloc(bn_bytes(len));
+    n->len = len;
+    memset(n->limbs, 0, len * sizeof(uint16_t));
+    return n;
+}
+
+static void bn_free(bignum_t *n) {
+    b_free(n, bn_bytes(n->len));
+}
+
+static bignum_t *bn_from(uint32_t v) {
+    bignum_t *n = bn_new(2);
+    n->limbs[0] = v & 0xFFFF;
+    n->limbs[1] = v >> 16;
+    return n;
+}
+
+/* Drops leading zero limbs (and any limbs past CFRAC_MAX_LIMBS) */
+static bignum_t *bn_trim(bignum_t *n) {
+    size_t len = n->len < CFRAC_MAX_LIMBS ? n->len : CFRAC_MAX_LIMBS;
+    while (len > 1 && n->limbs[len - 1] == 0) {
+        len--;
+    }
+    if (len == n->len) {
+        return n;
+    }
+    bignum_t *t = bn_new(len);
+    memcpy(t->limbs, n->limbs, len * sizeof(uint16_t));
+    bn_free(n);
+    return t;
+}
+
+static bignum_t *bn_add(const bignum_t *a, const bignum_t *b) {
+    size_t len = (a->len > b->len ? a->len : b->len) + 1;
+    bignum_t *r = bn_new(len);
+    uint32_t carry = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint32_t s = carry;
+        s += i < a->len ? a->limbs[i] : 0;
+        s += i < b->len ? b->limbs[i] : 0;
+        r->limbs[i] = s & 0xFFFF;
+        carry = s >> 16;
+    }
+    return bn_trim(r);
+}
+
+static bignum_t *bn_mul(const bignum_t *a, const bignum_t *b) {
+    bignum_t *r = bn_new(a->len + b->len);
+    for (size_t i = 0; i < a->len; i++) {
+        uint32_t carry = 0;
+        for (size_t j = 0; j < b->len; j++) {
+            uint32_t t = (uint32_t) a->limbs[i] * b->limbs[j] + r->limbs[i + j] + carry;
+            r->limbs[i + j] = t & 0xFFFF;
+            carry = t >> 16;
+        }
+        r->limbs[i + b->len] = carry;
+    }
+    return bn_trim(r);
+}
+
+static void run_cfrac(void) {
+    /* A pool of partial results, replaced as the computation proceeds */
+    enum { POOL = 64 };
+    bignum_t *pool[POOL];
+    for (int i = 0; i < POOL; i++) {
+        pool[i] = bn_from(rng_next());
+    }
+
+    for (long step = 0; step < 40000L * scale; step++) {
+        int i = rng_next() % POOL;
+        int j = rng_next() % POOL;
+        bignum_t *factor = bn_from(rng_next() | 1);
+        bignum_t *prod = bn_mul(pool[i], factor);
+        bignum_t *sum = bn_add(prod, pool[j]);
+        bn_free(factor);
+        bn_free(prod);
+        checksum += sum->limbs[0];
+        bn_free(pool[i]);
+        pool[i] = sum;
+    }
+
+    for (int i = 0; i < POOL; i++) {
+        bn_free(pool[i]);
+    }
+}
+
+/*****************************************************************
+ * espresso - logic minimization allocates "cube" sets of many
+ * different sizes in phases, grows some of them, and throws most of a
+ * phase away when it finishes. A few results survive into later phases.
+ ****************************************************************/
+
+typedef struct {
+    uint8_t *bits;
+    size_t size;
+} cube_t;
+
+/* espresso's set sizes cluster at a few word counts with a long tail */
+static size_t espresso_size(void) {
+    uint32_t r = rng_next() % 100;
+    if (r < 50) return rng_range(8, 32);
+    if (r < 80) return rng_range(33, 128);
+    if (r < 95) return rng_range(129, 1024);
+    return rng_range(1025, 8192);
+}
+
+static void run_espresso(void) {
+    enum { PHASE_CUBES = 512, SURVIVORS = 256 };
+    cube_t phase[PHASE_CUBES];
+    cube_t survivors[SURVIVORS];
+    int next_survivor = 0;
+
+    memset(survivors, 0, sizeof(survivors));
+    for (long p = 0; p < 150L * scale; p++) {
+        int n = rng_range(PHASE_CUBES / 4, PHASE_CUBES);
+        for (int i = 0; i < n; i++) {
+            phase[i].size = espresso_size();
+            phase[i].bits = b_malloc(phase[i].size);
+            memset(phase[i].bits, i, phase[i].size);
+            /* Some sets are extended while the phase is running */
+            if (rng_next() % 8 == 0) {
+                size_t grown = phase[i].size * 2;
+                phase[i].bits = b_realloc(phase[i].bits, phase[i].size, grown);
+                phase[i].size = grown;
+            }
+        }
+
+        /* Keep a handful of results, evicting the oldest survivors */
+        for (int i = 0; i < n; i++) {
+            checksum += phase[i].bits[0];
+            if (rng_next() % 32 == 0) {
+                cube_t *slot = &survivors[next_survivor++ % SURVIVORS];
+                if (slot->bits != NULL) {
+                    b_free(slot->bits, slot->size);
+                }
+                *slot = phase[i];
+            }
+            else {
+                b_free(phase[i].bits, phase[i].size);
+            }
+        }
+    }
+
+    for (int i = 0; i < SURVIVORS; i++) {
+        if (survivors[i].bits != NULL) {
+            b_free(survivors[i].bits, survivors[i].size);
+        }
+    }
+}
+
+/*****************************************************************
+ * glibc - modelled on glibc's bench-malloc-thread: a fixed array of
+ * slots, each iteration frees a random slot and refills it with a block
+ * whose size is biased towards small requests.
+ ****************************************************************/
+
+static size_t glibc_size(void) {
+    /* Roughly the distribution used by bench-malloc-thread */
+    uint32_t r = rng_next() % 1000;
+    if (r < 700) return rng_range(1, 128);
+    if (r < 950) return rng_range(129, 1024);
+    if (r < 995) return rng_range(1025, 4096);
+    return rng_range(4097, 32768);
+}
+
+static void run_glibc(void) {
+    enum { SLOTS = 1024 };
+    void *slots[SLOTS] = {NULL};
+    size_t sizes[SLOTS] = {0};
+
+    for (long i = 0; i < 200000L * scale; i++) {
+        int s = rng_next() % SLOTS;
+        if (slots[s] != NULL) {
+            b_free(slots[s], sizes[s]);
+        }
+        sizes[s] = glibc_size();
+        slots[s] = b_malloc(sizes[s]);
+        *(char *) slots[s] = (char) i;
+    }
+
+    for (int s = 0; s < SLOTS; s++) {
+        if (slots[s] != NULL) {
+            checksum += *(unsigned char *) slots[s];
+            b_free(slots[s], sizes[s]);
+        }
+    }
+}
+
+/*****************************************************************
+ * rbtree - insert random keys into a red-black tree, then free the
+ * whole tree. All nodes have the same size, which rewards allocators
+ * that recycle equal-sized blocks well.
+ ****************************************************************/
+
+typedef struct rb_node {
+    struct rb_node *left, *right, *parent;
+    uint32_t key;
+    bool red;
+} rb_node_t;
+
+static void rb_rotate_left(rb_node_t **root, rb_node_t *x) {
+    rb_node_t *y = x->right;
+    x->right = y->left;
+    if (y->left != NULL) y->left->parent = x;
+    y->parent = x->parent;
+    if (x->parent == NULL)
+        *root = y;
+    else if (x == x->parent->left)
+        x->parent->left = y;
+    else
+        x->parent->right = y;
+    y->left = x;
+    x->parent = y;
+}
+
+static void rb_rotate_right(rb_node_t **root, rb_node_t *x) {
+    rb_node_t *y = x->left;
+    x->left = y->right;
+    if (y->right != NULL) y->right->parent = x;
+    y->parent = x->parent;
+    if (x->parent == NULL)
+        *root = y;
+    else if (x == x->parent->right)
+        x->parent->right = y;
+    else
+        x->parent->left = y;
+    y->right = x;
+    x->parent = y;
+}
+
+static void rb_insert(rb_node_t **root, uint32_t key) {
+    rb_node_t *parent = NULL;
+    rb_node_t **link = root;
+    while (*link != NULL) {
+        parent = *link;
+        link = key < parent->key ? &parent->left : &parent->right;
+    }
+
+    rb_node_t *z = b_malloc(sizeof(rb_node_t));
+    z->left = z->right = NULL;
+    z->parent = parent;
+    z->key = key;
+    z->red = true;
+    *link = z;
+
+    /* Restore the red-black properties */
+    while (z->parent != NULL && z->parent->red) {
+        rb_node_t *g = z->parent->parent;
+        if (z->parent == g->left) {
+            rb_node_t *uncle = g->right;
+            if (uncle != NULL && uncle->red) {
+                z->parent->red = uncle->red = false;
+                g->red = true;
+                z = g;
+                continue;
+            }
+            if (z == z->parent->right) {
+                z = z->parent;
+                rb_rotate_left(root, z);
+            }
+            z->parent->red = false;
+            g->red = true;
+            rb_rotate_right(root, g);
+        }
+        else {
+            rb_node_t *uncle = g->left;
+            if (uncle != NULL && uncle->red) {
+                z->parent->red = uncle->red = false;
+                g->red = true;
+                z = g;
+                continue;
+            }
+            if (z == z->parent->left) {
+                z = z->parent;
+                rb_rotate_right(root, z);
+            }
+            z->parent->red = false;
+            g->red = true;
+            rb_rotate_left(root, g);
+        }
+    }
+    (*root)->red = false;
+}
+
+/* Frees a subtree in post-order, returning the sum of its keys */
+static unsigned rb_teardown(rb_node_t *node) {
+    if (node == NULL) {
+        return 0;
+    }
+    unsigned sum = rb_teardown(node->left) + rb_teardown(node->right) + node->key;
+    b_free(node, sizeof(rb_node_t));
+    return sum;
+}
+
+static void run_rbtree(void) {
+    for (int round = 0; round < 4 * scale; round++) {
+        rb_node_t *root = NULL;
+        for (int i = 0; i < 50000; i++) {
+            rb_insert(&root, rng_next());
+        }
+        checksum += rb_teardown(root);
+    }
+}
+
+/*****************************************************************
+ * parser - tokenizes generated text, interns every identifier in a
+ * chained hash table whose bucket array grows by realloc, and builds
+ * output lines in buffers that grow by doubling.
+ ****************************************************************/
+
+typedef struct symbol {
+    struct symbol *next;
+    size_t len;
+    unsigned count;
+    char name[];
+} symbol_t;
+
+typedef struct {
+    symbol_t **buckets;
+    size_t num_buckets;
+    size_t num_symbols;
+} symtab_t;
+
+static size_t sym_bytes(size_t len) {
+    return sizeof(symbol_t) + len + 1;
+}
+
+static unsigned hash_name(const char *s, size_t len) {
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char) s[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void symtab_grow(symtab_t *tab) {
+    size_t old = tab->num_buckets;
+    size_t n = old * 2;
+    tab->buckets = b_realloc(tab->buckets, old * sizeof(symbol_t *), n * sizeof(symbol_t *));
+    memset(tab->buckets + old, 0, old * sizeof(symbol_t *));
+    tab->num_buckets = n;
+
+    /* Rehash the entries of the old buckets */
+    for (size_t b = 0; b < old; b++) {
+        symbol_t **link = &tab->buckets[b];
+        while (*link != NULL) {
+            symbol_t *sym = *link;
+            size_t nb = hash_name(sym->name, sym->len) & (n - 1);
+            if (nb != b) {
+                *link = sym->next;
+                sym->next = tab->buckets[nb];
+                tab->buckets[nb] = sym;
+            }
+            else {
+                link = &sym->next;
+            }
+        }
+    }
+}
+
+static void symtab_intern(symtab_t *tab, const char *s, size_t len) {
+    size_t b = hash_name(s, len) & (tab->num_buckets - 1);
+    for (symbol_t *sym = tab->buckets[b]; sym != NULL; sym = sym->next) {
+        if (sym->len == len && memcmp(sym->name, s, len) == 0) {
+            sym->count++;
+            return;
+        }
+    }
+    symbol_t *sym = b_malloc(sym_bytes(len));
+    sym->len = len;
+    sym->count = 1;
+    memcpy(sym->name, s, len);
+    sym->name[len] = '\0';
+    sym->next = tab->buckets[b];
+    tab->buckets[b] = sym;
+    if (++tab->num_symbols > tab->num_buckets) {
+        symtab_grow(tab);
+    }
+}
+
+static void run_parser(void) {
+    static const char *const keywords[] = {"if", "else", "while", "return", "struct",
+                                           "static", "const", "for", "int", "char"};
+    symtab_t tab = {NULL, 16, 0};
+    tab.buckets = b_malloc(tab.num_buckets * sizeof(symbol_t *));
+    memset(tab.buckets, 0, tab.num_buckets * sizeof(symbol_t *));
+
+    for (long line = 0; line < 20000L * scale; line++) {
+        /* Build a line of source text in a buffer that grows as needed */
+        size_t cap = 16, len = 0;
+        char *buf = b_malloc(cap);
+        int words = rng_range(2, 24);
+        for (int w = 0; w < words; w++) {
+            char word[32];
+            size_t wlen;
+            if (rng_next() % 3 == 0) {
+                wlen = strlen(strcpy(word, keywords[rng_next() % 10]));
+            }
+            else {
+                /* Identifiers are drawn from a skewed vocabulary */
+                uint32_t id = rng_next() % (1 + rng_next() % 4096);
+                wlen = (size_t) snprintf(word, sizeof(word), "id_%u", id);
+            }
+            if (len + wlen + 2 > cap) {
+                size_t grown = cap * 2 > len + wlen + 2 ? cap * 2 : len + wlen + 2;
+                buf = b_realloc(buf, cap, grown);
+                cap = grown;
+            }
+            memcpy(buf + len, word, wlen);
+            len += wlen;
+            buf[len++] = ' ';
+        }
+        buf[len] = '\0';
+
+        /* Tokenize the line, interning every word */
+        for (size_t i = 0; i < len;) {
+            size_t start = i;
+            while (i < len && buf[i] != ' ') i++;
+            if (i > start) symtab_intern(&tab, buf + start, i - start);
+            i++;
+        }
+        b_free(buf, cap);
+    }
+
+    /* Tear down the symbol table */
+    for (size_t b = 0; b < tab.num_buckets; b++) {
+        symbol_t *sym = tab.buckets[b];
+        while (sym != NULL) {
+            symbol_t *next = sym->next;
+            checksum += sym->count;
+            b_free(sym, sym_bytes(sym->len));
+            sym = next;
+        }
+    }
+    b_free(tab.buckets, tab.num_buckets * sizeof(symbol_t *));
+}
+
+/*******************************
+ * Running and timing workloads
+ ******************************/
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} workload_t;
+
+static const workload_t workloads[] = {
+    {"cfrac", run_cfrac},   {"espresso", run_espresso}, {"glibc", run_glibc},
+    {"rbtree", run_rbtree}, {"parser", run_parser},
+};
+#define NUM_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+/*
+ * prepare_workload - resets the heap and the accounting before a run
+ */
+static void prepare_workload(void *ptr) {
+    (void) ptr;
+    if (alloc->uses_memlib) {
+        mem_reset_brk(false);
+    }
+    rng_seed(1);
+    live_bytes = 0;
+    peak_bytes = 0;
+    num_calls = 0;
+    checksum = 0;
+}
+
+/*
+ * run_workload - runs a workload once on the heap set up by
+ *     prepare_workload. This is the function that is timed by
+ *     timing_measure(), so it must do the same work every time it is called.
+ */
+static void run_workload(void *ptr) {
+    const workload_t *w = ptr;
+
+    if (!alloc->init()) {
+        app_error("%s: init failed", alloc->name);
+    }
+    w->run();
+}
+
+/*
+ * measure - runs a workload once to collect the space statistics, then
+ *     times it with timing_measure
+ */
+static void measure(const workload_t *w, result_t *res) {
+    timing_result_t timing;
+
+    /* Only this untimed run is profiled */
+    prepare_workload((void *) w);
+    if (prof_path != NULL && alloc->uses_memlib) mm_prof_start(prof_interval);
+    run_workload((void *) w);
+    mm_prof_stop();
+    if (live_bytes != 0) {
+        app_error("%s: %zu bytes still live after %s", alloc->name, live_bytes, w->name);
+    }
+    res->ops = num_calls;
+    res->peak_live = peak_bytes;
+    res->heapsize = alloc->uses_memlib ? mem_heapsize() : 0;
+    res->checksum = checksum;
+
+    timing_measure(prepare_workload, run_workload, (void *) w, &timing);
+    res->secs = timing.median;
+    res->secs_mad = timing.mad;
+}
+
+/*
+ * printresults - prints a summary of every workload run on one allocator
+ */
+static void printresults(const allocator_t *a, const bool *selected, result_t *results) {
+    printf("\nResults for %s malloc:\n", a->name);
+    printf("%-10s%10s%10s%7s%9s%12s%12s%6s\n", "workload", "ops", "secs", "mad", "Kops",
+           "peak", "heapsize", "util");
+    for (size_t i = 0; i < NUM_WORKLOADS; i++) {
+        result_t *r = &results[i];
+        if (!selected[i]) {
+            continue;
+        }
+        printf("%-10s%10.0f%10.6f%6.1f%%%9.0f%12zu", workloads[i].name, r->ops, r->secs,
+               100.0 * r->secs_mad / r->secs, (r->ops / 1e3) / r->secs, r->peak_live);
+        if (a->uses_memlib) {
+            printf("%12zu%5.0f%%\n", r->heapsize,
+                   100.0 * (double) r->peak_live / (double) r->heapsize);
+        }
+        else {
+            printf("%12s%6s\n", "-", "-");
+        }
+    }
+}
+
+static void run_allocator(const allocator_t *a, const bool *selected) {
+    result_t results[NUM_WORKLOADS];
+
+    alloc = a;
+    for (size_t i = 0; i < NUM_WORKLOADS; i++) {
+        if (selected[i]) {
+            measure(&workloads[i], &results[i]);
+        }
+    }
+    printresults(a, selected, results);
+}
+
+/*****************************************************************
+ * soak - drive mm for a long time with a random workload that never
+ * lets the live set outgrow a bound, to catch fragmentation that builds
+ * up too slowly to show in a short run. Blocks are mostly short-lived
+ * (freed from among the newest) with a long-lived minority (freed at
+ * random), sizes follow the glibc workload's mix plus a few large ones,
+ * some blocks grow by realloc, and the target live size moves between
+ * half and all of the bound every SOAK_PHASE_OPS calls.
+ ****************************************************************/
+
+/* A live block of the soak */
+typedef struct {
+    void *ptr;
+    size_t size;
+} soak_block_t;
+
+/* What one soak report interval saw */
+typedef struct {
+    double elapsed;   /* seconds since the soak started, at the end */
+    double ops;       /* calls made */
+    double secs;      /* seconds the interval took */
+    size_t live;      /* live payload bytes at the end */
+    size_t heapsize;  /* mem_heapsize() at the end */
+    uint64_t latency[SOAK_LATENCY_BUCKETS]; /* calls by ticks taken */
+} soak_sample_t;
+
+/*
+ * soak_bucket - the latency bucket of a call that took `ticks`: exact below
+ *     16, then 8 buckets per power of two
+ */
+static int soak_bucket(uint64_t ticks) {
+    int k;
+    if (ticks < 16) {
+        return (int) ticks;
+    }
+    k = 63 - __builtin_clzll(ticks);
+    return 16 + (k - 4) * 8 + (int) ((ticks >> (k - 3)) & 7);
+}
+
+/* Returns the most ticks a call in bucket b may have taken */
+static uint64_t soak_bucket_max(int b) {
+    int k;
+    if (b < 16) {
+        return b;
+    }
+    k = (b - 16) / 8 + 4;
+    return ((uint64_t) (8 + (b - 16) % 8 + 1) << (k - 3)) - 1;
+}
+
+/* Returns the latency in nanoseconds below which a fraction q of the calls fall */
+static double soak_percentile(const uint64_t *latency, double q) {
+    uint64_t calls = 0, seen = 0;
+    int b;
+
+    for (b = 0; b < SOAK_LATENCY_BUCKETS; b++) calls += latency[b];
+    for (b = 0; b < SOAK_LATENCY_BUCKETS; b++) {
+        seen += latency[b];
+        if (seen > 0 && seen >= q * calls) break;
+    }
+    if (b == SOAK_LATENCY_BUCKETS) b--;
+    return timing_ticks_to_secs(soak_bucket_max(b)) * 1e9;
+}
+
+static size_t soak_size(void) {
+    if (rng_next() % 100 == 0) return rng_range(32769, 262144);
+    return glibc_size();
+}
+
+static void print_soak_sample(const soak_sample_t *sample) {
+    printf("%9.1f%12.0f%11zu%11zu%6.1f%%%9.0f%9.0f%10.0f%10.0f\n", sample->elapsed,
+           sample->ops / sample->secs, sample->live, sample->heapsize,
+           (sample->heapsize == 0) ? 0.0 : 100.0 * sample->live / sample->heapsize,
+           soak_percentile(sample->latency, 0.5), soak_percentile(sample->latency, 0.99),
+           soak_percentile(sample->latency, 0.999), soak_percentile(sample->latency, 1));
+}
+
+/*
+ * soak_verdict - judge the samples taken after the warm-up, the first
+ *     quarter of the soak: the heap shouldn't have grown by more than
+ *     SOAK_DRIFT since, and the throughput of their second half shouldn't
+ *     be more than SOAK_SLOWDOWN below that of their first half. Returns
+ *     false if either happened.
+ */
+static bool soak_verdict(const soak_sample_t *samples, int n) {
+    int warm = n / 4, mid, i;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, slope, growth;
+    double ops[2] = {0, 0}, secs[2] = {0, 0}, slowdown;
+    bool ok = true;
+
+    if (n - warm < 4) {
+        printf("\nToo few reports after the warm-up to judge drift; soak longer or "
+               "report more often.\n");
+        return true;
+    }
+
+    /* Heap growth, and its trend by least squares, in bytes per hour */
+    for (i = warm; i < n; i++) {
+        double x = samples[i].elapsed, y = (double) samples[i].heapsize;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    slope = ((n - warm) * sxy - sx * sy) / ((n - warm) * sxx - sx * sx);
+    growth = ((double) samples[n - 1].heapsize - samples[warm].heapsize) /
+             samples[warm].heapsize;
+    printf("\nAfter the warm-up (%.0f s): heap grew %.1f%%, trend %.0f bytes/hour\n",
+           samples[warm].elapsed, 100.0 * growth, slope * 3600);
+    if (growth > SOAK_DRIFT) {
+        printf("DRIFT: the heap kept growing with a bounded live set\n");
+        ok = false;
+    }
+
+    /* Throughput of the first and second half */
+    mid = warm + (n - warm) / 2;
+    for (i = warm; i < n; i++) {
+        ops[i >= mid] += samples[i].ops;
+        secs[i >= mid] += samples[i].secs;
+    }
+    slowdown = 1 - (ops[1] / secs[1]) / (ops[0] / secs[0]);
+    printf("Throughput: %.0f calls/s, then %.0f calls/s (%+.1f%%)\n", ops[0] / secs[0],
+           ops[1] / secs[1], -100.0 * slowdown);
+    if (slowdown > SOAK_SLOWDOWN) {
+        printf("SLOWDOWN: throughput kept falling\n");
+        ok = false;
+    }
+    return ok;
+}
+
+/*
+ * run_soak - soak mm for soak_secs, reporting every soak_interval seconds.
+ *     Returns false if the heap drifted or the throughput degraded.
+ */
+static bool run_soak(void) {
+    /* blocks[0..num_old) are in no order; blocks[num_old..num_live) are the
+       newest blocks still live, at most SOAK_RECENT of them, oldest first */
+    soak_block_t *blocks = malloc(SOAK_SLOTS * sizeof(*blocks));
+    int max_samples = 64, n = 0, num_live = 0, num_old = 0;
+    soak_sample_t *samples = malloc(max_samples * sizeof(*samples));
+    soak_sample_t current;
+    size_t target = soak_live;
+    uint64_t start, interval_start, end_ticks, interval_ticks;
+    unsigned long calls = 0;
+    bool ok, oom = false;
+
+    if (blocks == NULL || samples == NULL) app_error("Out of memory");
+    if (soak_interval <= 0) soak_interval = soak_secs / 20;
+    alloc = &mm_allocator;
+    prepare_workload(NULL);
+    if (!alloc->init()) {
+        app_error("%s: init failed", alloc->name);
+    }
+
+    printf("Soaking mm malloc for %.0f s, live set up to %zu bytes:\n", soak_secs, soak_live);
+    printf("%9s%12s%11s%11s%7s%9s%9s%10s%10s\n", "secs", "calls/s", "live", "heap", "util",
+           "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+    memset(&current, 0, sizeof(current));
+    start = interval_start = timing_ticks();
+    end_ticks = start + (uint64_t) (soak_secs / timing_ticks_to_secs(1));
+    interval_ticks = (uint64_t) (soak_interval / timing_ticks_to_secs(1));
+
+    for (;;) {
+        uint32_t r = rng_next() % 100;
+        soak_block_t *grow = NULL;
+        size_t size = 0;
+        uint64_t t0, t1;
+        int i;
+
+        if (calls++ % SOAK_PHASE_OPS == 0) {
+            target = soak_live / 2 + rng_next() % (soak_live / 2 + 1);
+        }
+
+        /* Pick the next call; growing or allocating must stay within soak_live */
+        if (num_live > 0 && r < 5) {
+            /* Grow a block, as a buffer or array would */
+            grow = &blocks[rng_next() % num_live];
+            if (live_bytes + grow->size / 2 + 1 > soak_live) grow = NULL;
+        }
+        else if (num_live < SOAK_SLOTS && (num_live == 0 || (live_bytes < target && r < 55))) {
+            size = soak_size();
+            if (num_live > 0 && live_bytes + size > soak_live) size = 0;
+        }
+
+        /* The heap running out is the worst drift of all, so it isn't fatal */
+        t0 = timing_ticks();
+        if (grow != NULL) {
+            size_t grown = grow->size + grow->size / 2 + 1;
+            void *p = b_try_realloc(grow->ptr, grow->size, grown);
+            if (p == NULL) {
+                oom = true;
+                break;
+            }
+            grow->ptr = p;
+            grow->size = grown;
+        }
+        else if (size > 0) {
+            void *p = b_try_malloc(size);
+            if (p == NULL) {
+                oom = true;
+                break;
+            }
+            blocks[num_live].ptr = p;
+            blocks[num_live].size = size;
+            *(char *) p = (char) calls;
+            num_live++;
+            if (num_live - num_old > SOAK_RECENT) num_old++;
+        }
+        else {
+            /* Most blocks die young; the rest live for a random while */
+            if (r < 75 && num_live > SOAK_RECENT && num_live > num_old)
+                i = num_old + rng_next() % (num_live - num_old);
+            else
+                i = rng_next() % num_live;
+            checksum += *(unsigned char *) blocks[i].ptr;
+            b_free(blocks[i].ptr, blocks[i].size);
+            if (i < num_old) {
+                /* Refill the hole from the old blocks, whose order doesn't matter */
+                blocks[i] = blocks[--num_old];
+                i = num_old;
+            }
+            /* Close the gap among the newest blocks, keeping them in order */
+            memmove(&blocks[i], &blocks[i + 1], (num_live - i - 1) * sizeof(*blocks));
+            num_live--;
+        }
+        t1 = timing_ticks();
+        current.latency[soak_bucket(t1 - t0)]++;
+        current.ops++;
+
+        if (t1 - interval_start >= interval_ticks || t1 >= end_ticks) {
+            current.elapsed = timing_ticks_to_secs(t1 - start);
+            current.secs = timing_ticks_to_secs(t1 - interval_start);
+            current.live = live_bytes;
+            current.heapsize = mem_heapsize();
+            print_soak_sample(&current);
+            if (n == max_samples) {
+                max_samples *= 2;
+                if ((samples = realloc(samples, max_samples * sizeof(*samples))) == NULL)
+                    app_error("Out of memory");
+            }
+            samples[n++] = current;
+            memset(&current, 0, sizeof(current));
+            if (t1 >= end_ticks) break;
+            interval_start = timing_ticks();
+        }
+    }
+
+    ok = true;
+    if (oom) {
+        printf("\nOUT OF MEMORY after %.0f s, with %zu live bytes in a %zu-byte heap\n",
+               timing_ticks_to_secs(timing_ticks() - start), live_bytes, mem_heapsize());
+        ok = false;
+    }
+    while (num_live > 0) {
+        num_live--;
+        b_free(blocks[num_live].ptr, blocks[num_live].size);
+    }
+    ok = soak_verdict(samples, n) && ok;
+    free(samples);
+    free(blocks);
+    return ok;
+}
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv) {
+    int c;
+    bool run_libc = false;
+    bool selected[NUM_WORKLOADS];
+    bool any_selected = false;
+    bool ok = true;
+
+    memset(selected, 0, sizeof(selected));
+    while ((c = getopt(argc, argv, "w:s:r:C:p:P:F:S:i:L:hl")) != EOF) {
+        switch (c) {
+            case 'w': { /* Run only the named workload(s) */
+                size_t i;
+                for (i = 0; i < NUM_WORKLOADS; i++) {
+                    if (strcmp(optarg, workloads[i].name) == 0) break;
+                }
+                if (i == NUM_WORKLOADS) {
+                    app_error("Unknown workload %s", optarg);
+                }
+                selected[i] = true;
+                any_selected = true;
+                break;
+            }
+
+            case 's': /* Scale the amount of work */
+                scale = atoi(optarg);
+                if (scale < 1) {
+                    app_error("Scale must be at least 1");
+                }
+                break;
+
+            case 'r': /* Number of timed runs per workload */
+                timing_config.reps = atoi(optarg);
+                if (timing_config.reps < 1) {
+                    app_error("Repetitions must be at least 1");
+                }
+                break;
+
+            case 'C': /* Pin to a CPU while timing */
+                timing_config.cpu = atoi(optarg);
+                break;
+
+            case 'l': /* Run libc malloc as well */
+                run_libc = true;
+                break;
+
+            case 'p': /* Write a heap profile of mm */
+                prof_path = optarg;
+                break;
+
+            case 'P': /* Mean bytes between heap profile samples */
+                prof_interval = strtoul(optarg, NULL, 0);
+                if (prof_interval < 1) {
+                    app_error("Sampling interval must be at least 1");
+                }
+                break;
+
+            case 'F': /* Heap profile format */
+                if (strcmp(optarg, "text") == 0) {
+                    prof_format = MM_PROF_TEXT;
+                }
+                else if (strcmp(optarg, "pprof") == 0) {
+                    prof_format = MM_PROF_PPROF;
+                }
+                else {
+                    app_error("Unknown profile format %s (text or pprof)", optarg);
+                }
+                break;
+
+            case 'S': /* Soak mm for this many seconds */
+                soak_secs = atof(optarg);
+                if (soak_secs <= 0) {
+                    app_error("The soak time must be positive");
+                }
+                break;
+
+            case 'i': /* Seconds between soak reports */
+                soak_interval = atof(optarg);
+                if (soak_interval <= 0) {
+                    app_error("The report interval must be positive");
+                }
+                break;
+
+            case 'L': /* Bound on the soak's live bytes */
+                soak_live = strtoul(optarg, NULL, 0);
+                if (soak_live < 1 << 20) {
+                    app_error("The live set bound must be at least 1 MB");
+                }
+                break;
+
+            case 'h': /* Print this message */
+                usage();
+                exit(0);
+
+            default:
+                usage();
+                exit(1);
+        }
+    }
+    if (!any_selected) {
+        for (size_t i = 0; i < NUM_WORKLOADS; i++) {
+            selected[i] = true;
+        }
+    }
+
+    setbuf(stdout, 0);
+    if (timing_config.cpu == -2) timing_config.cpu = sched_getcpu();
+    timing_init(&timing_config);
+
+    if (run_libc && soak_secs == 0) {
+        run_allocator(&libc_allocator, selected);
+    }
+
+    mem_init();
+    if (soak_secs > 0)
+        ok = run_soak();
+    else
+        run_allocator(&mm_allocator, selected);
+    mem_deinit();
+
+    if (prof_path != NULL && !mm_prof_dump(prof_path, prof_format)) {
+        app_error("Could not write the heap profile to %s", prof_path);
+    }
+
+    timing_deinit();
+    return ok ? 0 : 1;
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+void app_error(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    putchar('\n');
+    va_end(ap);
+    exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr,
+            "Usage: mbench [-hl] [-w <workload>] [-s <scale>] [-r <reps>] [-C <cpu>]\n"
+            "              [-p <file>] [-P <bytes>] [-F text|pprof]\n"
+            "              [-S <secs> [-i <secs>] [-L <bytes>]]\n"
+            "Options\n"
+            "\t-h             Print this message.\n"
+            "\t-l             Run libc malloc as well.\n"
+            "\t-w <workload>  Run only <workload> (may be repeated): cfrac, espresso,\n"
+            "\t               glibc, rbtree, parser.\n"
+            "\t-s <scale>     Multiply the work done by every workload by <scale>.\n"
+            "\t-r <reps>      Time <reps> runs of each workload (default 5).\n"
+            "\t-C <cpu>       Pin to CPU <cpu> while timing (-1: don't pin;\n"
+            "\t               default: the CPU mbench starts on).\n"
+            "\t-p <file>      Write a heap profile of mm's untimed runs to <file>.\n"
+            "\t-P <bytes>     Sample about one in every <bytes> allocated bytes\n"
+            "\t               (default 65536).\n"
+            "\t-F <format>    Write the profile as text (default) or for pprof.\n"
+            "\t-S <secs>      Instead of the workloads, soak mm for <secs> with a\n"
+            "\t               random workload, and fail if its heap or throughput\n"
+            "\t               drifts after the warm-up.\n"
+            "\t-i <secs>      Report every <secs> while soaking (default: 20 reports).\n"
+            "\t-L <bytes>     Bound the soak's live payload to <bytes> (default 16 MB).\n");
+}
@@ -0,0 +1,684 @@
+/*
+ * mcapture.c - Capture the allocations of a running program as an mdriver
+ *     trace
+ *
+ * Built as a shared object and loaded with LD_PRELOAD, it interposes on
+ * malloc, free, realloc, calloc, memalign, posix_memalign, aligned_alloc
+ * and malloc_usable_size, and writes every call the program makes to a
+ * trace file that mdriver can replay:
+ *
+ *     gcc -shared -fPIC -O2 mcapture.c -o mcapture.so -ldl -lpthread
+ *     MCAPTURE_FILE=prog.rep LD_PRELOAD=./mcapture.so ./prog
+ *     ./mdriver -f prog.rep
+ *
+ * Each call takes a number from a global sequence counter and appends a
+ * fixed-size record to a ring buffer owned by the calling thread; nothing
+ * else happens on the application's threads. A background thread drains
+ * the rings every few milliseconds, puts the records back in sequence
+ * order, maps pointers to dense block ids and writes the trace lines.
+ *
+ * Frees take their sequence number before the block is released, and
+ * allocations after the block is obtained, so a block released by one
+ * thread and reused by another always shows up freed before it is
+ * allocated again. realloc takes its number after the fact, so another
+ * thread can reuse the old block before the realloc is recorded; the
+ * stale block is then freed in the trace first. Calls whose block was
+ * allocated before the capture started are left out, and so is every
+ * call made by a child after fork.
+ *
+ * Environment:
+ *   MCAPTURE_FILE      the trace to write, with %p replaced by the process id
+ *                      (default mcapture.%p.rep)
+ *   MCAPTURE_RING      records in each thread's ring (default 16384)
+ *   MCAPTURE_INTERVAL  milliseconds between flushes (default 10)
+ *   MCAPTURE_QUIET     if set, don't print a summary at exit
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define DEFAULT_RING 16384     /* records in each thread's ring */
+#define DEFAULT_INTERVAL 10    /* milliseconds between flushes */
+#define BOOTSTRAP_SIZE 65536   /* bytes handed out while dlsym runs */
+#define OUTBUF_SIZE (1 << 16)  /* bytes of trace lines buffered by the flusher */
+#define HEADER_WIDTH 20        /* width of each trace header field */
+#define MIN_MAP_SLOTS 4096     /* initial size of the pointer map */
+#define MIN_PENDING 4096       /* initial size of the reorder heap */
+
+/* The recorded calls */
+enum { OP_MALLOC, OP_CALLOC, OP_MEMALIGN, OP_REALLOC, OP_FREE, OP_USABLE_SIZE };
+
+/* One recorded call */
+typedef struct {
+    uint64_t seq;    /* position of the call in the capture */
+    uintptr_t ptr;   /* block returned, freed or queried */
+    uintptr_t old;   /* block passed to realloc */
+    uint64_t size;   /* requested size (per element for calloc) */
+    uint32_t arg;    /* calloc's nmemb or memalign's alignment */
+    uint32_t op;
+} record_t;
+
+/* A single-producer, single-consumer ring of records */
+typedef struct ring_t {
+    _Alignas(64) atomic_ulong head; /* next slot the owning thread writes */
+    _Alignas(64) atomic_ulong tail; /* next slot the flusher reads */
+    atomic_int owned;               /* is a live thread writing to it? */
+    struct ring_t *next;            /* in the list of all rings */
+    record_t recs[];
+} ring_t;
+
+/********************
+ * Global variables
+ *******************/
+
+/* The real allocator */
+static void *(*real_malloc)(size_t);
+static void (*real_free)(void *);
+static void *(*real_realloc)(void *, size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+static size_t (*real_malloc_usable_size)(void *);
+
+/* Memory handed out while dlsym looks up the real allocator */
+static char bootstrap[BOOTSTRAP_SIZE] __attribute__((aligned(16)));
+static size_t bootstrap_used;
+
+static atomic_bool capturing;          /* are calls being recorded? */
+static atomic_ulong next_seq;          /* sequence number of the next call */
+static _Atomic(ring_t *) rings;        /* every ring ever created */
+static unsigned long ring_size = DEFAULT_RING;
+static long interval_ms = DEFAULT_INTERVAL;
+static pthread_key_t ring_key;         /* releases a thread's ring when it exits */
+static pthread_t flusher;
+static atomic_bool stopping;
+static atomic_ulong stalls;            /* times a thread waited for a full ring */
+
+/* The ring of this thread, and whether this thread is inside the capture
+   code (whose own allocations are never recorded) */
+static __thread ring_t *my_ring __attribute__((tls_model("initial-exec")));
+static __thread int in_capture __attribute__((tls_model("initial-exec")));
+
+/* Flusher state */
+static int out_fd = -1;
+static char outbuf[OUTBUF_SIZE];
+static size_t outbuf_used;
+static int num_ids, num_ops;
+static unsigned long skipped, conflicts;
+
+/* The pointer map: open addressing, keyed by block address */
+typedef struct {
+    uintptr_t ptr; /* 0 if empty, TOMBSTONE if deleted */
+    int id;
+} slot_t;
+#define TOMBSTONE ((uintptr_t) 1)
+static slot_t *map;
+static size_t map_slots, map_used;
+
+/* The reorder heap: records drained from the rings, min-ordered by seq */
+static record_t *pending;
+static size_t pending_len, pending_cap;
+static uint64_t emit_seq; /* sequence number of the next record to write */
+
+/*********************
+ * Function prototypes
+ *********************/
+
+static void capture_error(const char *msg);
+
+/***********************************
+ * Memory for the capture's own use
+ ***********************************/
+
+/* The capture's tables come from mmap, so they never disturb the heap
+   being captured */
+static void *map_pages(size_t bytes) {
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) capture_error("mmap failed");
+    return p;
+}
+
+static bool is_bootstrap(const void *ptr) {
+    return (const char *) ptr >= bootstrap && (const char *) ptr < bootstrap + BOOTSTRAP_SIZE;
+}
+
+static void *bootstrap_alloc(size_t size) {
+    size_t offset = (bootstrap_used + 15) & ~(size_t) 15;
+    if (offset + size > BOOTSTRAP_SIZE) return NULL;
+    bootstrap_used = offset + size;
+    return bootstrap + offset;
+}
+
+/*
+ * resolve - look up the real allocator. dlsym may allocate, which the
+ *     bootstrap arena takes care of.
+ */
+static void resolve(void) {
+    static int resolving;
+
+    if (real_malloc != NULL || resolving) return;
+    resolving = 1;
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    real_malloc_usable_size = dlsym(RTLD_NEXT, "malloc_usable_size");
+    if (real_malloc == NULL || real_free == NULL || real_realloc == NULL ||
+        real_calloc == NULL)
+        capture_error("cannot find the real allocator");
+    resolving = 0;
+}
+
+/***************************************
+ * Recording, on the application threads
+ ***************************************/
+
+/* Ring destructor: let another thread take the ring over once it is drained */
+static void release_ring(void *ring) {
+    my_ring = NULL; /* later destructors that allocate get a ring of their own */
+    atomic_store_explicit(&((ring_t *) ring)->owned, 0, memory_order_release);
+}
+
+/*
+ * get_ring - the ring of the calling thread, reusing the ring of a thread
+ *     that has exited if one is free
+ */
+static ring_t *get_ring(void) {
+    ring_t *ring;
+
+    if (my_ring != NULL) return my_ring;
+    in_capture++;
+    for (ring = atomic_load(&rings); ring != NULL; ring = ring->next) {
+        int unowned = 0;
+        if (atomic_load(&ring->head) == atomic_load(&ring->tail) &&
+            atomic_compare_exchange_strong(&ring->owned, &unowned, 1))
+            break;
+    }
+    if (ring == NULL) {
+        ring = map_pages(sizeof(ring_t) + ring_size * sizeof(record_t));
+        atomic_init(&ring->owned, 1);
+        ring->next = atomic_load(&rings);
+        while (!atomic_compare_exchange_weak(&rings, &ring->next, ring))
+            ;
+    }
+    pthread_setspecific(ring_key, ring);
+    my_ring = ring;
+    in_capture--;
+    return ring;
+}
+
+/*
+ * record - append a call to the calling thread's ring. If the ring is
+ *     full, wait for the flusher: dropping the record would leave a hole
+ *     in the sequence.
+ */
+static void record(uint32_t op, const void *ptr, const void *old, uint64_t size,
+                   uint32_t arg) {
+    ring_t *ring;
+    unsigned long head;
+    record_t *r;
+
+    if (in_capture || !atomic_load_explicit(&capturing, memory_order_relaxed)) return;
+    ring = get_ring();
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == ring_size) {
+        atomic_fetch_add_explicit(&stalls, 1, memory_order_relaxed);
+        while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == ring_size)
+            sched_yield();
+    }
+    r = &ring->recs[head & (ring_size - 1)];
+    r->seq = atomic_fetch_add_explicit(&next_seq, 1, memory_order_relaxed);
+    r->ptr = (uintptr_t) ptr;
+    r->old = (uintptr_t) old;
+    r->size = size;
+    r->arg = arg;
+    r->op = op;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/*
+ * The interposed allocator
+ */
+void *malloc(size_t size) {
+    void *p;
+
+    if (real_malloc == NULL) {
+        resolve();
+        if (real_malloc == NULL) return bootstrap_alloc(size);
+    }
+    p = real_malloc(size);
+    if (p != NULL) record(OP_MALLOC, p, NULL, size, 0);
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    void *p;
+
+    if (real_calloc == NULL) {
+        resolve();
+        /* bootstrap is zero-initialized and never reused */
+        if (real_calloc == NULL)
+            return (size == 0 || nmemb <= SIZE_MAX / size) ? bootstrap_alloc(nmemb * size)
+                                                           : NULL;
+    }
+    p = real_calloc(nmemb, size);
+    if (p == NULL) return p;
+    if (nmemb <= UINT32_MAX)
+        record(OP_CALLOC, p, NULL, size, nmemb);
+    else /* too big for the trace anyway; skipped when it is written */
+        record(OP_MALLOC, p, NULL, nmemb * size, 0);
+    return p;
+}
+
+void free(void *ptr) {
+    if (ptr == NULL || is_bootstrap(ptr)) return;
+    if (real_free == NULL) resolve();
+    record(OP_FREE, ptr, NULL, 0, 0);
+    real_free(ptr);
+}
+
+void *realloc(void *ptr, size_t size) {
+    void *p;
+
+    if (is_bootstrap(ptr)) {
+        /* Move the block out of the bootstrap arena, without knowing its size */
+        size_t avail = bootstrap + BOOTSTRAP_SIZE - (char *) ptr;
+        if ((p = malloc(size)) != NULL) memcpy(p, ptr, size < avail ? size : avail);
+        return p;
+    }
+    if (real_realloc == NULL) resolve();
+    p = real_realloc(ptr, size);
+    if (p != NULL || (ptr != NULL && size == 0)) record(OP_REALLOC, p, ptr, size, 0);
+    return p;
+}
+
+void *memalign(size_t alignment, size_t size) {
+    void *p;
+
+    if (real_memalign == NULL) resolve();
+    p = real_memalign(alignment, size);
+    if (p != NULL) record(OP_MEMALIGN, p, NULL, size, alignment);
+    return p;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    void *p;
+
+    if (real_aligned_alloc == NULL) resolve();
+    p = real_aligned_alloc(alignment, size);
+    if (p != NULL) record(OP_MEMALIGN, p, NULL, size, alignment);
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    int err;
+
+    if (real_posix_memalign == NULL) resolve();
+    err = real_posix_memalign(memptr, alignment, size);
+    if (err == 0) record(OP_MEMALIGN, *memptr, NULL, size, alignment);
+    return err;
+}
+
+size_t malloc_usable_size(void *ptr) {
+    if (ptr == NULL) return 0;
+    if (is_bootstrap(ptr)) return 0;
+    if (real_malloc_usable_size == NULL) resolve();
+    record(OP_USABLE_SIZE, ptr, NULL, 0, 0);
+    return real_malloc_usable_size(ptr);
+}
+
+/*****************************************
+ * Writing the trace, on the flusher thread
+ *****************************************/
+
+static void write_all(const char *buf, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t n = (offset < 0) ? write(out_fd, buf, len) : pwrite(out_fd, buf, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            capture_error("cannot write the trace");
+        }
+        buf += n;
+        len -= n;
+        if (offset >= 0) offset += n;
+    }
+}
+
+static void flush_outbuf(void) {
+    write_all(outbuf, outbuf_used, -1);
+    outbuf_used = 0;
+}
+
+/* Appends one trace line */
+static void emit(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void emit(const char *fmt, ...) {
+    va_list ap;
+    int n;
+
+    if (outbuf_used + 64 > OUTBUF_SIZE) flush_outbuf();
+    va_start(ap, fmt);
+    n = vsnprintf(outbuf + outbuf_used, OUTBUF_SIZE - outbuf_used, fmt, ap);
+    va_end(ap);
+    outbuf_used += n;
+    num_ops++;
+}
+
+/* The header goes in fixed-width fields, so it can be rewritten in place
+   once the counts are known */
+static void write_header(bool rewrite) {
+    char header[4 * (HEADER_WIDTH + 1) + 1];
+    snprintf(header, sizeof(header), "%*d\n%*d\n%*d\n%*d\n", HEADER_WIDTH, 1, HEADER_WIDTH,
+             num_ids, HEADER_WIDTH, num_ops, HEADER_WIDTH, 0);
+    write_all(header, strlen(header), rewrite ? 0 : -1);
+}
+
+static size_t map_hash(uintptr_t ptr) {
+    return ((ptr >> 4) * 0x9e3779b97f4a7c15ULL) >> 20 & (map_slots - 1);
+}
+
+static void map_insert(uintptr_t ptr, int id);
+
+/* Rebuilds the pointer map with room for twice as many blocks as it holds */
+static void map_grow(void) {
+    slot_t *old = map;
+    size_t old_slots = map_slots, live = 0;
+
+    for (size_t i = 0; i < old_slots; i++) {
+        live += (old[i].ptr > TOMBSTONE);
+    }
+    map_slots = MIN_MAP_SLOTS;
+    while (map_slots < 4 * live) map_slots *= 2;
+    map = map_pages(map_slots * sizeof(slot_t));
+    map_used = 0;
+    for (size_t i = 0; i < old_slots; i++) {
+        if (old[i].ptr > TOMBSTONE) map_insert(old[i].ptr, old[i].id);
+    }
+    if (old != NULL) munmap(old, old_slots * sizeof(slot_t));
+}
+
+static void map_insert(uintptr_t ptr, int id) {
+    size_t i;
+
+    if (2 * (map_used + 1) > map_slots) map_grow();
+    for (i = map_hash(ptr); map[i].ptr > TOMBSTONE; i = (i + 1) & (map_slots - 1))
+        ;
+    if (map[i].ptr == 0) map_used++;
+    map[i].ptr = ptr;
+    map[i].id = id;
+}
+
+/* Removes ptr from the map and returns its id, or -1 if it isn't there */
+static int map_remove(uintptr_t ptr) {
+    if (map_slots == 0) return -1;
+    for (size_t i = map_hash(ptr); map[i].ptr != 0; i = (i + 1) & (map_slots - 1)) {
+        if (map[i].ptr == ptr) {
+            map[i].ptr = TOMBSTONE;
+            return map[i].id;
+        }
+    }
+    return -1;
+}
+
+static int map_find(uintptr_t ptr) {
+    if (map_slots == 0) return -1;
+    for (size_t i = map_hash(ptr); map[i].ptr != 0; i = (i + 1) & (map_slots - 1)) {
+        if (map[i].ptr == ptr) return map[i].id;
+    }
+    return -1;
+}
+
+/*
+ * new_block - give the block at ptr the next id. If ptr is still mapped,
+ *     a realloc released it before being recorded; free the stale id first.
+ */
+static int new_block(uintptr_t ptr) {
+    int stale = map_remove(ptr);
+
+    if (stale >= 0) {
+        emit("f %d\n", stale);
+        conflicts++;
+    }
+    map_insert(ptr, num_ids);
+    return num_ids++;
+}
+
+/*
+ * write_record - translate one record into a trace line
+ */
+static void write_record(const record_t *r) {
+    /* mdriver wants every block to have a payload, so zero-byte requests
+       become one-byte ones */
+    unsigned long size = (r->size > 0) ? r->size : 1;
+    int id;
+
+    /* mdriver reads sizes as 32-bit ints */
+    if (r->size > INT_MAX || r->arg > INT_MAX) {
+        skipped++;
+        if (r->op == OP_REALLOC) map_remove(r->old);
+        return;
+    }
+    switch (r->op) {
+        case OP_MALLOC:
+            emit("a %d %lu\n", new_block(r->ptr), size);
+            break;
+        case OP_CALLOC:
+            if (r->arg == 0) /* mdriver has no calloc of zero elements */
+                emit("a %d 1\n", new_block(r->ptr));
+            else
+                emit("c %d %u %lu\n", new_block(r->ptr), r->arg, size);
+            break;
+        case OP_MEMALIGN:
+            emit("m %d %u %lu\n", new_block(r->ptr), r->arg, size);
+            break;
+        case OP_REALLOC:
+            id = (r->old != 0) ? map_remove(r->old) : -1;
+            if (r->ptr == 0) { /* realloc(ptr, 0) freed the block */
+                if (id >= 0) emit("f %d\n", id);
+                break;
+            }
+            if (id < 0) {
+                /* realloc(NULL, size), or of a block from before the capture */
+                emit("a %d %lu\n", new_block(r->ptr), size);
+                break;
+            }
+            if (map_find(r->ptr) >= 0) {
+                emit("f %d\n", map_remove(r->ptr));
+                conflicts++;
+            }
+            map_insert(r->ptr, id);
+            emit("r %d %lu\n", id, size);
+            break;
+        case OP_FREE:
+            if ((id = map_remove(r->ptr)) >= 0)
+                emit("f %d\n", id);
+            else
+                skipped++;
+            break;
+        case OP_USABLE_SIZE:
+            if ((id = map_find(r->ptr)) >= 0)
+                emit("u %d\n", id);
+            else
+                skipped++;
+            break;
+    }
+}
+
+/* Min-heap on seq */
+static void pending_push(const record_t *r) {
+    size_t i;
+
+    if (pending_len == pending_cap) {
+        size_t cap = pending_cap ? 2 * pending_cap : MIN_PENDING;
+        record_t *grown = map_pages(cap * sizeof(record_t));
+        if (pending != NULL) {
+            memcpy(grown, pending, pending_len * sizeof(record_t));
+            munmap(pending, pending_cap * sizeof(record_t));
+        }
+        pending = grown;
+        pending_cap = cap;
+    }
+    for (i = pending_len++; i > 0 && pending[(i - 1) / 2].seq > r->seq; i = (i - 1) / 2) {
+        pending[i] = pending[(i - 1) / 2];
+    }
+    pending[i] = *r;
+}
+
+static void pending_pop(void) {
+    record_t last = pending[--pending_len];
+    size_t i = 0, child;
+
+    while ((child = 2 * i + 1) < pending_len) {
+        if (child + 1 < pending_len && pending[child + 1].seq < pending[child].seq) child++;
+        if (pending[child].seq >= last.seq) break;
+        pending[i] = pending[child];
+        i = child;
+    }
+    pending[i] = last;
+}
+
+/*
+ * drain - move every record out of the rings, then write the records that
+ *     complete the sequence. At the end of the capture, write them all:
+ *     a thread that was stopped mid-call leaves a hole.
+ */
+static void drain(bool final) {
+    for (ring_t *ring = atomic_load(&rings); ring != NULL; ring = ring->next) {
+        unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; tail++) {
+            pending_push(&ring->recs[tail & (ring_size - 1)]);
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    while (pending_len > 0 && (final || pending[0].seq == emit_seq)) {
+        write_record(&pending[0]);
+        emit_seq = pending[0].seq + 1;
+        pending_pop();
+    }
+    flush_outbuf();
+}
+
+static void *flush_loop(void *arg) {
+    struct timespec pause = {interval_ms / 1000, (interval_ms % 1000) * 1000000};
+
+    (void) arg;
+    in_capture = 1; /* the flusher's own allocations aren't part of the trace */
+    while (!atomic_load(&stopping)) {
+        nanosleep(&pause, NULL);
+        drain(false);
+    }
+    return NULL;
+}
+
+/**************************
+ * Starting and stopping
+ **************************/
+
+static void capture_error(const char *msg) {
+    char line[256];
+    int n = snprintf(line, sizeof(line), "mcapture: %s\n", msg);
+    if (write(STDERR_FILENO, line, n) < 0) {
+        /* nothing more we can do */
+    }
+    _exit(1);
+}
+
+/* A child of fork has no flusher; it runs uncaptured */
+static void stop_in_child(void) {
+    atomic_store(&capturing, false);
+    out_fd = -1;
+}
+
+static unsigned long env_ulong(const char *name, unsigned long dflt) {
+    const char *val = getenv(name);
+    return (val != NULL && *val != '\0') ? strtoul(val, NULL, 0) : dflt;
+}
+
+/*
+ * expand_path - copy a trace file name, replacing %p with the process id so
+ *     that programs the captured one runs don't overwrite its trace
+ */
+static void expand_path(char *path, size_t size, const char *name) {
+    size_t len = 0;
+
+    for (; *name != '\0' && len + 1 < size; name++) {
+        if (name[0] == '%' && name[1] == 'p') {
+            int n = snprintf(path + len, size - len, "%d", (int) getpid());
+            len = (len + n < size) ? len + n : size - 1;
+            name++;
+        } else {
+            path[len++] = *name;
+        }
+    }
+    path[len] = '\0';
+}
+
+__attribute__((constructor)) static void capture_start(void) {
+    char path[PATH_MAX];
+    const char *name = getenv("MCAPTURE_FILE");
+
+    resolve();
+    in_capture++;
+    ring_size = env_ulong("MCAPTURE_RING", DEFAULT_RING);
+    if (ring_size < 2 || (ring_size & (ring_size - 1)) != 0)
+        capture_error("MCAPTURE_RING must be a power of two");
+    interval_ms = (long) env_ulong("MCAPTURE_INTERVAL", DEFAULT_INTERVAL);
+    expand_path(path, sizeof(path), (name != NULL && *name != '\0') ? name : "mcapture.%p.rep");
+    if ((out_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        capture_error("cannot open the trace file");
+    write_header(false);
+
+    if (pthread_key_create(&ring_key, release_ring) != 0)
+        capture_error("pthread_key_create failed");
+    pthread_atfork(NULL, NULL, stop_in_child);
+    if (pthread_create(&flusher, NULL, flush_loop, NULL) != 0)
+        capture_error("cannot start the flusher thread");
+    atomic_store(&capturing, true);
+    in_capture--;
+}
+
+__attribute__((destructor)) static void capture_stop(void) {
+    char line[256];
+    int n;
+
+    if (out_fd < 0 || !atomic_load(&capturing)) return;
+    in_capture++;
+    atomic_store(&capturing, false);
+    atomic_store(&stopping, true);
+    pthread_join(flusher, NULL);
+    drain(true);
+    write_header(true);
+    close(out_fd);
+    out_fd = -1;
+
+    n = snprintf(line, sizeof(line),
+                 "mcapture: %d ops on %d blocks, %lu skipped, %lu reordered, %lu stalls\n",
+                 num_ops, num_ids, skipped, conflicts, atomic_load(&stalls));
+    if (getenv("MCAPTURE_QUIET") == NULL && write(STDERR_FILENO, line, n) < 0) {
+        /* the trace is written; the summary is a courtesy */
+    }
+    in_capture--;
+}
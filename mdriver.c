@@ -7,15 +7,27 @@
  * Copyright (c) 2004, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE
 #include <assert.h>
+#include <dlfcn.h>
 #include <errno.h>
 #include <float.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <math.h>
+#include <sched.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -23,10 +35,14 @@
 #define __attribute__(args)
 #endif
 
+#include "../include/cachesim.h"
+#include "../include/evring.h"
+#include "../include/json.h"
 #include "../include/memlib.h"
 #include "../include/mm.h"
+#include "../include/mm_plugin.h"
+#include "../include/timing.h"
 #include "config.h"
-#include "fsecs.h"
 
 /**********************
  * Constants and macros
@@ -37,6 +53,62 @@
 #define HDRLINES 4         /* number of header lines in a trace file */
 #define LINENUM(i) (i + 5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Long-only command line options */
+enum {
+    OPT_TIMELINE = 256,
+    OPT_TIMELINE_FORMAT,
+    OPT_TIMELINE_DIR,
+    OPT_FRAG,
+    OPT_JSON,
+    OPT_BASELINE,
+    OPT_TOLERANCE,
+    OPT_REPS,
+    OPT_WARMUP,
+    OPT_CPU,
+    OPT_DETECT_FREQ,
+    OPT_JOBS,
+    OPT_PLUGIN,
+    OPT_NO_CALIBRATE,
+    OPT_TOUCH,
+    OPT_STATS,
+    OPT_CHECKHEAP,
+    OPT_CACHESIM,
+    OPT_HEAP_DUMP,
+    OPT_EVENTS,
+    OPT_RSS,
+    OPT_SBRK_COST,
+    OPT_STEADY
+};
+
+/* Maximum number of allocator plugins loaded with --plugin */
+#define MAX_PLUGINS 16
+
+/* Default number of timed and warm-up runs of each trace */
+#define DEFAULT_REPS 11
+#define DEFAULT_WARMUPS 2
+
+/* Most replays that --steady measures */
+#define MAX_STEADY_ITERS 100
+
+/* Throughput must drop by this many MADs before it counts as a regression */
+#define NOISE_MADS 3.0
+
+/* Relative weight of utilization in the performance index */
+#ifdef STAGE0
+#define UTIL_WEIGHT 1.0
+#endif
+
+#ifdef STAGE1
+#define UTIL_WEIGHT 0.6
+#endif
+
+/* Traces that run faster than this are too noisy to gate on by themselves */
+#define MIN_GATED_SECS 1e-4
+
+/* Free space in the fragmentation breakdown is bucketed by powers of two:
+   bucket 0 holds blocks of up to 32 bytes, the last bucket everything larger */
+#define FRAG_BUCKETS 16
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p) ((((unsigned long) (p)) % ALIGNMENT) == 0)
 
@@ -61,12 +133,27 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
-    int index;                          /* index for free() to use later */
-    size_t size;                        /* byte size of alloc/realloc request */
+    enum {
+        ALLOC,      /* a <id> <size> */
+        FREE,       /* f <id> */
+        REALLOC,    /* r <id> <size> */
+        CALLOC,     /* c <id> <nmemb> <size> */
+        MEMALIGN,   /* m <id> <alignment> <size> */
+        SIZED_FREE, /* s <id> <size> */
+        USABLE_SIZE /* u <id> */
+    } type;         /* type of request */
+    int index;      /* index for free() to use later */
+    size_t size;    /* byte size of alloc/realloc request (nmemb * size for calloc) */
+    size_t arg;     /* nmemb for calloc, alignment for memalign */
 } traceop_t;
 
-/* Holds the information for one trace file*/
+/*
+ * Holds the information for one trace file. The requests are kept twice:
+ * as an array of traceop_t for the correctness and utilization passes,
+ * and pre-decoded into a compact structure of arrays for the speed
+ * passes, so that the timed replay loop touches as little driver data as
+ * possible.
+ */
 typedef struct {
     char filename[MAXLINE];
     int ignore_ranges;    /* don't check ranges (i.e. this is too big) */
@@ -74,20 +161,39 @@ typedef struct {
     int num_ops;          /* number of distinct requests */
     int weight;           /* weight for this trace (unused) */
     traceop_t *ops;       /* array of requests */
-    char **blocks;        /* array of ptrs returned by malloc/realloc... */
+    uint8_t *op_types;    /* compact copy of ops: request types... */
+    int32_t *op_indices;  /* ... block indices (-1 for free(NULL))... */
+    uint32_t *op_sizes;   /* ... request sizes (of one element for calloc)... */
+    uint32_t *op_args;    /* ... and nmemb or alignment */
+    char **blocks;        /* array of ptrs returned by malloc/realloc; blocks[-1] */
+                          /* is always NULL, so free(NULL) needs no special case */
     size_t *block_sizes;  /* ... and a corresponding array of payload sizes */
     int *block_rand_base; /* index into random_data, if debug is on */
 } trace_t;
 
 /*
- * Holds the params to the xxx_speed functions, which are timed by fcyc.
- * This struct is necessary because fcyc accepts only a pointer array
- * as input.
+ * Holds the params to the xxx_speed functions, which are timed by
+ * timing_measure. This struct is necessary because timing_measure accepts
+ * only a pointer as input.
  */
 typedef struct {
     trace_t *trace;
 } speed_t;
 
+/*
+ * Breaks the heap down by where its bytes go, at one point in a trace.
+ * The five categories add up to heapsize.
+ */
+typedef struct {
+    size_t heapsize; /* mem_heapsize() at this point */
+    size_t payload;  /* bytes requested by the trace */
+    size_t metadata; /* headers, footers and other allocator bookkeeping */
+    size_t padding;  /* rounding of each request up to mm_padded_size */
+    size_t slack;    /* unsplit remainders handed out along with a block */
+    size_t free;     /* bytes in free blocks, metadata included */
+    size_t free_by_bucket[FRAG_BUCKETS]; /* free bytes by free block size */
+} frag_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* set in read_trace */
@@ -97,14 +203,75 @@ typedef struct {
 
     /* run-time stats defined for both libc and student */
     int valid;   /* was the trace processed correctly by the allocator? */
-    double secs; /* number of secs needed to run the trace */
+    double secs; /* number of secs needed to run the trace (median of runs) */
+    double secs_mad;            /* median absolute deviation of the runs */
+    double secs_ci_lo;          /* ~95% confidence interval of the median */
+    double secs_ci_hi;
+    int freq_changes;           /* runs with a CPU frequency change, or -1 */
+    double overhead_secs;       /* driver overhead subtracted from secs */
 
     /* defined only for the student malloc package */
     double util; /* space utilization for this trace (always 0 for libc) */
 
     /* Note: secs and util are only defined if valid is true */
+
+    /* fragmentation breakdown at peak and end of trace (see --frag) */
+    frag_t frag_peak;
+    frag_t frag_end;
+
+    /* repeated replays on one heap, after the warm-up ones (see --steady) */
+    bool has_steady;
+    double steady_cold_secs;  /* the first replay, on a new heap */
+    double steady_secs;       /* median of the measured replays */
+    size_t steady_warm_heap;  /* heap size after the warm-up */
+    int steady_iters;         /* measured replays */
+    double steady_iter_secs[MAX_STEADY_ITERS];
+    size_t steady_iter_growth[MAX_STEADY_ITERS]; /* heap growth in bytes */
+
+    /* heap growth in the utilization pass, for packages that use memlib */
+    bool has_sbrk;
+    mem_sbrk_stats_t sbrk;
+
+    /* defined only with --stats, for packages that provide mm_get_stats */
+    bool has_alloc_stats;
+    struct mm_stats alloc_stats; /* at the end of the utilization pass */
+
+    /* simulated cache and TLB behaviour by op type (see --cachesim) */
+    bool has_cachesim;
+    uint64_t cachesim_ops[CACHESIM_CLASSES];
+    cachesim_counts_t cachesim[CACHESIM_CLASSES];
+
+    /* the heap's real memory footprint (see --rss) */
+    bool has_rss;
+    long rss_heap_pages; /* pages up to the break at the peak */
+    long rss_pages;      /* ... that the package had made resident */
+    long rss_meta_pages; /* ... resident but holding no allocated payload, or -1 */
+    long rss_end_pages;  /* resident pages at the end of the trace */
+    long minor_faults;   /* during the replay */
 } stats_t;
 
+/* The performance index and the averages it is computed from */
+typedef struct {
+    double avg_util;       /* weighted average utilization */
+    double avg_throughput; /* ops per second over all weighted traces */
+    double p1;             /* utilization component of the index */
+    double p2;             /* throughput component of the index */
+    double perfindex;      /* (p1 + p2) * 100 */
+} perf_t;
+
+/* An open fragmentation timeline file for one trace (see --timeline) */
+typedef struct {
+    FILE *fp;
+    int samples; /* number of samples written so far */
+} timeline_t;
+
+/* Summarizes the free blocks on the heap, filled in by mm_heap_walk */
+typedef struct {
+    size_t free_blocks;  /* number of free blocks */
+    size_t free_bytes;   /* total size of the free blocks, metadata included */
+    size_t largest_free; /* size of the largest free block */
+} free_summary_t;
+
 /********************
  * For debugging.  If debug-mode is on, then we have each block start
  * at a "random" place (a hash of the index), and copy random data
@@ -134,6 +301,234 @@ static char tracedir[MAXLINE] = TRACEDIR;
 /* The filenames of the default tracefiles */
 static char *default_tracefiles[] = {DEFAULT_TRACEFILES, NULL};
 
+/*
+ * Fragmentation timeline. If timeline_interval is nonzero, the utilization
+ * pass samples the heap every timeline_interval ops and writes the samples
+ * for each trace to a file in timeline_dir.
+ */
+static int timeline_interval = 0;
+static enum { TIMELINE_CSV, TIMELINE_JSON } timeline_format = TIMELINE_CSV;
+static char timeline_dir[MAXLINE] = "./";
+
+/* The mm package linked into mdriver, described like a plugin */
+static const mm_plugin_t builtin_mm = {
+    .abi_version = MM_PLUGIN_ABI_VERSION,
+    .size = sizeof(mm_plugin_t),
+    .name = "mm",
+    .flags = MM_PLUGIN_USES_MEMLIB,
+    .init = mm_init,
+    .malloc = mm_malloc,
+    .free = mm_free,
+    .realloc = mm_realloc,
+    .calloc = mm_calloc,
+    .checkheap = mm_checkheap,
+    .heap_walk = mm_heap_walk,
+    .padded_size = mm_padded_size,
+    .memalign = mm_memalign,
+    .free_sized = mm_free_sized,
+    .usable_size = mm_usable_size,
+    .get_stats = mm_get_stats,
+    .checkheap_mode = mm_checkheap_mode,
+    .checkheap_errors = mm_checkheap_errors,
+    .heap_dump = mm_heap_dump,
+};
+
+/* The package under test. The eval_mm_* routines call it through this
+   pointer, so that the same routines can evaluate loaded plugins. */
+static const mm_plugin_t *mm_pkg = &builtin_mm;
+
+/* Allocator plugins to compare with the mm package (see --plugin) */
+static const mm_plugin_t *plugins[MAX_PLUGINS];
+static int num_plugins = 0;
+
+/* libc malloc, described like a plugin so it can be timed the same way */
+static bool libc_init(void) {
+    return true;
+}
+
+static void libc_free_sized(void *ptr, size_t size) {
+    (void) size;
+    free(ptr);
+}
+
+static const mm_plugin_t libc_pkg = {
+    .abi_version = MM_PLUGIN_ABI_VERSION,
+    .size = sizeof(mm_plugin_t),
+    .name = "libc",
+    .flags = 0,
+    .init = libc_init,
+    .malloc = malloc,
+    .free = free,
+    .realloc = realloc,
+    .calloc = calloc,
+    .memalign = memalign,
+    .free_sized = libc_free_sized,
+    .usable_size = malloc_usable_size,
+};
+
+/*
+ * The null allocator hands out addresses from a bump pointer and never
+ * reuses them. The speed passes never touch the blocks, so it doesn't need
+ * any memory: timing it measures the cost of the replay loop itself, which
+ * is subtracted from the time of every real allocator (see --no-calibrate).
+ */
+static uintptr_t null_brk;
+
+static bool null_init(void) {
+    null_brk = 16;
+    return true;
+}
+
+static void *null_malloc(size_t size) {
+    void *p = (void *) null_brk;
+    null_brk += (size + 15) & ~(uintptr_t) 15;
+    return p;
+}
+
+static void null_free(void *ptr) {
+    (void) ptr;
+}
+
+static void *null_realloc(void *ptr, size_t size) {
+    (void) ptr;
+    return (size == 0) ? NULL : null_malloc(size);
+}
+
+static void *null_calloc(size_t nmemb, size_t size) {
+    return null_malloc(nmemb * size);
+}
+
+static void *null_memalign(size_t alignment, size_t size) {
+    null_brk = (null_brk + alignment - 1) & ~(uintptr_t) (alignment - 1);
+    return null_malloc(size);
+}
+
+static void null_free_sized(void *ptr, size_t size) {
+    (void) ptr;
+    (void) size;
+}
+
+static size_t null_usable_size(void *ptr) {
+    (void) ptr;
+    return 0;
+}
+
+static const mm_plugin_t null_pkg = {
+    .abi_version = MM_PLUGIN_ABI_VERSION,
+    .size = sizeof(mm_plugin_t),
+    .name = "null",
+    .flags = 0,
+    .init = null_init,
+    .malloc = null_malloc,
+    .free = null_free,
+    .realloc = null_realloc,
+    .calloc = null_calloc,
+    .memalign = null_memalign,
+    .free_sized = null_free_sized,
+    .usable_size = null_usable_size,
+};
+
+/* If set, subtract the time of the null allocator from every speed result */
+static int calibrate = 1;
+
+/*
+ * How the speed passes touch the blocks, like a program using them would
+ * (see --touch). Touching is done a word per TOUCH_STRIDE bytes, i.e. once
+ * per cache line.
+ */
+#define TOUCH_STRIDE 64
+static struct {
+    bool on_alloc;      /* write every block when it is (re)allocated */
+    int scan_interval;  /* read all live blocks every this many ops */
+    int chase_interval; /* chase pointers through all live blocks every this many ops */
+} touch;
+static volatile long touch_sink; /* keeps the reads from being optimized away */
+
+/*
+ * The cache simulator pass (see --cachesim). Accesses are charged to the
+ * type of the request being served, or to CACHESIM_TOUCH while the blocks
+ * are touched; the touch routines tell the simulator what they touch.
+ */
+#define CACHESIM_TOUCH (CACHESIM_CLASSES - 1)
+#define TOUCHED(p) (cachesim_on ? cachesim_access(p, sizeof(long)) : (void) 0)
+static int cachesim_report = 0;
+static cachesim_config_t cachesim_config;
+static const char *cachesim_class_names[CACHESIM_CLASSES] = {
+    "malloc", "free", "realloc", "calloc", "memalign", "free_sized", "usable_size", "touch"};
+
+/* Number of worker processes checking traces in parallel (see --jobs) */
+static int num_jobs = 1;
+
+/* If set, break down the heap at the peak and at the end of each trace */
+static int frag_report = 0;
+
+/* If set, measure the resident pages and page faults of each trace */
+static int rss_report = 0;
+
+/* If not empty, write heap snapshots at the same points to this directory */
+static char heap_dump_dir[MAXLINE] = "";
+
+/* If set, record every allocator call in the event rings in this file (see evring.h) */
+#define EVENT_SLOTS 65536 /* events per ring */
+static char *events_path = NULL;
+
+/*
+ * If on, every mem_sbrk call costs about what growing the heap costs with a
+ * real kernel (see --sbrk-cost and mem_set_sbrk_cost). The defaults are
+ * rough figures for a brk system call, and for faulting in and zeroing a
+ * 4KB page, on current x86 Linux.
+ */
+#define DEFAULT_SBRK_CALL_NSECS 500
+#define DEFAULT_SBRK_PAGE_NSECS 250
+static struct {
+    bool on;
+    unsigned long call_nsecs;
+    unsigned long page_nsecs;
+} sbrk_cost = {false, DEFAULT_SBRK_CALL_NSECS, DEFAULT_SBRK_PAGE_NSECS};
+
+/*
+ * Steady-state runs (see --steady): each trace is replayed over and over on
+ * the same heap, freeing the blocks it leaves allocated at the end of each
+ * replay, and the replays after the warm-up are timed one by one.
+ */
+#define DEFAULT_STEADY_WARMUPS 3
+static struct {
+    int iters;   /* measured replays; 0 turns steady-state runs off */
+    int warmups; /* replays before them */
+} steady = {0, DEFAULT_STEADY_WARMUPS};
+
+/* If set, report the allocator's own statistics per trace (see --stats) */
+static int stats_report = 0;
+
+/*
+ * How the correctness pass checks the heap after every op (see --checkheap
+ * and mm_checkheap_mode). -D checks the whole heap even without it.
+ */
+#define DEFAULT_CHECK_BLOCKS 64  /* blocks per incremental or sampled check */
+#define DEFAULT_CHECK_PERIOD 100 /* mean ops per sampled check */
+static struct {
+    bool on;
+    mm_check_mode_t mode;
+    size_t blocks;
+    unsigned period;
+} checkheap = {false, MM_CHECK_FULL, DEFAULT_CHECK_BLOCKS, DEFAULT_CHECK_PERIOD};
+
+/*
+ * Machine-readable results and regression gating. Results are written as
+ * JSON to json_path, and compared against the JSON results in
+ * baseline_path. A metric regresses when it is worse than the baseline by
+ * more than its tolerance.
+ */
+static char *json_path = NULL;
+static char *baseline_path = NULL;
+static double util_tolerance = 0.005; /* absolute drop in utilization */
+static double kops_tolerance = 0.10;  /* relative drop in throughput */
+static double perf_tolerance = 1.0;   /* drop in perf index points */
+
+/* How the speed of each trace is measured (see timing.h); cpu -2 means
+   "pin to whichever CPU we start on" */
+static timing_config_t timing_config = {-2, DEFAULT_WARMUPS, DEFAULT_REPS, false};
+
 /*********************
  * Function prototypes
  *********************/
@@ -149,23 +544,61 @@ static void init_random_data(void);
 static void check_index(const trace_t *trace, int opnum, int index);
 static void randomize_block(trace_t *trace, int index);
 
+/* These functions record the fragmentation timeline */
+static void summarize_free_block(const mm_block_info_t *info, void *arg);
+static void timeline_open(timeline_t *timeline, const trace_t *trace);
+static void timeline_sample(timeline_t *timeline, int opnum, size_t live_bytes);
+static void timeline_close(timeline_t *timeline);
+
+/* These functions run the tests on all the traces */
+static trace_t *check_trace(int tracenum, const char *tracedir, const char *tracefile,
+                            stats_t *stats);
+static void run_tests_parallel(int num_tracefiles, const char *tracedir,
+                               char **tracefiles, stats_t *mm_stats,
+                               speed_t *speed_params);
+
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(stats_t *stats, const char *tracedir, const char *filename);
 static void reinit_trace(trace_t *trace);
 static void free_trace(trace_t *trace);
 
-/* Routines for evaluating the correctness and speed of libc malloc */
+/* Routines for evaluating the correctness of libc malloc */
 static int eval_libc_valid(trace_t *trace);
-static void eval_libc_speed(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
+static void eval_mm_frag(trace_t *trace, int tracenum, stats_t *stats);
+static void eval_mm_cachesim(trace_t *trace, int tracenum, stats_t *stats);
+static void eval_mm_rss(trace_t *trace, int tracenum, stats_t *stats);
+static void prepare_mm_speed(void *ptr);
 static void eval_mm_speed(void *ptr);
+static void time_speed(speed_t *speed_params, stats_t *stats);
+static void time_steady(trace_t *trace, stats_t *stats);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printfrag(int n, stats_t *stats);
+static void printallocstats(int n, stats_t *stats);
+static void printrealloc(int n, stats_t *stats);
+static void printsbrk(int n, stats_t *stats);
+static void printcachesim(int n, stats_t *stats);
+static void printrss(int n, stats_t *stats);
+static void printsteady(int n, stats_t *stats);
+static void compute_perf_index(int n, const stats_t *stats, perf_t *perf);
+static void write_json(const char *path, int n, const stats_t *mm_stats,
+                       const stats_t *libc_stats, const perf_t *perf);
+static int compare_baseline(const char *path, int n, const stats_t *stats,
+                            const perf_t *perf);
+static void parse_tolerances(char *spec);
+static void parse_touch(char *spec);
+static void parse_checkheap(char *spec);
+static void parse_cachesim(char *spec);
+static void parse_sbrk_cost(char *spec);
+static void parse_steady(char *spec);
+static const mm_plugin_t *load_plugin(const char *path);
+static void printcomparison(int n, int num_pkgs, const mm_plugin_t **pkgs, stats_t **stats);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3, 4)));
@@ -174,33 +607,213 @@ static void unix_error(const char *fmt, ...)
 static void app_error(const char *fmt, ...)
     __attribute__((format(printf, 1, 2), noreturn));
 
+/*
+ * check_trace - read a trace and run the correctness and space utilization
+ *     passes on it. Returns the trace, which the caller frees.
+ */
+static trace_t *check_trace(int tracenum, const char *tracedir, const char *tracefile,
+                            stats_t *stats) {
+    range_t *ranges = NULL; /* keeps track of block extents for one trace */
+    trace_t *trace;
+
+    trace = read_trace(stats, tracedir, tracefile);
+    strcpy(stats->filename, trace->filename);
+    stats->ops = trace->num_ops;
+    if (verbose > 1) printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, &ranges);
+    clear_ranges(&ranges);
+
+    /* Space utilization is only defined for heaps in memlib.c */
+    if (stats->valid && !onetime_flag && (mm_pkg->flags & MM_PLUGIN_USES_MEMLIB)) {
+        if (verbose > 1) printf("efficiency, ");
+        stats->util = eval_mm_util(trace, tracenum);
+        mem_get_sbrk_stats(&stats->sbrk);
+        stats->has_sbrk = true;
+        if (stats_report && MM_PLUGIN_HAS(mm_pkg, get_stats)) {
+            mm_pkg->get_stats(&stats->alloc_stats);
+            stats->has_alloc_stats = true;
+        }
+        if ((frag_report || heap_dump_dir[0] != '\0') &&
+            MM_PLUGIN_HAS(mm_pkg, heap_walk) && MM_PLUGIN_HAS(mm_pkg, padded_size)) {
+            eval_mm_frag(trace, tracenum, stats);
+        }
+        if (rss_report) {
+            if (verbose > 1) printf("footprint, ");
+            eval_mm_rss(trace, tracenum, stats);
+        }
+    }
+    if (stats->valid && !onetime_flag && cachesim_report) {
+        if (verbose > 1) printf("cache behaviour, ");
+        eval_mm_cachesim(trace, tracenum, stats);
+    }
+    return trace;
+}
+
 /* Run the tests; return the number of tests run (may be less than
    num_tracefiles, if there's a timeout) */
 static void run_tests(int num_tracefiles, const char *tracedir, char **tracefiles,
                       stats_t *mm_stats, speed_t *speed_params) {
     volatile int i;
 
-    range_t *ranges = NULL; /* keeps track of block extents for one trace */
+    if (num_jobs > 1 && !onetime_flag) {
+        run_tests_parallel(num_tracefiles, tracedir, tracefiles, mm_stats, speed_params);
+        return;
+    }
+
     for (i = 0; i < num_tracefiles; i++) {
-        trace_t *trace;
-        trace = read_trace(&mm_stats[i], tracedir, tracefiles[i]);
-        strcpy(mm_stats[i].filename, trace->filename);
-        mm_stats[i].ops = trace->num_ops;
-        if (verbose > 1) printf("Checking mm_malloc for correctness, ");
-        mm_stats[i].valid = eval_mm_valid(trace, &ranges);
-        clear_ranges(&ranges);
+        trace_t *trace = check_trace(i, tracedir, tracefiles[i], &mm_stats[i]);
 
         if (onetime_flag) {
             free_trace(trace);
             return;
         }
         if (mm_stats[i].valid) {
-            if (verbose > 1) printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i);
             speed_params->trace = trace;
             if (verbose > 1) printf("and performance.\n");
-            mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+            time_speed(speed_params, &mm_stats[i]);
+            time_steady(trace, &mm_stats[i]);
+        }
+        free_trace(trace);
+    }
+}
+
+/*****************************************************************
+ * The following routines run the tests in parallel. Worker processes
+ * forked from the driver each get a private copy of the simulated heap
+ * and take traces from a work-stealing queue in shared memory, running
+ * the correctness and utilization passes only. The speed of the valid
+ * traces is then measured one trace at a time by the driver itself, so
+ * that the workers don't disturb the timings.
+ ****************************************************************/
+
+/*
+ * Each worker owns a deque of trace numbers, initially a contiguous slice
+ * of the traces. Its head and tail are packed into one word so that the
+ * owner (popping from the head) and thieves (taking from the tail) can
+ * both update it with a single compare-and-swap.
+ */
+typedef struct {
+    _Atomic uint64_t range; /* tail << 32 | head */
+} job_deque_t;
+
+#define DEQUE_RANGE(head, tail) (((uint64_t) (tail) << 32) | (uint32_t) (head))
+
+/* The shared record of one trace evaluated by a worker */
+typedef struct {
+    stats_t stats;
+    int errors;                                     /* errors found in this trace */
+    enum { JOB_PENDING, JOB_RUNNING, JOB_DONE } state;
+} job_t;
+
+/*
+ * take_job - pop a trace number from our own deque, or else steal one from
+ *     the tail of another worker's deque. Returns -1 when all are empty.
+ */
+static int take_job(job_deque_t *deques, int num_workers, int self) {
+    int k;
+
+    for (k = 0; k < num_workers; k++) {
+        job_deque_t *deque = &deques[(self + k) % num_workers];
+        uint64_t range = atomic_load(&deque->range);
+
+        while ((uint32_t) range < (uint32_t) (range >> 32)) {
+            uint32_t head = range, tail = range >> 32;
+            uint64_t next = (k == 0) ? DEQUE_RANGE(head + 1, tail) : DEQUE_RANGE(head, tail - 1);
+            if (atomic_compare_exchange_weak(&deque->range, &range, next)) {
+                return (k == 0) ? (int) head : (int) tail - 1;
+            }
+        }
+    }
+    return -1;
+}
+
+/*
+ * run_worker - body of a worker process: evaluate traces until there are
+ *     none left
+ */
+static void run_worker(int self, int num_workers, job_deque_t *deques, job_t *jobs,
+                       const char *tracedir, char **tracefiles) {
+    int i;
+
+    while ((i = take_job(deques, num_workers, self)) >= 0) {
+        jobs[i].state = JOB_RUNNING;
+        errors = 0;
+        free_trace(check_trace(i, tracedir, tracefiles[i], &jobs[i].stats));
+        jobs[i].errors = errors;
+        jobs[i].state = JOB_DONE;
+    }
+}
+
+/*
+ * run_tests_parallel - run the correctness and utilization passes in
+ *     num_jobs worker processes, then time the valid traces serially
+ */
+static void run_tests_parallel(int num_tracefiles, const char *tracedir,
+                               char **tracefiles, stats_t *mm_stats,
+                               speed_t *speed_params) {
+    int num_workers = (num_jobs < num_tracefiles) ? num_jobs : num_tracefiles;
+    size_t shared_size = num_tracefiles * sizeof(job_t) + num_workers * sizeof(job_deque_t);
+    job_t *jobs;
+    job_deque_t *deques;
+    int w, i;
+
+    jobs = mmap(NULL, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1,
+                0);
+    if (jobs == MAP_FAILED) unix_error("mmap failed in run_tests_parallel");
+    deques = (job_deque_t *) &jobs[num_tracefiles];
+
+    /* Deal the traces out in contiguous slices */
+    for (w = 0; w < num_workers; w++) {
+        uint32_t head = (uint64_t) num_tracefiles * w / num_workers;
+        uint32_t tail = (uint64_t) num_tracefiles * (w + 1) / num_workers;
+        atomic_init(&deques[w].range, DEQUE_RANGE(head, tail));
+    }
+
+    if (verbose > 1)
+        printf("Checking %d traces for correctness and efficiency in %d workers\n",
+               num_tracefiles, num_workers);
+    /* Don't let the workers inherit (and print again) what is buffered */
+    fflush(stdout);
+    for (w = 0; w < num_workers; w++) {
+        pid_t pid = fork();
+        if (pid < 0) unix_error("fork failed in run_tests_parallel");
+        if (pid == 0) {
+            /* Workers may run on any CPU, and keep their progress messages quiet */
+            timing_deinit();
+            if (verbose > 1) verbose = 1;
+            run_worker(w, num_workers, deques, jobs, tracedir, tracefiles);
+            /* _exit skips stdio, so flush any error messages first */
+            fflush(stdout);
+            _exit(0);
+        }
+    }
+    while (wait(NULL) > 0) {
+    }
+
+    /* Merge the results in trace order, whichever worker produced them */
+    for (i = 0; i < num_tracefiles; i++) {
+        mm_stats[i] = jobs[i].stats;
+        errors += jobs[i].errors;
+        if (jobs[i].state != JOB_DONE) {
+            /* The worker running this trace died */
+            mm_stats[i].valid = 0;
+            errors++;
+            printf("ERROR [trace %s]: worker process died while checking it\n",
+                   tracefiles[i]);
         }
+    }
+    munmap(jobs, shared_size);
+
+    /* Time the valid traces, one at a time */
+    for (i = 0; i < num_tracefiles; i++) {
+        trace_t *trace;
+
+        if (!mm_stats[i].valid) continue;
+        trace = read_trace(&mm_stats[i], tracedir, tracefiles[i]);
+        speed_params->trace = trace;
+        if (verbose > 1) printf("Checking mm_malloc for performance.\n");
+        time_speed(speed_params, &mm_stats[i]);
+        time_steady(trace, &mm_stats[i]);
         free_trace(trace);
     }
 }
@@ -210,20 +823,20 @@ static void run_tests(int num_tracefiles, const char *tracedir, char **tracefile
  **************/
 int main(int argc, char **argv) {
     int i;
-    char c;
+    int c;
     char **tracefiles = NULL; /* null-terminated array of trace file names */
     int num_tracefiles = 0;   /* the number of traces in that array */
 
     stats_t *libc_stats = NULL; /* libc stats for each trace */
     stats_t *mm_stats = NULL;   /* mm (i.e. student) stats for each trace */
+    stats_t *plugin_stats[MAX_PLUGINS] = {NULL}; /* stats for each plugin */
+    int mm_errors;                                /* errors found in mm alone */
     speed_t speed_params;       /* input parameters to the xx_speed routines */
 
     int run_libc = 0; /* If set, run libc malloc (set by -l) */
 
-    /* temporaries used to compute the performance index */
-    double secs, ops, util, avg_mm_util, avg_mm_throughput = 0, p1, p2, perfindex;
-    double weight = 0;
-    int numcorrect;
+    perf_t perf;       /* the performance index */
+    int regressions = 0; /* checks that failed against the baseline */
 
     setbuf(stdout, 0);
     setbuf(stderr, 0);
@@ -231,7 +844,33 @@ int main(int argc, char **argv) {
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:hlD")) != EOF) {
+    static const struct option long_options[] = {
+        {"timeline", required_argument, NULL, OPT_TIMELINE},
+        {"timeline-format", required_argument, NULL, OPT_TIMELINE_FORMAT},
+        {"timeline-dir", required_argument, NULL, OPT_TIMELINE_DIR},
+        {"frag", no_argument, NULL, OPT_FRAG},
+        {"stats", no_argument, NULL, OPT_STATS},
+        {"json", required_argument, NULL, OPT_JSON},
+        {"baseline", required_argument, NULL, OPT_BASELINE},
+        {"tolerance", required_argument, NULL, OPT_TOLERANCE},
+        {"reps", required_argument, NULL, OPT_REPS},
+        {"warmup", required_argument, NULL, OPT_WARMUP},
+        {"cpu", required_argument, NULL, OPT_CPU},
+        {"detect-freq", no_argument, NULL, OPT_DETECT_FREQ},
+        {"jobs", required_argument, NULL, OPT_JOBS},
+        {"plugin", required_argument, NULL, OPT_PLUGIN},
+        {"no-calibrate", no_argument, NULL, OPT_NO_CALIBRATE},
+        {"touch", required_argument, NULL, OPT_TOUCH},
+        {"checkheap", required_argument, NULL, OPT_CHECKHEAP},
+        {"cachesim", optional_argument, NULL, OPT_CACHESIM},
+        {"heap-dump", required_argument, NULL, OPT_HEAP_DUMP},
+        {"events", required_argument, NULL, OPT_EVENTS},
+        {"rss", no_argument, NULL, OPT_RSS},
+        {"sbrk-cost", optional_argument, NULL, OPT_SBRK_COST},
+        {"steady", required_argument, NULL, OPT_STEADY},
+        {NULL, 0, NULL, 0}};
+
+    while ((c = getopt_long(argc, argv, "d:f:c:j:hlD", long_options, NULL)) != EOF) {
         switch (c) {
             case 'f': /* Use one specific trace file only (relative to curr dir) */
                 num_tracefiles = 1;
@@ -264,6 +903,127 @@ int main(int argc, char **argv) {
                 debug_mode = DBG_EXPENSIVE;
                 break;
 
+            case OPT_TIMELINE: /* Sample the heap every <k> ops */
+                timeline_interval = atoi(optarg);
+                if (timeline_interval <= 0) {
+                    app_error("--timeline interval must be positive\n");
+                }
+                break;
+
+            case OPT_TIMELINE_FORMAT:
+                if (strcmp(optarg, "csv") == 0) {
+                    timeline_format = TIMELINE_CSV;
+                }
+                else if (strcmp(optarg, "json") == 0) {
+                    timeline_format = TIMELINE_JSON;
+                }
+                else {
+                    app_error("Unknown timeline format %s\n", optarg);
+                }
+                break;
+
+            case OPT_TIMELINE_DIR:
+                if (strlen(optarg) + 2 > MAXLINE) {
+                    app_error("Timeline directory name too long\n");
+                }
+                strcpy(timeline_dir, optarg);
+                if (timeline_dir[strlen(timeline_dir) - 1] != '/') {
+                    strcat(timeline_dir, "/");
+                }
+                break;
+
+            case OPT_FRAG: /* Break down internal and external fragmentation */
+                frag_report = 1;
+                break;
+
+            case OPT_HEAP_DUMP: /* Write heap snapshots */
+                if (strlen(optarg) + 2 > MAXLINE) {
+                    app_error("Heap dump directory name too long\n");
+                }
+                strcpy(heap_dump_dir, optarg);
+                if (heap_dump_dir[strlen(heap_dump_dir) - 1] != '/') {
+                    strcat(heap_dump_dir, "/");
+                }
+                break;
+
+            case OPT_STATS: /* Report the allocator's statistics */
+                stats_report = 1;
+                break;
+
+            case OPT_JSON: /* Write the results as JSON ("-" for stdout) */
+                json_path = optarg;
+                break;
+
+            case OPT_BASELINE: /* Fail if the results regress against a baseline */
+                baseline_path = optarg;
+                break;
+
+            case OPT_TOLERANCE: /* Per-metric regression tolerances */
+                parse_tolerances(optarg);
+                break;
+
+            case 'j':
+            case OPT_JOBS: /* Check traces in <n> parallel worker processes */
+                num_jobs = atoi(optarg);
+                if (num_jobs < 1) app_error("The number of jobs must be at least 1\n");
+                break;
+
+            case OPT_PLUGIN: /* Compare with an allocator plugin */
+                if (num_plugins == MAX_PLUGINS) {
+                    app_error("At most %d plugins can be loaded\n", MAX_PLUGINS);
+                }
+                plugins[num_plugins++] = load_plugin(optarg);
+                break;
+
+            case OPT_TOUCH: /* Touch the blocks while timing */
+                parse_touch(optarg);
+                break;
+
+            case OPT_CHECKHEAP: /* Check the heap after every op */
+                parse_checkheap(optarg);
+                break;
+
+            case OPT_CACHESIM: /* Simulate the caches and TLB */
+                parse_cachesim(optarg);
+                break;
+
+            case OPT_EVENTS: /* Record allocator events in shared memory */
+                events_path = optarg;
+                break;
+
+            case OPT_RSS: /* Measure resident pages and page faults */
+                rss_report = 1;
+                break;
+
+            case OPT_SBRK_COST: /* Charge for growing the heap */
+                parse_sbrk_cost(optarg);
+                break;
+
+            case OPT_STEADY: /* Replay each trace on a warm heap */
+                parse_steady(optarg);
+                break;
+
+            case OPT_NO_CALIBRATE: /* Report raw times, driver overhead included */
+                calibrate = 0;
+                break;
+
+            case OPT_REPS: /* Number of timed runs per trace */
+                timing_config.reps = atoi(optarg);
+                if (timing_config.reps < 1) app_error("--reps must be at least 1\n");
+                break;
+
+            case OPT_WARMUP: /* Number of untimed runs per trace */
+                timing_config.warmups = atoi(optarg);
+                break;
+
+            case OPT_CPU: /* CPU to pin to while timing (-1: don't pin) */
+                timing_config.cpu = atoi(optarg);
+                break;
+
+            case OPT_DETECT_FREQ: /* Count timed runs with frequency changes */
+                timing_config.detect_freq = true;
+                break;
+
             case 'h': /* Print this message */
                 usage();
                 exit(0);
@@ -284,8 +1044,19 @@ int main(int argc, char **argv) {
         init_random_data();
     }
 
-    /* Initialize the timing package */
-    init_fsecs();
+    /* Initialize the timing package, by default pinned to the current CPU */
+    if (timing_config.cpu == -2) timing_config.cpu = sched_getcpu();
+    timing_init(&timing_config);
+
+    /* Each -j worker claims a ring of its own */
+    if (events_path != NULL && !evring_open(events_path, num_jobs + 1, EVENT_SLOTS)) {
+        unix_error("Could not create the event file %s", events_path);
+    }
+
+    if (cachesim_report && !cachesim_init(&cachesim_config)) {
+        app_error("Bad --cachesim geometry: sizes must be powers of two, with a power of "
+                  "two number of sets\n");
+    }
 
     /*
      * Optionally run and evaluate the libc malloc package
@@ -306,7 +1077,9 @@ int main(int argc, char **argv) {
             if (libc_stats[i].valid) {
                 speed_params.trace = trace;
                 if (verbose > 1) printf("and performance.\n");
-                libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+                mm_pkg = &libc_pkg;
+                time_speed(&speed_params, &libc_stats[i]);
+                mm_pkg = &builtin_mm;
             }
             free_trace(trace);
         }
@@ -329,11 +1102,29 @@ int main(int argc, char **argv) {
 
     /* Initialize the simulated memory system in memlib.c */
     mem_init();
+    if (sbrk_cost.on) mem_set_sbrk_cost(sbrk_cost.call_nsecs, sbrk_cost.page_nsecs);
 
     run_tests(num_tracefiles, tracedir, tracefiles, mm_stats, &speed_params);
 
+    /*
+     * Run the same traces on every plugin. Errors in a plugin are reported,
+     * but don't count against the mm package.
+     */
+    mm_errors = errors;
+    for (i = 0; i < num_plugins && !onetime_flag; i++) {
+        if (verbose > 1) printf("\nTesting %s malloc\n", plugins[i]->name);
+        if ((plugin_stats[i] = calloc(num_tracefiles, sizeof(stats_t))) == NULL)
+            unix_error("plugin_stats calloc in main failed");
+        mm_pkg = plugins[i];
+        run_tests(num_tracefiles, tracedir, tracefiles, plugin_stats[i], &speed_params);
+    }
+    mm_pkg = &builtin_mm;
+    errors = mm_errors;
+
     mem_deinit();
-    deinit_fsecs();
+    timing_deinit();
+    cachesim_deinit();
+    evring_close();
 
     /* Display the mm results in a compact table */
     if (verbose) {
@@ -350,6 +1141,22 @@ int main(int argc, char **argv) {
         else {
             printf("\nResults for mm malloc:\n");
             printresults(num_tracefiles, mm_stats);
+            if (frag_report) printfrag(num_tracefiles, mm_stats);
+            if (stats_report) printallocstats(num_tracefiles, mm_stats);
+            if (stats_report) printrealloc(num_tracefiles, mm_stats);
+            if (stats_report || sbrk_cost.on) printsbrk(num_tracefiles, mm_stats);
+            if (cachesim_report) printcachesim(num_tracefiles, mm_stats);
+            if (rss_report) printrss(num_tracefiles, mm_stats);
+            if (steady.iters > 0) printsteady(num_tracefiles, mm_stats);
+            if (num_plugins > 0) {
+                const mm_plugin_t *pkgs[MAX_PLUGINS + 1] = {&builtin_mm};
+                stats_t *pkg_stats[MAX_PLUGINS + 1] = {mm_stats};
+                for (i = 0; i < num_plugins; i++) {
+                    pkgs[i + 1] = plugins[i];
+                    pkg_stats[i + 1] = plugin_stats[i];
+                }
+                printcomparison(num_tracefiles, num_plugins + 1, pkgs, pkg_stats);
+            }
             printf("\n");
         }
     }
@@ -362,71 +1169,31 @@ int main(int argc, char **argv) {
     }
 
     /*
-     * Accumulate the aggregate statistics for the student's mm package
+     * Compute the performance index, and record and gate the results
      */
-    secs = 0;
-    ops = 0;
-    util = 0;
-    numcorrect = 0;
-    for (i = 0; i < num_tracefiles; i++) {
-        secs += mm_stats[i].secs * mm_stats[i].weight;
-        ops += mm_stats[i].ops * mm_stats[i].weight;
-        util += mm_stats[i].util * mm_stats[i].weight;
-        weight += mm_stats[i].weight;
-        if (mm_stats[i].valid) numcorrect++;
+    compute_perf_index(num_tracefiles, mm_stats, &perf);
+    if (json_path != NULL) {
+        write_json(json_path, num_tracefiles, mm_stats, libc_stats, &perf);
+    }
+    if (baseline_path != NULL) {
+        regressions = compare_baseline(baseline_path, num_tracefiles, mm_stats, &perf);
     }
     free(mm_stats);
-    if (weight == 0)
-        avg_mm_util = 0;
-    else
-        avg_mm_util = util / weight;
-
-#ifdef STAGE0
-#define UTIL_WEIGHT 1.0
-#endif
-
-#ifdef STAGE1
-#define UTIL_WEIGHT 0.6
-#endif
+    free(libc_stats);
+    for (i = 0; i < num_plugins; i++) {
+        free(plugin_stats[i]);
+    }
 
     /*
-     * Compute and print the performance index
+     * Print the performance index
      */
     if (errors == 0) {
-        if (weight == 0) {
-            avg_mm_throughput = 0;
-        }
-        else {
-            avg_mm_throughput = (secs == 0) ? 0 : ops / secs;
-        }
-        if (avg_mm_util < MIN_SPACE) {
-            p1 = 0.0;
-        }
-        else if (avg_mm_util > MAX_SPACE) {
-            p1 = UTIL_WEIGHT;
-        }
-        else {
-            p1 = (avg_mm_util - MIN_SPACE) / (MAX_SPACE - MIN_SPACE) * UTIL_WEIGHT;
-        }
-
-        if (avg_mm_throughput < MIN_SPEED) {
-            p2 = 0.0;
-        }
-        else if (avg_mm_throughput > MAX_SPEED) {
-            p2 = 1.0 - UTIL_WEIGHT;
-        }
-        else {
-            p2 = (avg_mm_throughput - MIN_SPEED) / (MAX_SPEED - MIN_SPEED) *
-                 (1.0 - UTIL_WEIGHT);
-        }
-
-        perfindex = (p1 + p2) * 100.0;
-        printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n", p1 * 100, p2 * 100,
-               perfindex);
+        printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n", perf.p1 * 100,
+               perf.p2 * 100, perf.perfindex);
 
 #ifdef STAGE0
         const double BUMP = 65;
-        double perfscore = perfindex - BUMP;
+        double perfscore = perf.perfindex - BUMP;
         if (perfscore <= 0) {
             perfscore = 0;
         }
@@ -435,7 +1202,7 @@ int main(int argc, char **argv) {
 
 #ifdef STAGE1
         const double BUMP = 60;
-        double perfscore = perfindex - BUMP;
+        double perfscore = perf.perfindex - BUMP;
         if (perfscore <= 0) {
             perfscore = 0;
         }
@@ -443,12 +1210,57 @@ int main(int argc, char **argv) {
 #endif
     }
     else { /* There were errors */
-        perfindex = 0.0;
         printf("Terminated with %d errors\n", errors);
         printf("Score = 0\n");
     }
+    if (regressions > 0) {
+        printf("Failed %d check%s against %s\n", regressions, regressions > 1 ? "s" : "",
+               baseline_path);
+    }
+
+    /* Exit statuses are taken mod 256, so don't return the counts */
+    return (errors + regressions > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * compute_perf_index - Accumulate the aggregate statistics for the
+ *     student's mm package and compute the performance index from them
+ */
+static void compute_perf_index(int n, const stats_t *stats, perf_t *perf) {
+    int i;
+    double secs = 0, ops = 0, util = 0, weight = 0;
+
+    for (i = 0; i < n; i++) {
+        secs += stats[i].secs * stats[i].weight;
+        ops += stats[i].ops * stats[i].weight;
+        util += stats[i].util * stats[i].weight;
+        weight += stats[i].weight;
+    }
+    perf->avg_util = (weight == 0) ? 0 : util / weight;
+    perf->avg_throughput = (weight == 0 || secs == 0) ? 0 : ops / secs;
 
-    return errors;
+    if (perf->avg_util < MIN_SPACE) {
+        perf->p1 = 0.0;
+    }
+    else if (perf->avg_util > MAX_SPACE) {
+        perf->p1 = UTIL_WEIGHT;
+    }
+    else {
+        perf->p1 = (perf->avg_util - MIN_SPACE) / (MAX_SPACE - MIN_SPACE) * UTIL_WEIGHT;
+    }
+
+    if (perf->avg_throughput < MIN_SPEED) {
+        perf->p2 = 0.0;
+    }
+    else if (perf->avg_throughput > MAX_SPEED) {
+        perf->p2 = 1.0 - UTIL_WEIGHT;
+    }
+    else {
+        perf->p2 = (perf->avg_throughput - MIN_SPEED) / (MAX_SPEED - MIN_SPEED) *
+                   (1.0 - UTIL_WEIGHT);
+    }
+
+    perf->perfindex = (perf->p1 + perf->p2) * 100.0;
 }
 
 /*****************************************************************
@@ -478,8 +1290,9 @@ static int add_range(range_t **ranges, char *lo, int size, const trace_t *trace,
     }
 
     /* The payload must lie within the extent of the heap */
-    if ((lo < (char *) mem_heap_lo()) || (lo > (char *) mem_heap_hi()) ||
-        (hi < (char *) mem_heap_lo()) || (hi > (char *) mem_heap_hi())) {
+    if ((mm_pkg->flags & MM_PLUGIN_USES_MEMLIB) &&
+        ((lo < (char *) mem_heap_lo()) || (lo > (char *) mem_heap_hi()) ||
+         (hi < (char *) mem_heap_lo()) || (hi > (char *) mem_heap_hi()))) {
         malloc_error(trace, opnum, "Payload (%p:%p) lies outside heap (%p:%p)", lo, hi,
                      mem_heap_lo(), mem_heap_hi());
         return 0;
@@ -610,17 +1423,96 @@ static void check_index(const trace_t *trace, int opnum, int index) {
 }
 
 /**********************************************
- * The following routines manipulate tracefiles
+ * The following routines record the fragmentation timeline
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * summarize_free_block - mm_heap_walk callback accumulating a free_summary_t
  */
-static trace_t *read_trace(stats_t *stats, const char *tracedir, const char *filename) {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    int index, size;
+static void summarize_free_block(const mm_block_info_t *info, void *arg) {
+    free_summary_t *summary = arg;
+
+    if (info->allocated) return;
+    summary->free_blocks++;
+    summary->free_bytes += info->size;
+    if (info->size > summary->largest_free) summary->largest_free = info->size;
+}
+
+/*
+ * timeline_open - create the timeline file for a trace. The file is named
+ *     after the trace file, e.g. "./amptjp.rep.timeline.csv".
+ */
+static void timeline_open(timeline_t *timeline, const trace_t *trace) {
+    char path[2 * MAXLINE + 16];
+    const char *name = strrchr(trace->filename, '/');
+
+    name = (name == NULL) ? trace->filename : name + 1;
+    snprintf(path, sizeof(path), "%s%s.timeline.%s", timeline_dir, name,
+             timeline_format == TIMELINE_CSV ? "csv" : "json");
+    if ((timeline->fp = fopen(path, "w")) == NULL)
+        unix_error("Could not open %s in timeline_open", path);
+    timeline->samples = 0;
+
+    if (timeline_format == TIMELINE_CSV) {
+        fprintf(timeline->fp, "op,live_bytes,heapsize,free_blocks,free_bytes,"
+                              "largest_free,util\n");
+    }
+    else {
+        fprintf(timeline->fp, "{\"trace\": ");
+        json_print_string(timeline->fp, trace->filename);
+        fprintf(timeline->fp, ", \"interval\": %d, \"samples\": [", timeline_interval);
+    }
+}
+
+/*
+ * timeline_sample - record the state of the heap after request opnum
+ */
+static void timeline_sample(timeline_t *timeline, int opnum, size_t live_bytes) {
+    free_summary_t summary = {0, 0, 0};
+    size_t heapsize = mem_heapsize();
+    double util = (heapsize == 0) ? 0 : (double) live_bytes / (double) heapsize;
+
+    if (MM_PLUGIN_HAS(mm_pkg, heap_walk)) {
+        mm_pkg->heap_walk(summarize_free_block, &summary);
+    }
+
+    if (timeline_format == TIMELINE_CSV) {
+        fprintf(timeline->fp, "%d,%zu,%zu,%zu,%zu,%zu,%.6f\n", opnum, live_bytes, heapsize,
+                summary.free_blocks, summary.free_bytes, summary.largest_free, util);
+    }
+    else {
+        fprintf(timeline->fp,
+                "%s\n  {\"op\": %d, \"live_bytes\": %zu, \"heapsize\": %zu, "
+                "\"free_blocks\": %zu, \"free_bytes\": %zu, \"largest_free\": %zu, "
+                "\"util\": %.6f}",
+                timeline->samples == 0 ? "" : ",", opnum, live_bytes, heapsize,
+                summary.free_blocks, summary.free_bytes, summary.largest_free, util);
+    }
+    timeline->samples++;
+}
+
+/*
+ * timeline_close - finish and close a timeline file
+ */
+static void timeline_close(timeline_t *timeline) {
+    if (timeline_format == TIMELINE_JSON) {
+        fprintf(timeline->fp, "\n]}\n");
+    }
+    fclose(timeline->fp);
+}
+
+/**********************************************
+ * The following routines manipulate tracefiles
+ *********************************************/
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+static trace_t *read_trace(stats_t *stats, const char *tracedir, const char *filename) {
+    FILE *tracefile;
+    trace_t *trace;
+    char type[MAXLINE];
+    int index, size, arg;
     int max_index = 0;
     int op_index;
 
@@ -652,9 +1544,20 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir, const char *fil
     if ((trace->ops = (traceop_t *) malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
         unix_error("malloc 2 failed in read_trace");
 
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = (char **) calloc(trace->num_ids, sizeof(char *))) == NULL)
+    /* ... and pre-decode them for the speed passes here */
+    trace->op_types = malloc(trace->num_ops * sizeof(*trace->op_types));
+    trace->op_indices = malloc(trace->num_ops * sizeof(*trace->op_indices));
+    trace->op_sizes = malloc(trace->num_ops * sizeof(*trace->op_sizes));
+    trace->op_args = malloc(trace->num_ops * sizeof(*trace->op_args));
+    if (trace->op_types == NULL || trace->op_indices == NULL || trace->op_sizes == NULL ||
+        trace->op_args == NULL)
+        unix_error("malloc 2 failed in read_trace");
+
+    /* We'll keep an array of pointers to the allocated blocks here, with
+       an extra NULL entry in front for index -1... */
+    if ((trace->blocks = (char **) calloc(trace->num_ids + 1, sizeof(char *))) == NULL)
         unix_error("malloc 3 failed in read_trace");
+    trace->blocks++;
 
     /* ... along with the corresponding byte sizes of each block */
     if ((trace->block_sizes = (size_t *) calloc(trace->num_ids, sizeof(size_t))) == NULL)
@@ -665,34 +1568,85 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir, const char *fil
              calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
         unix_error("malloc 5 failed in read_trace");
 
-    /* read every request line in the trace file */
+    /* read every request line in the trace file. block_sizes tracks the
+       size of each block while reading, to check the sizes of sized frees. */
     index = 0;
     op_index = 0;
     while (fscanf(tracefile, "%s", type) != EOF) {
+        traceop_t *op = &trace->ops[op_index];
+
+        op->size = 0;
+        op->arg = 0;
         switch (type[0]) {
             case 'a':
                 assert(fscanf(tracefile, "%u %u", &index, &size) != EOF);
-                trace->ops[op_index].type = ALLOC;
-                trace->ops[op_index].index = index;
-                trace->ops[op_index].size = size;
+                op->type = ALLOC;
+                op->index = index;
+                op->size = size;
                 max_index = (index > max_index) ? index : max_index;
                 break;
             case 'r':
                 assert(fscanf(tracefile, "%u %u", &index, &size) != EOF);
-                trace->ops[op_index].type = REALLOC;
-                trace->ops[op_index].index = index;
-                trace->ops[op_index].size = size;
+                op->type = REALLOC;
+                op->index = index;
+                op->size = size;
+                max_index = (index > max_index) ? index : max_index;
+                break;
+            case 'c':
+                assert(fscanf(tracefile, "%u %u %u", &index, &arg, &size) != EOF);
+                if (arg == 0) {
+                    app_error("%s: calloc of zero elements", trace->filename);
+                }
+                op->type = CALLOC;
+                op->index = index;
+                op->size = (size_t) arg * size;
+                op->arg = arg;
+                max_index = (index > max_index) ? index : max_index;
+                break;
+            case 'm':
+                assert(fscanf(tracefile, "%u %u %u", &index, &arg, &size) != EOF);
+                if (arg == 0 || (arg & (arg - 1)) != 0) {
+                    app_error("%s: alignment %d is not a power of two", trace->filename,
+                              arg);
+                }
+                op->type = MEMALIGN;
+                op->index = index;
+                op->size = size;
+                op->arg = arg;
                 max_index = (index > max_index) ? index : max_index;
                 break;
             case 'f':
                 assert(fscanf(tracefile, "%ud", &index) != EOF);
-                trace->ops[op_index].type = FREE;
-                trace->ops[op_index].index = index;
+                op->type = FREE;
+                op->index = index;
+                break;
+            case 's':
+                assert(fscanf(tracefile, "%u %u", &index, &size) != EOF);
+                if (index < 0 || index >= trace->num_ids ||
+                    trace->block_sizes[index] != (size_t) size) {
+                    app_error("%s: sized free of block %d with the wrong size %d",
+                              trace->filename, index, size);
+                }
+                op->type = SIZED_FREE;
+                op->index = index;
+                op->size = size;
+                break;
+            case 'u':
+                assert(fscanf(tracefile, "%u", &index) != EOF);
+                op->type = USABLE_SIZE;
+                op->index = index;
                 break;
             default:
                 app_error("Bogus type character (%c) in tracefile %s\n", type[0],
                           trace->filename);
         }
+        if (op->type != FREE && (op->index < 0 || op->index >= trace->num_ids)) {
+            app_error("%s: block index %d out of range", trace->filename, op->index);
+        }
+        if (op->type == ALLOC || op->type == REALLOC || op->type == CALLOC ||
+            op->type == MEMALIGN) {
+            trace->block_sizes[op->index] = op->size;
+        }
         op_index++;
         if (op_index == trace->num_ops) break;
     }
@@ -700,6 +1654,14 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir, const char *fil
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
 
+    for (op_index = 0; op_index < trace->num_ops; op_index++) {
+        const traceop_t *op = &trace->ops[op_index];
+        trace->op_types[op_index] = op->type;
+        trace->op_indices[op_index] = (op->type == FREE && op->index < 0) ? -1 : op->index;
+        trace->op_sizes[op_index] = (op->type == CALLOC) ? op->size / op->arg : op->size;
+        trace->op_args[op_index] = op->arg;
+    }
+
     /* fill in the stats */
     strcpy(stats->filename, trace->filename);
     stats->weight = trace->weight;
@@ -718,12 +1680,16 @@ static void reinit_trace(trace_t *trace) {
 }
 
 /*
- * free_trace - Free the trace record and the four arrays it points
+ * free_trace - Free the trace record and the arrays it points
  *              to, all of which were allocated in read_trace().
  */
 static void free_trace(trace_t *trace) {
-    free(trace->ops); /* free the three arrays... */
-    free(trace->blocks);
+    free(trace->ops); /* free the arrays... */
+    free(trace->op_types);
+    free(trace->op_indices);
+    free(trace->op_sizes);
+    free(trace->op_args);
+    free(trace->blocks - 1);
     free(trace->block_sizes);
     free(trace->block_rand_base);
     free(trace); /* and the trace record itself... */
@@ -734,6 +1700,68 @@ static void free_trace(trace_t *trace) {
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * op_name - the allocator function that a trace operation calls, for messages
+ */
+static const char *op_name(const mm_plugin_t *pkg, int type) {
+    static const char *names[] = {"malloc",   "free",       "realloc",    "calloc",
+                                  "memalign", "free_sized", "usable_size"};
+    static char name[64];
+
+    snprintf(name, sizeof(name), "%s_%s", (pkg == &libc_pkg) ? "libc" : "mm", names[type]);
+    return name;
+}
+
+/*
+ * pkg_alloc - perform an allocating trace operation (ALLOC, CALLOC or
+ *     MEMALIGN) with package pkg. Packages without memalign fail it.
+ */
+static char *pkg_alloc(const mm_plugin_t *pkg, const traceop_t *op) {
+    switch (op->type) {
+        case CALLOC:
+            return pkg->calloc(op->arg, op->size / op->arg);
+        case MEMALIGN:
+            return MM_PLUGIN_HAS(pkg, memalign) ? pkg->memalign(op->arg, op->size) : NULL;
+        default:
+            return pkg->malloc(op->size);
+    }
+}
+
+/*
+ * pkg_free - perform a freeing trace operation (FREE or SIZED_FREE) on p
+ *     with package pkg. Packages without free_sized use plain free.
+ */
+static void pkg_free(const mm_plugin_t *pkg, const traceop_t *op, char *p) {
+    if (op->type == SIZED_FREE && MM_PLUGIN_HAS(pkg, free_sized)) {
+        pkg->free_sized(p, op->size);
+    }
+    else {
+        pkg->free(p);
+    }
+}
+
+/*
+ * check_heap - call the package's heap checker before request i. Returns 0
+ *     if it found a problem; the checker itself says what it was.
+ */
+static int check_heap(trace_t *trace, int i) {
+    uint64_t errors;
+
+    if (!MM_PLUGIN_HAS(mm_pkg, checkheap)) return 1;
+    if (!MM_PLUGIN_HAS(mm_pkg, checkheap_errors)) {
+        mm_pkg->checkheap();
+        return 1;
+    }
+    errors = mm_pkg->checkheap_errors();
+    mm_pkg->checkheap();
+    if (mm_pkg->checkheap_errors() != errors) {
+        malloc_error(trace, i, "mm_checkheap found %" PRIu64 " problem(s) in the heap",
+                     mm_pkg->checkheap_errors() - errors);
+        return 0;
+    }
+    return 1;
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
@@ -750,22 +1778,28 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges) {
     reinit_trace(trace);
 
     /* Call the mm package's init function */
-    if (!mm_init()) {
+    if (!mm_pkg->init()) {
         malloc_error(trace, 0, "mm_init failed.");
         return 0;
     }
+    if (MM_PLUGIN_HAS(mm_pkg, checkheap_mode)) {
+        if (checkheap.on)
+            mm_pkg->checkheap_mode(checkheap.mode, checkheap.blocks, checkheap.period);
+        else
+            mm_pkg->checkheap_mode(MM_CHECK_FULL, 0, 0);
+    }
 
     /* Interpret each operation in the trace in order */
     for (i = 0; i < trace->num_ops; i++) {
         index = trace->ops[i].index;
         size = trace->ops[i].size;
 
+        /* Let the students check their own heap */
+        if ((checkheap.on || debug_mode == DBG_EXPENSIVE) && !check_heap(trace, i)) return 0;
+
         if (debug_mode == DBG_EXPENSIVE) {
             range_t *r;
 
-            /* Let the students check their own heap */
-            mm_checkheap();
-
             /* Now check that all our allocated blocks have the right data */
             r = *ranges;
             while (r) {
@@ -775,11 +1809,13 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges) {
         }
 
         switch (trace->ops[i].type) {
-            case ALLOC: /* mm_malloc */
+            case ALLOC:    /* mm_malloc */
+            case CALLOC:   /* mm_calloc */
+            case MEMALIGN: /* mm_memalign */
 
                 /* Call the student's malloc */
-                if ((p = mm_malloc(size)) == NULL) {
-                    malloc_error(trace, i, "mm_malloc failed.");
+                if ((p = pkg_alloc(mm_pkg, &trace->ops[i])) == NULL) {
+                    malloc_error(trace, i, "%s failed.", op_name(mm_pkg, trace->ops[i].type));
                     return 0;
                 }
 
@@ -790,6 +1826,26 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges) {
                  */
                 if (add_range(ranges, p, size, trace, i, index) == 0) return 0;
 
+                /* Aligned blocks must honour the requested alignment... */
+                if (trace->ops[i].type == MEMALIGN &&
+                    (uintptr_t) p % trace->ops[i].arg != 0) {
+                    malloc_error(trace, i, "Payload address (%p) not aligned to %zu bytes",
+                                 p, trace->ops[i].arg);
+                    return 0;
+                }
+
+                /* ... and calloc'ed blocks must be zeroed */
+                if (trace->ops[i].type == CALLOC) {
+                    size_t j;
+                    for (j = 0; j < size && p[j] == 0; j++)
+                        ;
+                    if (j < size) {
+                        malloc_error(trace, i, "mm_calloc block has a nonzero byte at %zu",
+                                     j);
+                        return 0;
+                    }
+                }
+
                 /* Remember region */
                 trace->blocks[index] = p;
                 trace->block_sizes[index] = size;
@@ -803,7 +1859,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges) {
 
                 /* Call the student's realloc */
                 oldp = trace->blocks[index];
-                newp = mm_realloc(oldp, size);
+                newp = mm_pkg->realloc(oldp, size);
                 if ((newp == NULL) && (size != 0)) {
                     malloc_error(trace, i, "mm_realloc failed.");
                     return 0;
@@ -836,7 +1892,8 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges) {
                 randomize_block(trace, index);
                 break;
 
-            case FREE: /* mm_free */
+            case FREE:       /* mm_free */
+            case SIZED_FREE: /* mm_free_sized */
                 check_index(trace, i, index);
 
                 /* Remove region from list and call student's free function */
@@ -847,7 +1904,18 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges) {
                     p = trace->blocks[index];
                     remove_range(ranges, p);
                 }
-                mm_free(p);
+                pkg_free(mm_pkg, &trace->ops[i], p);
+                break;
+
+            case USABLE_SIZE: /* mm_usable_size */
+                /* The whole block must be usable, possibly more */
+                if (MM_PLUGIN_HAS(mm_pkg, usable_size) &&
+                    (size = mm_pkg->usable_size(trace->blocks[index])) <
+                        trace->block_sizes[index]) {
+                    malloc_error(trace, i, "mm_usable_size of block %d is %zu, below %zu",
+                                 index, size, trace->block_sizes[index]);
+                    return 0;
+                }
                 break;
 
             default:
@@ -879,23 +1947,29 @@ static double eval_mm_util(trace_t *trace, int tracenum) {
     int total_size = 0;
     char *p;
     char *newp, *oldp;
+    timeline_t timeline;
 
     reinit_trace(trace);
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk(false);
-    if (!mm_init()) {
+    if (!mm_pkg->init()) {
         app_error("trace %d: mm_init failed in eval_mm_util", tracenum);
     }
 
+    if (timeline_interval > 0) timeline_open(&timeline, trace);
+
     for (i = 0; i < trace->num_ops; i++) {
         switch (trace->ops[i].type) {
-            case ALLOC: /* mm_alloc */
+            case ALLOC:    /* mm_alloc */
+            case CALLOC:   /* mm_calloc */
+            case MEMALIGN: /* mm_memalign */
                 index = trace->ops[i].index;
                 size = trace->ops[i].size;
 
-                if ((p = mm_malloc(size)) == NULL) {
-                    app_error("trace %d: mm_malloc failed in eval_mm_util", tracenum);
+                if ((p = pkg_alloc(mm_pkg, &trace->ops[i])) == NULL) {
+                    app_error("trace %d: %s failed in eval_mm_util", tracenum,
+                              op_name(mm_pkg, trace->ops[i].type));
                 }
 
                 /* Remember region and size */
@@ -911,7 +1985,7 @@ static double eval_mm_util(trace_t *trace, int tracenum) {
                 oldsize = trace->block_sizes[index];
 
                 oldp = trace->blocks[index];
-                if ((newp = mm_realloc(oldp, newsize)) == NULL && newsize != 0) {
+                if ((newp = mm_pkg->realloc(oldp, newsize)) == NULL && newsize != 0) {
                     app_error("trace %d: mm_realloc failed in eval_mm_util", tracenum);
                 }
 
@@ -922,7 +1996,8 @@ static double eval_mm_util(trace_t *trace, int tracenum) {
                 total_size += (newsize - oldsize);
                 break;
 
-            case FREE: /* mm_free */
+            case FREE:       /* mm_free */
+            case SIZED_FREE: /* mm_free_sized */
                 index = trace->ops[i].index;
                 if (index < 0) {
                     size = 0;
@@ -933,19 +2008,30 @@ static double eval_mm_util(trace_t *trace, int tracenum) {
                     p = trace->blocks[index];
                 }
 
-                mm_free(p);
+                pkg_free(mm_pkg, &trace->ops[i], p);
 
                 total_size -= size;
                 break;
 
+            case USABLE_SIZE: /* doesn't change the heap */
+                break;
+
             default:
                 app_error("trace %d: Nonexistent request type in eval_mm_util", tracenum);
         }
 
         /* update the high-water mark */
         max_total_size = (total_size > max_total_size) ? total_size : max_total_size;
+
+        /* sample the heap for the fragmentation timeline */
+        if (timeline_interval > 0 &&
+            ((i + 1) % timeline_interval == 0 || i == trace->num_ops - 1)) {
+            timeline_sample(&timeline, i, total_size);
+        }
     }
 
+    if (timeline_interval > 0) timeline_close(&timeline);
+
     // printf("max_total_size = %f\n", (double)max_total_size);
     // printf("mem_heapsize = %f\n", (double)mem_heapsize());
 
@@ -953,196 +2039,1682 @@ static double eval_mm_util(trace_t *trace, int tracenum) {
 }
 
 /*
- * eval_mm_speed - This is the function that is used by fcyc()
- *    to measure the running time of the mm malloc package.
+ * The following routines compute the fragmentation breakdown. Only the
+ * driver knows what size each block was requested with, so it walks the
+ * heap with mm_heap_walk and matches every allocated payload against the
+ * live blocks of the trace.
  */
-static void eval_mm_speed(void *ptr) {
-    int i, index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *) ptr)->trace;
-    reinit_trace(trace);
 
-    /* Reset the heap and initialize the mm package */
-    mem_reset_brk(false);
-    if (!mm_init()) {
-        app_error("mm_init failed in eval_mm_speed");
+/* A live block of the trace: its payload address and requested size */
+typedef struct {
+    char *payload;
+    size_t size;
+} live_block_t;
+
+/* State threaded through mm_heap_walk by take_frag_snapshot */
+typedef struct {
+    live_block_t *live;
+    int num_live;
+    size_t walked; /* total size of the blocks seen so far */
+    frag_t *frag;
+} frag_walk_t;
+
+static int cmp_live_block(const void *a, const void *b) {
+    const live_block_t *x = a, *y = b;
+    return (x->payload > y->payload) - (x->payload < y->payload);
+}
+
+/* Returns the bucket of a free block of the given size */
+static int frag_bucket(size_t size) {
+    int bucket = 0;
+    for (size_t limit = 32; size > limit && bucket < FRAG_BUCKETS - 1; limit <<= 1) {
+        bucket++;
     }
+    return bucket;
+}
 
-    /* Interpret each trace request */
-    for (i = 0; i < trace->num_ops; i++) switch (trace->ops[i].type) {
-            case ALLOC: /* mm_malloc */
-                index = trace->ops[i].index;
-                size = trace->ops[i].size;
-                if ((p = mm_malloc(size)) == NULL)
-                    app_error("mm_malloc error in eval_mm_speed");
-                trace->blocks[index] = p;
-                break;
+/*
+ * frag_visit_block - mm_heap_walk callback assigning a block's bytes to
+ *     the categories of a frag_t
+ */
+static void frag_visit_block(const mm_block_info_t *info, void *arg) {
+    frag_walk_t *walk = arg;
+    frag_t *frag = walk->frag;
+    live_block_t key = {info->payload, 0};
+    live_block_t *live;
+
+    walk->walked += info->size;
+    if (!info->allocated) {
+        frag->free += info->size;
+        frag->free_by_bucket[frag_bucket(info->size)] += info->size;
+        return;
+    }
 
-            case REALLOC: /* mm_realloc */
-                index = trace->ops[i].index;
-                newsize = trace->ops[i].size;
-                oldp = trace->blocks[index];
-                if ((newp = mm_realloc(oldp, newsize)) == NULL && newsize != 0)
-                    app_error("mm_realloc error in eval_mm_speed");
-                trace->blocks[index] = newp;
-                break;
+    frag->metadata += info->size - info->payload_size;
+    live = bsearch(&key, walk->live, walk->num_live, sizeof(live_block_t),
+                   cmp_live_block);
+    if (live == NULL) {
+        /* Allocated, but not by the trace: count it as slack */
+        frag->slack += info->payload_size;
+        return;
+    }
 
-            case FREE: /* mm_free */
-                index = trace->ops[i].index;
-                if (index < 0) {
-                    block = 0;
-                }
-                else {
-                    block = trace->blocks[index];
-                }
-                mm_free(block);
-                break;
+    size_t padded = mm_pkg->padded_size(live->size);
+    if (padded > info->payload_size) padded = info->payload_size;
+    frag->payload += live->size;
+    frag->padding += padded - live->size;
+    frag->slack += info->payload_size - padded;
+}
 
-            default:
-                app_error("Nonexistent request type in eval_mm_speed");
+/*
+ * take_frag_snapshot - break down the current heap into a frag_t
+ */
+static void take_frag_snapshot(const trace_t *trace, frag_t *frag) {
+    frag_walk_t walk;
+    int index;
+
+    if ((walk.live = malloc(trace->num_ids * sizeof(live_block_t))) == NULL)
+        unix_error("malloc failed in take_frag_snapshot");
+    walk.num_live = 0;
+    for (index = 0; index < trace->num_ids; index++) {
+        if (trace->blocks[index] != NULL) {
+            walk.live[walk.num_live].payload = trace->blocks[index];
+            walk.live[walk.num_live].size = trace->block_sizes[index];
+            walk.num_live++;
         }
+    }
+    qsort(walk.live, walk.num_live, sizeof(live_block_t), cmp_live_block);
+
+    memset(frag, 0, sizeof(*frag));
+    frag->heapsize = mem_heapsize();
+    walk.walked = 0;
+    walk.frag = frag;
+    mm_pkg->heap_walk(frag_visit_block, &walk);
+
+    /* Whatever lies outside the blocks (prologues, sentinels...) is metadata */
+    frag->metadata += frag->heapsize - walk.walked;
+    free(walk.live);
 }
 
 /*
- * eval_libc_valid - We run this function to make sure that the
- *    libc malloc can run to completion on the set of traces.
- *    We'll be conservative and terminate if any libc malloc call fails.
- *
+ * dump_heap - write a snapshot of the heap to the --heap-dump directory,
+ *     e.g. "./amptjp.rep.peak.heap", if the package can
  */
-static int eval_libc_valid(trace_t *trace) {
-    int i, newsize;
-    char *p, *newp, *oldp;
+static void dump_heap(const trace_t *trace, const char *when) {
+    char path[2 * MAXLINE + 16];
+    const char *name = strrchr(trace->filename, '/');
+
+    if (heap_dump_dir[0] == '\0' || !MM_PLUGIN_HAS(mm_pkg, heap_dump)) return;
+    name = (name == NULL) ? trace->filename : name + 1;
+    snprintf(path, sizeof(path), "%s%s.%s.heap", heap_dump_dir, name, when);
+    if (!mm_pkg->heap_dump(path)) unix_error("Could not write %s in dump_heap", path);
+}
 
-    reinit_trace(trace);
+/*
+ * eval_mm_frag - Break the heap down into payload, metadata, padding,
+ *   slack and free space, once at the point where the trace has the
+ *   most live payload bytes and once at the end of the trace.
+ */
+/*
+ * find_peak_op - the op after which the trace has the most live payload
+ *   bytes, or -1 if it never has any. The live payload only depends on the
+ *   trace, so this doesn't run the package.
+ */
+static int find_peak_op(trace_t *trace) {
+    int i;
+    int index;
+    long total_size = 0, max_total_size = 0;
+    int peak_op = -1;
 
+    reinit_trace(trace);
     for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
         switch (trace->ops[i].type) {
-            case ALLOC: /* malloc */
-                if ((p = malloc(trace->ops[i].size)) == NULL) {
-                    malloc_error(trace, i, "libc malloc failed");
-                    unix_error("System message");
-                }
-                trace->blocks[trace->ops[i].index] = p;
+            case ALLOC:
+            case CALLOC:
+            case MEMALIGN:
+                trace->block_sizes[index] = trace->ops[i].size;
+                total_size += trace->ops[i].size;
                 break;
-
-            case REALLOC: /* realloc */
-                newsize = trace->ops[i].size;
-                oldp = trace->blocks[trace->ops[i].index];
-                if ((newp = realloc(oldp, newsize)) == NULL && newsize != 0) {
-                    malloc_error(trace, i, "libc realloc failed");
-                    unix_error("System message");
-                }
-                trace->blocks[trace->ops[i].index] = newp;
+            case REALLOC:
+                total_size += trace->ops[i].size - trace->block_sizes[index];
+                trace->block_sizes[index] = trace->ops[i].size;
                 break;
-
-            case FREE: /* free */
-                if (trace->ops[i].index >= 0) {
-                    free(trace->blocks[trace->ops[i].index]);
-                }
-                else {
-                    free(0);
-                }
+            case FREE:
+            case SIZED_FREE:
+                if (index >= 0) total_size -= trace->block_sizes[index];
                 break;
-
-            default:
-                app_error("invalid operation type  in eval_libc_valid");
+            case USABLE_SIZE:
+                break;
+        }
+        if (total_size > max_total_size) {
+            max_total_size = total_size;
+            peak_op = i;
         }
     }
-
-    return 1;
+    return peak_op;
 }
 
-/*
- * eval_libc_speed - This is the function that is used by fcyc() to
- *    measure the running time of the libc malloc package on the set
- *    of traces.
- */
-static void eval_libc_speed(void *ptr) {
+static void eval_mm_frag(trace_t *trace, int tracenum, stats_t *stats) {
     int i;
-    int index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *) ptr)->trace;
+    int index;
+    int peak_op = find_peak_op(trace);
+    char *p;
 
+    /* Replay the trace, keeping blocks[] limited to the live blocks */
     reinit_trace(trace);
+    mem_reset_brk(false);
+    if (!mm_pkg->init()) {
+        app_error("trace %d: mm_init failed in eval_mm_frag", tracenum);
+    }
+    memset(&stats->frag_peak, 0, sizeof(stats->frag_peak));
 
     for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
         switch (trace->ops[i].type) {
-            case ALLOC: /* malloc */
-                index = trace->ops[i].index;
-                size = trace->ops[i].size;
-                if ((p = malloc(size)) == NULL)
-                    unix_error("malloc failed in eval_libc_speed");
+            case ALLOC:
+            case CALLOC:
+            case MEMALIGN:
+                if ((p = pkg_alloc(mm_pkg, &trace->ops[i])) == NULL)
+                    app_error("trace %d: %s failed in eval_mm_frag", tracenum,
+                              op_name(mm_pkg, trace->ops[i].type));
                 trace->blocks[index] = p;
+                trace->block_sizes[index] = trace->ops[i].size;
                 break;
-
-            case REALLOC: /* realloc */
-                index = trace->ops[i].index;
-                newsize = trace->ops[i].size;
-                oldp = trace->blocks[index];
-                if ((newp = realloc(oldp, newsize)) == NULL && newsize != 0)
-                    unix_error("realloc failed in eval_libc_speed\n");
-
-                trace->blocks[index] = newp;
+            case REALLOC:
+                p = mm_pkg->realloc(trace->blocks[index], trace->ops[i].size);
+                if (p == NULL && trace->ops[i].size != 0)
+                    app_error("trace %d: mm_realloc failed in eval_mm_frag", tracenum);
+                trace->blocks[index] = p;
+                trace->block_sizes[index] = trace->ops[i].size;
                 break;
-
-            case FREE: /* free */
-                index = trace->ops[i].index;
+            case FREE:
+            case SIZED_FREE:
                 if (index >= 0) {
-                    block = trace->blocks[index];
-                    free(block);
+                    pkg_free(mm_pkg, &trace->ops[i], trace->blocks[index]);
+                    trace->blocks[index] = NULL;
                 }
                 else {
-                    free(0);
+                    mm_pkg->free(NULL);
                 }
                 break;
+            case USABLE_SIZE:
+                break;
+        }
+        if (i == peak_op) {
+            take_frag_snapshot(trace, &stats->frag_peak);
+            dump_heap(trace, "peak");
         }
     }
+    take_frag_snapshot(trace, &stats->frag_end);
+    dump_heap(trace, "end");
 }
 
-/*************************************
- * Some miscellaneous helper routines
- ************************************/
+/*
+ * touch_block - write a word in every cache line of a block, as a program
+ *     initializing it would
+ */
+static void touch_block(char *p, size_t size) {
+    size_t off;
+
+    for (off = 0; off + sizeof(long) <= size; off += TOUCH_STRIDE) {
+        TOUCHED(p + off);
+        *(long *) (p + off) = off;
+    }
+}
 
 /*
- * printresults - prints a performance summary for some malloc package
+ * scan_live_blocks - read a word in every cache line of every live block
  */
-static void printresults(int n, stats_t *stats) {
+static void scan_live_blocks(const trace_t *trace) {
+    long sum = 0;
+    size_t off;
     int i;
-    /* weighted sums all */
-    double sumsecs = 0;
-    double sumops = 0;
-    double sumutil = 0;
-    int sumweight = 0;
 
-    /* Print the individual results for each trace */
-    printf("  %6s%6s %5s%8s%9s  %s\n", "valid", "util", "ops", "secs", "Kops", "trace");
-    for (i = 0; i < n; i++) {
-        if (stats[i].valid) {
-            printf("%2s%4s %5.0f%%%8.0f%10.6f%6.0f %s\n", stats[i].weight != 0 ? "*" : "",
-                   "yes", stats[i].util * 100.0, stats[i].ops, stats[i].secs,
-                   (stats[i].ops / 1e3) / stats[i].secs, stats[i].filename);
-            sumweight += stats[i].weight;
-            sumsecs += stats[i].secs * stats[i].weight;
-            sumops += stats[i].ops * stats[i].weight;
-            sumutil += stats[i].util * stats[i].weight;
+    for (i = 0; i < trace->num_ids; i++) {
+        const char *p = trace->blocks[i];
+        for (off = 0; off + sizeof(long) <= trace->block_sizes[i]; off += TOUCH_STRIDE) {
+            TOUCHED(p + off);
+            sum += *(const long *) (p + off);
         }
-        else {
-            printf("%2s%4s %6s%8s%9s%6s %s\n", stats[i].weight != 0 ? "*" : "", "no", "-",
-                   "-", "-", "-", stats[i].filename);
+    }
+    touch_sink += sum;
+}
+
+/*
+ * chase_live_blocks - link the live blocks into a list through their
+ *     first words, in the order of their ids rather than their addresses,
+ *     and follow it. Each load depends on the one before, so this measures
+ *     the latency of walking the heap rather than its bandwidth.
+ */
+static void chase_live_blocks(const trace_t *trace) {
+    char *first = NULL, *last = NULL, *p;
+    long n = 0;
+    int i;
+
+    for (i = 0; i < trace->num_ids; i++) {
+        if (trace->block_sizes[i] < sizeof(char *)) continue;
+        if (last != NULL) {
+            TOUCHED(last);
+            *(char **) last = trace->blocks[i];
         }
+        else
+            first = trace->blocks[i];
+        last = trace->blocks[i];
+    }
+    if (last != NULL) {
+        TOUCHED(last);
+        *(char **) last = NULL;
     }
 
-    /* Print the aggregate results for the set of traces */
-    if (errors == 0) {
-        if (sumweight == 0) sumweight = 1;
+    for (p = first; p != NULL; p = *(char **) p) {
+        TOUCHED(p);
+        n++;
+    }
+    touch_sink += n;
+}
 
-        printf("%2d     %5.0f%%%8.0f%10.6f%6.0f\n", sumweight,
-               (sumutil / (double) sumweight) * 100.0, sumops, sumsecs,
-               (sumsecs == 0.0) ? 0 : (sumops / 1e3) / sumsecs);
+/*
+ * touch_op - after request i of a speed pass, track the size of the live
+ *     blocks and touch them as configured with --touch. block_sizes holds
+ *     the sizes of the live blocks; it was cleared by prepare_mm_speed.
+ */
+static void touch_op(trace_t *trace, int i) {
+    const traceop_t *op = &trace->ops[i];
+
+    switch (op->type) {
+        case ALLOC:
+        case CALLOC:
+        case MEMALIGN:
+        case REALLOC:
+            trace->block_sizes[op->index] = op->size;
+            if (touch.on_alloc && op->size > 0) {
+                touch_block(trace->blocks[op->index], op->size);
+            }
+            break;
+        case FREE:
+        case SIZED_FREE:
+            if (op->index >= 0) trace->block_sizes[op->index] = 0;
+            break;
+        case USABLE_SIZE:
+            break;
     }
-    else {
-        printf("       %8s%10s%6s\n", "-", "-", "-");
+
+    if (touch.scan_interval > 0 && (i + 1) % touch.scan_interval == 0) {
+        scan_live_blocks(trace);
+    }
+    if (touch.chase_interval > 0 && (i + 1) % touch.chase_interval == 0) {
+        chase_live_blocks(trace);
+    }
+}
+
+/*
+ * replay_op - Perform op i of a trace on the package, for the passes that
+ *   replay a trace after it has been checked. pass names the caller in
+ *   error messages.
+ */
+static void replay_op(trace_t *trace, int i, int tracenum, const char *pass) {
+    const traceop_t *op = &trace->ops[i];
+    char *p;
+
+    switch (op->type) {
+        case ALLOC:
+        case CALLOC:
+        case MEMALIGN:
+            if ((p = pkg_alloc(mm_pkg, op)) == NULL)
+                app_error("trace %d: %s failed in %s", tracenum, op_name(mm_pkg, op->type), pass);
+            trace->blocks[op->index] = p;
+            break;
+        case REALLOC:
+            p = mm_pkg->realloc(trace->blocks[op->index], op->size);
+            if (p == NULL && op->size != 0)
+                app_error("trace %d: mm_realloc failed in %s", tracenum, pass);
+            trace->blocks[op->index] = p;
+            break;
+        case FREE:
+        case SIZED_FREE:
+            if (op->index >= 0) {
+                pkg_free(mm_pkg, op, trace->blocks[op->index]);
+                trace->blocks[op->index] = NULL;
+            }
+            else {
+                mm_pkg->free(NULL);
+            }
+            break;
+        case USABLE_SIZE:
+            if (MM_PLUGIN_HAS(mm_pkg, usable_size)) {
+                mm_pkg->usable_size(trace->blocks[op->index]);
+            }
+            break;
+    }
+}
+
+/*
+ * eval_mm_cachesim - Replay the trace once more with the cache simulator
+ *   on, charging the accesses the package makes to the type of each
+ *   request, and the accesses the --touch patterns make to "touch". Only
+ *   packages built with the instrumentation described in cachesim.c tell
+ *   the simulator what they access.
+ */
+static void eval_mm_cachesim(trace_t *trace, int tracenum, stats_t *stats) {
+    bool touching = touch.on_alloc || touch.scan_interval > 0 || touch.chase_interval > 0;
+    int i, cls;
+
+    reinit_trace(trace);
+    mem_reset_brk(false);
+    if (!mm_pkg->init()) {
+        app_error("trace %d: mm_init failed in eval_mm_cachesim", tracenum);
+    }
+    cachesim_reset();
+    memset(stats->cachesim_ops, 0, sizeof(stats->cachesim_ops));
+
+    for (i = 0; i < trace->num_ops; i++) {
+        stats->cachesim_ops[trace->ops[i].type]++;
+        cachesim_set_class(trace->ops[i].type);
+        cachesim_on = true;
+        replay_op(trace, i, tracenum, "eval_mm_cachesim");
+        cachesim_on = false;
+
+        if (touching) {
+            stats->cachesim_ops[CACHESIM_TOUCH]++;
+            cachesim_set_class(CACHESIM_TOUCH);
+            cachesim_on = true;
+            touch_op(trace, i);
+            cachesim_on = false;
+        }
+    }
+
+    for (cls = 0; cls < CACHESIM_CLASSES; cls++) {
+        cachesim_get_counts(cls, &stats->cachesim[cls]);
+    }
+    stats->has_cachesim = true;
+}
+
+/* Marks the pages of the heap that hold some of an allocated block's payload */
+static void mark_payload_pages(const mm_block_info_t *info, void *arg) {
+    unsigned char *pages = arg;
+    long pagesize = sysconf(_SC_PAGESIZE);
+    uintptr_t lo = (uintptr_t) mem_heap_lo();
+    uintptr_t first, last;
+
+    if (!info->allocated || info->payload_size == 0) return;
+    first = ((uintptr_t) info->payload - lo) / pagesize;
+    last = ((uintptr_t) info->payload + info->payload_size - 1 - lo) / pagesize;
+    for (uintptr_t page = first; page <= last; page++) {
+        pages[page] |= 2;
+    }
+}
+
+/*
+ * count_resident_pages - count the heap pages that are resident and, if the
+ *   package can walk its heap, those of them that hold no allocated payload
+ *   (-1 otherwise)
+ */
+static void count_resident_pages(long *heap_pages, long *resident, long *meta_only) {
+    long pagesize = sysconf(_SC_PAGESIZE);
+    unsigned char *pages;
+    long i, n;
+
+    if ((pages = calloc(mem_heapsize() / pagesize + 1, 1)) == NULL)
+        unix_error("calloc in count_resident_pages failed");
+    if ((n = mem_resident_pages(pages)) < 0) unix_error("mincore failed in count_resident_pages");
+    *meta_only = -1;
+    if (MM_PLUGIN_HAS(mm_pkg, heap_walk)) {
+        mm_pkg->heap_walk(mark_payload_pages, pages);
+        *meta_only = 0;
+    }
+
+    *heap_pages = n;
+    *resident = 0;
+    for (i = 0; i < n; i++) {
+        if (pages[i] & 1) (*resident)++;
+        if (pages[i] == 1 && *meta_only >= 0) (*meta_only)++;
+    }
+    free(pages);
+}
+
+/*
+ * eval_mm_rss - Replay the trace on a heap whose pages have all been given
+ *   back to the kernel, and count the pages the package has made resident
+ *   and how many of them hold no allocated payload, i.e. are resident only
+ *   because of the package's metadata, at the trace's peak; and the
+ *   resident pages and minor faults at its end. The driver doesn't write
+ *   the payloads in this pass, so every resident page was touched by the
+ *   package itself.
+ */
+static void eval_mm_rss(trace_t *trace, int tracenum, stats_t *stats) {
+    struct rusage before, after;
+    int peak_op = find_peak_op(trace);
+    long heap_pages, meta_only;
+    int i;
+
+    reinit_trace(trace);
+    mem_reset_brk(false);
+    mem_release_pages();
+    getrusage(RUSAGE_SELF, &before);
+    if (!mm_pkg->init()) {
+        app_error("trace %d: mm_init failed in eval_mm_rss", tracenum);
+    }
+    for (i = 0; i < trace->num_ops; i++) {
+        replay_op(trace, i, tracenum, "eval_mm_rss");
+        if (i == peak_op) {
+            count_resident_pages(&stats->rss_heap_pages, &stats->rss_pages,
+                                 &stats->rss_meta_pages);
+        }
+    }
+    getrusage(RUSAGE_SELF, &after);
+
+    count_resident_pages(&heap_pages, &stats->rss_end_pages, &meta_only);
+    if (peak_op < 0) {
+        stats->rss_heap_pages = heap_pages;
+        stats->rss_pages = stats->rss_end_pages;
+        stats->rss_meta_pages = meta_only;
+    }
+    stats->minor_faults = after.ru_minflt - before.ru_minflt;
+    stats->has_rss = true;
+
+    /* The released pages read back as zeros, which would hide reads of
+       uninitialized metadata in later passes, so fill them with garbage again */
+    mem_reset_brk(true);
+}
+
+/*
+ * prepare_mm_speed - reset the trace and the heap before a timed run of
+ *    eval_mm_speed, so that the driver's own bookkeeping isn't timed
+ */
+static void prepare_mm_speed(void *ptr) {
+    trace_t *trace = ((speed_t *) ptr)->trace;
+    reinit_trace(trace);
+    mem_reset_brk(false);
+}
+
+/*
+ * replay_speed - Run the requests of the trace on the mm package as fast as
+ *    possible, on the heap as it is
+ */
+static void replay_speed(trace_t *trace) {
+    const uint8_t *types = trace->op_types;
+    const int32_t *indices = trace->op_indices;
+    const uint32_t *sizes = trace->op_sizes;
+    const uint32_t *args = trace->op_args;
+    char **blocks = trace->blocks;
+    int num_ops = trace->num_ops;
+    int i;
+
+    /* Load the entry points once; the compiler can't know they don't change */
+    void *(*malloc_fn)(size_t) = mm_pkg->malloc;
+    void *(*realloc_fn)(void *, size_t) = mm_pkg->realloc;
+    void (*free_fn)(void *) = mm_pkg->free;
+    void *(*calloc_fn)(size_t, size_t) = mm_pkg->calloc;
+    void *(*memalign_fn)(size_t, size_t) =
+        MM_PLUGIN_HAS(mm_pkg, memalign) ? mm_pkg->memalign : NULL;
+    void (*free_sized_fn)(void *, size_t) =
+        MM_PLUGIN_HAS(mm_pkg, free_sized) ? mm_pkg->free_sized : NULL;
+    size_t (*usable_size_fn)(void *) =
+        MM_PLUGIN_HAS(mm_pkg, usable_size) ? mm_pkg->usable_size : NULL;
+
+    /* The null allocator's blocks aren't backed by memory, so calibration
+       runs measure the replay loop without the touches */
+    bool touching = (touch.on_alloc || touch.scan_interval > 0 || touch.chase_interval > 0) &&
+                    mm_pkg != &null_pkg;
+
+    /* Interpret each trace request */
+    for (i = 0; i < num_ops; i++) {
+        int index = indices[i];
+        char *p;
+
+        switch (types[i]) {
+            case ALLOC: /* mm_malloc */
+                if ((p = malloc_fn(sizes[i])) == NULL)
+                    app_error("mm_malloc error in replay_speed");
+                blocks[index] = p;
+                break;
+
+            case REALLOC: /* mm_realloc */
+                if ((p = realloc_fn(blocks[index], sizes[i])) == NULL && sizes[i] != 0)
+                    app_error("mm_realloc error in replay_speed");
+                blocks[index] = p;
+                break;
+
+            case FREE: /* mm_free; blocks[-1] is NULL */
+                free_fn(blocks[index]);
+                break;
+
+            case CALLOC: /* mm_calloc */
+                if ((p = calloc_fn(args[i], sizes[i])) == NULL)
+                    app_error("mm_calloc error in replay_speed");
+                blocks[index] = p;
+                break;
+
+            case MEMALIGN: /* mm_memalign */
+                if (memalign_fn == NULL || (p = memalign_fn(args[i], sizes[i])) == NULL)
+                    app_error("mm_memalign error in replay_speed");
+                blocks[index] = p;
+                break;
+
+            case SIZED_FREE: /* mm_free_sized */
+                if (free_sized_fn != NULL)
+                    free_sized_fn(blocks[index], sizes[i]);
+                else
+                    free_fn(blocks[index]);
+                break;
+
+            case USABLE_SIZE: /* mm_usable_size */
+                if (usable_size_fn != NULL) usable_size_fn(blocks[index]);
+                break;
+
+            default:
+                app_error("Nonexistent request type in replay_speed");
+        }
+
+        if (touching) touch_op(trace, i);
+    }
+}
+
+/*
+ * eval_mm_speed - This is the function that is timed by timing_measure()
+ *    to measure the running time of the mm malloc package.
+ */
+static void eval_mm_speed(void *ptr) {
+    /* Initialize the mm package */
+    if (!mm_pkg->init()) {
+        app_error("mm_init failed in eval_mm_speed");
+    }
+    replay_speed(((speed_t *) ptr)->trace);
+}
+
+/*
+ * eval_libc_valid - We run this function to make sure that the
+ *    libc malloc can run to completion on the set of traces.
+ *    We'll be conservative and terminate if any libc malloc call fails.
+ *
+ */
+static int eval_libc_valid(trace_t *trace) {
+    int i, newsize;
+    char *p, *newp, *oldp;
+
+    reinit_trace(trace);
+
+    for (i = 0; i < trace->num_ops; i++) {
+        switch (trace->ops[i].type) {
+            case ALLOC:    /* malloc */
+            case CALLOC:   /* calloc */
+            case MEMALIGN: /* memalign */
+                if ((p = pkg_alloc(&libc_pkg, &trace->ops[i])) == NULL) {
+                    malloc_error(trace, i, "%s failed", op_name(&libc_pkg, trace->ops[i].type));
+                    unix_error("System message");
+                }
+                trace->blocks[trace->ops[i].index] = p;
+                break;
+
+            case REALLOC: /* realloc */
+                newsize = trace->ops[i].size;
+                oldp = trace->blocks[trace->ops[i].index];
+                if ((newp = realloc(oldp, newsize)) == NULL && newsize != 0) {
+                    malloc_error(trace, i, "libc realloc failed");
+                    unix_error("System message");
+                }
+                trace->blocks[trace->ops[i].index] = newp;
+                break;
+
+            case FREE:       /* free */
+            case SIZED_FREE: /* free_sized */
+                if (trace->ops[i].index >= 0) {
+                    pkg_free(&libc_pkg, &trace->ops[i], trace->blocks[trace->ops[i].index]);
+                }
+                else {
+                    free(0);
+                }
+                break;
+
+            case USABLE_SIZE: /* malloc_usable_size */
+                malloc_usable_size(trace->blocks[trace->ops[i].index]);
+                break;
+
+            default:
+                app_error("invalid operation type  in eval_libc_valid");
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * time_speed - time the current package on a trace and record the result.
+ *     Unless calibration is off, the time of the null allocator on the
+ *     same trace is subtracted, so that the result reflects the cost of
+ *     the allocator rather than of the driver.
+ */
+static void time_speed(speed_t *speed_params, stats_t *stats) {
+    timing_result_t result, overhead;
+    const mm_plugin_t *pkg = mm_pkg;
+
+    timing_measure(prepare_mm_speed, eval_mm_speed, speed_params, &result);
+    stats->overhead_secs = 0;
+    if (calibrate) {
+        mm_pkg = &null_pkg;
+        timing_measure(prepare_mm_speed, eval_mm_speed, speed_params, &overhead);
+        mm_pkg = pkg;
+
+        /* Never let the noise in both timings make a result vanish */
+        stats->overhead_secs = overhead.median;
+        if (stats->overhead_secs > result.median / 2) {
+            stats->overhead_secs = result.median / 2;
+        }
+        result.median -= stats->overhead_secs;
+        result.ci_lo -= stats->overhead_secs;
+        result.ci_hi -= stats->overhead_secs;
+    }
+    stats->secs = result.median;
+    stats->secs_mad = result.mad;
+    stats->secs_ci_lo = result.ci_lo;
+    stats->secs_ci_hi = result.ci_hi;
+    stats->freq_changes = result.freq_changes;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * time_steady - Replay the trace over and over on the same heap, without
+ *    mem_reset_brk or mm_init in between, to see how the package does once
+ *    the heap has settled rather than while it grows from nothing. The
+ *    blocks a replay leaves allocated are freed at its end, as part of it,
+ *    so that every replay starts with no live blocks. The replays after the
+ *    warm-up ones are timed one by one, along with how much each of them
+ *    grew the heap.
+ */
+static void time_steady(trace_t *trace, stats_t *stats) {
+    double secs[MAX_STEADY_ITERS];
+    bool *live;
+    int i, iter;
+
+    if (steady.iters == 0 || !(mm_pkg->flags & MM_PLUGIN_USES_MEMLIB)) return;
+
+    /* Which blocks are still allocated at the end only depends on the trace */
+    if ((live = calloc(trace->num_ids, sizeof(*live))) == NULL)
+        unix_error("calloc in time_steady failed");
+    for (i = 0; i < trace->num_ops; i++) {
+        int index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+            case ALLOC:
+            case CALLOC:
+            case MEMALIGN:
+                live[index] = true;
+                break;
+            case REALLOC:
+                live[index] = trace->ops[i].size != 0;
+                break;
+            case FREE:
+            case SIZED_FREE:
+                if (index >= 0) live[index] = false;
+                break;
+            case USABLE_SIZE:
+                break;
+        }
+    }
+
+    mem_reset_brk(false);
+    if (!mm_pkg->init()) {
+        app_error("mm_init failed in time_steady");
+    }
+    for (iter = 0; iter < steady.warmups + steady.iters; iter++) {
+        size_t heapsize = mem_heapsize();
+        uint64_t start;
+        double t;
+
+        if (iter == steady.warmups) stats->steady_warm_heap = heapsize;
+        reinit_trace(trace);
+        start = timing_ticks();
+        replay_speed(trace);
+        for (i = 0; i < trace->num_ids; i++) {
+            if (live[i]) mm_pkg->free(trace->blocks[i]);
+        }
+        t = timing_ticks_to_secs(timing_ticks() - start);
+
+        if (iter == 0) stats->steady_cold_secs = t;
+        if (iter >= steady.warmups) {
+            stats->steady_iter_secs[iter - steady.warmups] = t;
+            stats->steady_iter_growth[iter - steady.warmups] = mem_heapsize() - heapsize;
+        }
+    }
+    free(live);
+
+    memcpy(secs, stats->steady_iter_secs, steady.iters * sizeof(double));
+    qsort(secs, steady.iters, sizeof(double), cmp_double);
+    stats->steady_secs = (steady.iters % 2 == 1)
+                             ? secs[steady.iters / 2]
+                             : (secs[steady.iters / 2 - 1] + secs[steady.iters / 2]) / 2;
+    stats->steady_iters = steady.iters;
+    stats->has_steady = true;
+}
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+/*
+ * printresults - prints a performance summary for some malloc package
+ */
+static void printresults(int n, stats_t *stats) {
+    int i;
+    /* weighted sums all */
+    double sumsecs = 0;
+    double sumops = 0;
+    double sumutil = 0;
+    int sumweight = 0;
+
+    /* Print the individual results for each trace */
+    printf("  %6s%6s %5s%8s%9s%7s  %s\n", "valid", "util", "ops", "secs", "Kops", "mad",
+           "trace");
+    for (i = 0; i < n; i++) {
+        if (stats[i].valid) {
+            printf("%2s%4s %5.0f%%%8.0f%10.6f%6.0f%6.1f%% %s%s\n",
+                   stats[i].weight != 0 ? "*" : "", "yes", stats[i].util * 100.0,
+                   stats[i].ops, stats[i].secs, (stats[i].ops / 1e3) / stats[i].secs,
+                   100.0 * stats[i].secs_mad / stats[i].secs, stats[i].filename,
+                   stats[i].freq_changes > 0 ? " (cpu frequency changed)" : "");
+            sumweight += stats[i].weight;
+            sumsecs += stats[i].secs * stats[i].weight;
+            sumops += stats[i].ops * stats[i].weight;
+            sumutil += stats[i].util * stats[i].weight;
+        }
+        else {
+            printf("%2s%4s %6s%8s%9s%6s%7s %s\n", stats[i].weight != 0 ? "*" : "", "no",
+                   "-", "-", "-", "-", "-", stats[i].filename);
+        }
+    }
+
+    /* Print the aggregate results for the set of traces */
+    if (errors == 0) {
+        if (sumweight == 0) sumweight = 1;
+
+        printf("%2d     %5.0f%%%8.0f%10.6f%6.0f\n", sumweight,
+               (sumutil / (double) sumweight) * 100.0, sumops, sumsecs,
+               (sumsecs == 0.0) ? 0 : (sumops / 1e3) / sumsecs);
+    }
+    else {
+        printf("       %8s%10s%6s\n", "-", "-", "-");
+    }
+}
+
+/*
+ * printfrag - prints the fragmentation breakdown of every trace, as
+ *     percentages of the heap size
+ */
+static void printfrag(int n, stats_t *stats) {
+    int i, b;
+
+    printf("\nFragmentation breakdown (percent of heap):\n");
+    printf("%6s%9s%9s%9s%9s%9s%11s  %s\n", "", "payload", "metadata", "padding", "slack",
+           "free", "heap", "trace");
+    for (i = 0; i < n; i++) {
+        const frag_t *snapshots[2] = {&stats[i].frag_peak, &stats[i].frag_end};
+        const char *labels[2] = {"peak", "end"};
+
+        if (!stats[i].valid) continue;
+        for (int s = 0; s < 2; s++) {
+            const frag_t *f = snapshots[s];
+            double heap = (f->heapsize == 0) ? 1 : (double) f->heapsize;
+
+            printf("%6s%8.1f%%%8.1f%%%8.1f%%%8.1f%%%8.1f%%%11zu  %s\n", labels[s],
+                   100.0 * f->payload / heap, 100.0 * f->metadata / heap,
+                   100.0 * f->padding / heap, 100.0 * f->slack / heap,
+                   100.0 * f->free / heap, f->heapsize, s == 0 ? stats[i].filename : "");
+            if (f->free == 0) continue;
+
+            /* Free space by block size, skipping empty buckets */
+            printf("%6s  free:", "");
+            for (b = 0; b < FRAG_BUCKETS; b++) {
+                if (f->free_by_bucket[b] == 0) continue;
+                if (b == FRAG_BUCKETS - 1)
+                    printf(" >%zu:", (size_t) 16 << b);
+                else
+                    printf(" <=%zu:", (size_t) 32 << b);
+                printf("%.1f%%", 100.0 * f->free_by_bucket[b] / heap);
+            }
+            printf("\n");
+        }
+    }
+}
+
+/*
+ * print_work_hist - print the non-empty buckets of a work histogram of
+ *     struct mm_stats
+ */
+static void print_work_hist(const char *label, const uint64_t *hist) {
+    uint64_t calls = 0;
+    int k;
+
+    for (k = 0; k < MM_STATS_HIST; k++) calls += hist[k];
+    if (calls == 0) return;
+    printf("%9s  %s:", "", label);
+    for (k = 0; k < MM_STATS_HIST; k++) {
+        if (hist[k] == 0) continue;
+        if (k <= 1)
+            printf(" %d:", k);
+        else if (k == MM_STATS_HIST - 1)
+            printf(" >=%" PRIu64 ":", (uint64_t) 1 << (k - 1));
+        else
+            printf(" %" PRIu64 "-%" PRIu64 ":", (uint64_t) 1 << (k - 1),
+                   ((uint64_t) 1 << k) - 1);
+        printf("%" PRIu64, hist[k]);
+    }
+    printf("\n");
+}
+
+/*
+ * printallocstats - print the statistics that the allocator reported
+ *     through mm_get_stats at the end of each trace
+ */
+static void printallocstats(int n, stats_t *stats) {
+    int i, k;
+    uint64_t searches;
+
+    printf("\nAllocator statistics (end of trace):\n");
+    printf("%9s%9s%9s%9s%9s%7s%11s%11s%11s  %s\n", "mallocs", "frees", "reallocs",
+           "splits", "merges", "sbrks", "allocated", "free", "largest", "trace");
+    for (i = 0; i < n; i++) {
+        const struct mm_stats *st = &stats[i].alloc_stats;
+
+        if (!stats[i].valid || !stats[i].has_alloc_stats) continue;
+        printf("%9" PRIu64 "%9" PRIu64 "%9" PRIu64 "%9" PRIu64 "%9" PRIu64 "%7" PRIu64
+               "%11zu%11zu%11zu  %s\n",
+               st->mallocs, st->frees, st->reallocs, st->splits, st->coalesces, st->sbrks,
+               st->allocated_bytes, st->free_bytes, st->largest_free, stats[i].filename);
+
+        /* The work done per call, as histograms */
+        searches = 0;
+        for (k = 0; k < MM_STATS_HIST; k++) searches += st->fit_searched[k];
+        if (searches > 0) {
+            printf("%9s  fit searches: %" PRIu64 ", blocks examined: mean %.1f, max %" PRIu64
+                   "\n",
+                   "", searches, (double) st->fit_searched_blocks / searches,
+                   st->fit_searched_max);
+        }
+        print_work_hist("blocks examined per search", st->fit_searched);
+        print_work_hist("merges per free", st->free_merges);
+        print_work_hist("merges per malloc", st->malloc_merges);
+        if (st->free_bytes == 0) continue;
+
+        /* Free blocks by size class, skipping empty classes */
+        printf("%9s  free blocks:", "");
+        for (k = 0; k < MM_STATS_CLASSES; k++) {
+            if (st->free_blocks[k] == 0) continue;
+            if (k == MM_STATS_CLASSES - 1)
+                printf(" >=%zu:", (size_t) 16 << k);
+            else
+                printf(" <%zu:", (size_t) 32 << k);
+            printf("%zu", st->free_blocks[k]);
+        }
+        printf("\n");
+    }
+}
+
+/*
+ * printrealloc - print how the allocator served the reallocs of existing
+ *     blocks in each trace that has any: in place or by moving, and the
+ *     bytes the moves copied per byte requested
+ */
+static void printrealloc(int n, stats_t *stats) {
+    bool header = false;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        const struct mm_stats *st = &stats[i].alloc_stats;
+        uint64_t calls = st->realloc_in_place + st->realloc_moved;
+
+        if (!stats[i].valid || !stats[i].has_alloc_stats || calls == 0) continue;
+        if (!header) {
+            printf("\nReallocs of existing blocks:\n");
+            printf("%9s%9s%9s%13s%13s%8s  %s\n", "calls", "inplace", "moved", "requested",
+                   "copied", "copy/B", "trace");
+            header = true;
+        }
+        printf("%9" PRIu64 "%9" PRIu64 "%9" PRIu64 "%13" PRIu64 "%13" PRIu64 "%8.3f  %s\n",
+               calls, st->realloc_in_place, st->realloc_moved, st->realloc_requested,
+               st->realloc_copied,
+               (st->realloc_requested == 0)
+                   ? 0.0
+                   : (double) st->realloc_copied / st->realloc_requested,
+               stats[i].filename);
+    }
+}
+
+/*
+ * printsbrk - print how each trace grew the heap through mem_sbrk, and
+ *     what that cost under --sbrk-cost
+ */
+static void printsbrk(int n, stats_t *stats) {
+    int i;
+
+    printf("\nHeap growth (mem_sbrk):\n");
+    if (sbrk_cost.on) {
+        printf("Charged %lu ns per call and %lu ns per page\n", sbrk_cost.call_nsecs,
+               sbrk_cost.page_nsecs);
+    }
+    printf("%9s%12s%9s%12s%10s  %s\n", "calls", "bytes", "pages", "bytes/call", "secs",
+           "trace");
+    for (i = 0; i < n; i++) {
+        const mem_sbrk_stats_t *sb = &stats[i].sbrk;
+
+        if (!stats[i].valid || !stats[i].has_sbrk) continue;
+        printf("%9" PRIu64 "%12" PRIu64 "%9" PRIu64 "%12.0f", sb->calls, sb->bytes, sb->pages,
+               (sb->calls == 0) ? 0.0 : (double) sb->bytes / sb->calls);
+        if (sbrk_cost.on)
+            printf("%10.6f", (sb->calls * sbrk_cost.call_nsecs +
+                              sb->pages * sbrk_cost.page_nsecs) / 1e9);
+        else
+            printf("%10s", "-");
+        printf("  %s\n", stats[i].filename);
+    }
+}
+
+/* Prints misses as a percentage of the accesses */
+static void print_miss_rate(uint64_t misses, uint64_t accesses) {
+    printf(" %8.2f%%", (accesses == 0) ? 0.0 : 100.0 * misses / accesses);
+}
+
+/*
+ * printcachesim - print the simulated miss rates of each trace, and of
+ *     each type of request over all the traces
+ */
+static void printcachesim(int n, stats_t *stats) {
+    const cachesim_config_t *c = &cachesim_config;
+    cachesim_counts_t total[CACHESIM_CLASSES];
+    uint64_t ops[CACHESIM_CLASSES];
+    bool instrumented = false;
+    int i, cls, l;
+
+    memset(total, 0, sizeof(total));
+    memset(ops, 0, sizeof(ops));
+    printf("\nSimulated cache misses (L1 %zuK/%u, L2 %zuK/%u, LLC %zuK/%u, TLB %u/%u; "
+           "%zu-byte lines, %zu-byte pages):\n",
+           c->size[0] >> 10, c->ways[0], c->size[1] >> 10, c->ways[1], c->size[2] >> 10,
+           c->ways[2], c->tlb_entries, c->tlb_ways, c->line, c->page);
+    printf("%-5s %12s %9s %9s %9s %9s\n", "trace", "lines", "L1", "L2", "LLC", "TLB");
+    for (i = 0; i < n; i++) {
+        cachesim_counts_t sum;
+
+        if (!stats[i].valid || !stats[i].has_cachesim) continue;
+        memset(&sum, 0, sizeof(sum));
+        for (cls = 0; cls < CACHESIM_CLASSES; cls++) {
+            const cachesim_counts_t *k = &stats[i].cachesim[cls];
+            sum.accesses += k->accesses;
+            total[cls].accesses += k->accesses;
+            for (l = 0; l < CACHESIM_LEVELS; l++) {
+                sum.misses[l] += k->misses[l];
+                total[cls].misses[l] += k->misses[l];
+            }
+            sum.tlb_misses += k->tlb_misses;
+            total[cls].tlb_misses += k->tlb_misses;
+            ops[cls] += stats[i].cachesim_ops[cls];
+            if (cls != CACHESIM_TOUCH && k->accesses > 0) instrumented = true;
+        }
+        printf("%-5d %12" PRIu64, i, sum.accesses);
+        for (l = 0; l < CACHESIM_LEVELS; l++) {
+            print_miss_rate(sum.misses[l], sum.accesses);
+        }
+        print_miss_rate(sum.tlb_misses, sum.accesses);
+        printf("\n");
+    }
+
+    /* Rates are misses per line accessed; touch counts every op touched after */
+    printf("%-11s %10s %8s %9s %9s %9s %9s %9s\n", "op", "count", "lines/op", "L1", "L2",
+           "LLC", "TLB", "LLC/op");
+    for (cls = 0; cls < CACHESIM_CLASSES; cls++) {
+        uint64_t count = ops[cls];
+
+        if (count == 0 && total[cls].accesses == 0) continue;
+        printf("%-11s %10" PRIu64 " %8.1f", cachesim_class_names[cls], count,
+               (count == 0) ? 0.0 : (double) total[cls].accesses / count);
+        for (l = 0; l < CACHESIM_LEVELS; l++) {
+            print_miss_rate(total[cls].misses[l], total[cls].accesses);
+        }
+        print_miss_rate(total[cls].tlb_misses, total[cls].accesses);
+        printf(" %9.3f\n",
+               (count == 0) ? 0.0 : (double) total[cls].misses[CACHESIM_LEVELS - 1] / count);
+    }
+    if (!instrumented) {
+        printf("(The allocator made no simulated accesses; build it with the "
+               "instrumentation described in src/cachesim.c.)\n");
+    }
+}
+
+/*
+ * printsteady - print the throughput of each trace on a new heap and on a
+ *     warm one, and how much the heap still grew once it was warm. The
+ *     JSON output has every measured replay.
+ */
+static void printsteady(int n, stats_t *stats) {
+    int i, k;
+
+    printf("\nSteady state (%d replays on the same heap after %d warm-up ones):\n",
+           steady.iters, steady.warmups);
+    printf("%10s%10s%12s%12s%8s  %s\n", "cold Kops", "warm Kops", "warm heap", "growth/rep",
+           "growing", "trace");
+    for (i = 0; i < n; i++) {
+        const stats_t *st = &stats[i];
+        size_t growth = 0;
+        int growing = 0;
+
+        if (!st->valid || !st->has_steady) continue;
+        for (k = 0; k < st->steady_iters; k++) {
+            growth += st->steady_iter_growth[k];
+            if (st->steady_iter_growth[k] > 0) growing++;
+        }
+        printf("%10.0f%10.0f%12zu%12.0f%8d  %s\n", st->ops / 1e3 / st->steady_cold_secs,
+               st->ops / 1e3 / st->steady_secs, st->steady_warm_heap,
+               (double) growth / st->steady_iters, growing, st->filename);
+    }
+}
+
+/*
+ * printrss - print the footprint of each trace in pages
+ */
+static void printrss(int n, stats_t *stats) {
+    int i;
+
+    printf("\nMemory footprint (%ld-byte pages, at the peak unless noted):\n",
+           sysconf(_SC_PAGESIZE));
+    printf("%10s%10s%8s%10s%10s%12s  %s\n", "heap", "resident", "rss%", "metadata", "end rss",
+           "minflt", "trace");
+    for (i = 0; i < n; i++) {
+        const stats_t *st = &stats[i];
+
+        if (!st->valid || !st->has_rss) continue;
+        printf("%10ld%10ld%7.1f%%", st->rss_heap_pages, st->rss_pages,
+               (st->rss_heap_pages == 0) ? 0.0 : 100.0 * st->rss_pages / st->rss_heap_pages);
+        if (st->rss_meta_pages >= 0)
+            printf("%10ld", st->rss_meta_pages);
+        else
+            printf("%10s", "-");
+        printf("%10ld%12ld  %s\n", st->rss_end_pages, st->minor_faults, st->filename);
+    }
+}
+
+/*
+ * The following routines write the results as JSON and compare them
+ * against the JSON results of an earlier run.
+ */
+
+/* Returns the part of a path after the last '/' */
+static const char *path_basename(const char *path) {
+    const char *name = strrchr(path, '/');
+    return (name == NULL) ? path : name + 1;
+}
+
+static void print_json_frag(FILE *fp, const char *name, const frag_t *f) {
+    int b;
+
+    fprintf(fp,
+            "\"%s\": {\"heapsize\": %zu, \"payload\": %zu, \"metadata\": %zu, "
+            "\"padding\": %zu, \"slack\": %zu, \"free\": %zu, \"free_by_bucket\": [",
+            name, f->heapsize, f->payload, f->metadata, f->padding, f->slack, f->free);
+    for (b = 0; b < FRAG_BUCKETS; b++) {
+        fprintf(fp, "%s%zu", b == 0 ? "" : ", ", f->free_by_bucket[b]);
+    }
+    fprintf(fp, "]}");
+}
+
+/* Writes a work histogram of struct mm_stats as a JSON member */
+static void print_json_hist(FILE *fp, const char *name, const uint64_t *hist) {
+    fprintf(fp, "\"%s\": [", name);
+    for (int k = 0; k < MM_STATS_HIST; k++) {
+        fprintf(fp, "%s%" PRIu64, k == 0 ? "" : ", ", hist[k]);
+    }
+    fprintf(fp, "]");
+}
+
+/*
+ * print_json_stats - write the per-trace stats of one malloc package
+ *     as a JSON array
+ */
+static void print_json_stats(FILE *fp, int n, const stats_t *stats) {
+    int i;
+
+    fprintf(fp, "[");
+    for (i = 0; i < n; i++) {
+        const stats_t *st = &stats[i];
+
+        fprintf(fp, "%s\n    {\"trace\": ", i == 0 ? "" : ",");
+        json_print_string(fp, st->filename);
+        fprintf(fp, ", \"weight\": %d, \"valid\": %s", st->weight,
+                st->valid ? "true" : "false");
+        if (st->valid) {
+            fprintf(fp,
+                    ", \"util\": %.6f, \"ops\": %.0f, \"secs\": %.9f, "
+                    "\"secs_mad\": %.9f, \"secs_ci\": [%.9f, %.9f], \"kops\": %.3f, "
+                    "\"overhead_secs\": %.9f, \"freq_changes\": %d",
+                    st->util, st->ops, st->secs, st->secs_mad, st->secs_ci_lo,
+                    st->secs_ci_hi, (st->secs == 0) ? 0 : (st->ops / 1e3) / st->secs,
+                    st->overhead_secs, st->freq_changes);
+            if (frag_report) {
+                fprintf(fp, ",\n     \"frag\": {");
+                print_json_frag(fp, "peak", &st->frag_peak);
+                fprintf(fp, ",\n              ");
+                print_json_frag(fp, "end", &st->frag_end);
+                fprintf(fp, "}");
+            }
+            if (st->has_alloc_stats) {
+                const struct mm_stats *a = &st->alloc_stats;
+                fprintf(fp,
+                        ",\n     \"alloc_stats\": {\"heap_size\": %zu, "
+                        "\"allocated_bytes\": %zu, \"allocated_blocks\": %zu, "
+                        "\"free_bytes\": %zu, \"largest_free\": %zu, \"free_blocks\": [",
+                        a->heap_size, a->allocated_bytes, a->allocated_blocks, a->free_bytes,
+                        a->largest_free);
+                for (int k = 0; k < MM_STATS_CLASSES; k++) {
+                    fprintf(fp, "%s%zu", k == 0 ? "" : ", ", a->free_blocks[k]);
+                }
+                fprintf(fp,
+                        "], \"mallocs\": %" PRIu64 ", \"frees\": %" PRIu64
+                        ", \"reallocs\": %" PRIu64 ", \"splits\": %" PRIu64
+                        ", \"coalesces\": %" PRIu64 ", \"sbrks\": %" PRIu64 ",",
+                        a->mallocs, a->frees, a->reallocs, a->splits, a->coalesces,
+                        a->sbrks);
+                fprintf(fp,
+                        "\n                     \"fit_searched_blocks\": %" PRIu64
+                        ", \"fit_searched_max\": %" PRIu64 ", ",
+                        a->fit_searched_blocks, a->fit_searched_max);
+                fprintf(fp,
+                        "\"realloc_in_place\": %" PRIu64 ", \"realloc_moved\": %" PRIu64
+                        ", \"realloc_requested\": %" PRIu64 ", \"realloc_copied\": %" PRIu64
+                        ",\n                     ",
+                        a->realloc_in_place, a->realloc_moved, a->realloc_requested,
+                        a->realloc_copied);
+                print_json_hist(fp, "fit_searched", a->fit_searched);
+                fprintf(fp, ",\n                     ");
+                print_json_hist(fp, "free_merges", a->free_merges);
+                fprintf(fp, ", ");
+                print_json_hist(fp, "malloc_merges", a->malloc_merges);
+                fprintf(fp, "}");
+            }
+            if (st->has_sbrk) {
+                fprintf(fp,
+                        ",\n     \"sbrk\": {\"calls\": %" PRIu64 ", \"bytes\": %" PRIu64
+                        ", \"pages\": %" PRIu64 "}",
+                        st->sbrk.calls, st->sbrk.bytes, st->sbrk.pages);
+            }
+            if (st->has_steady) {
+                fprintf(fp,
+                        ",\n     \"steady\": {\"warmups\": %d, \"cold_secs\": %.9f, "
+                        "\"secs\": %.9f, \"warm_heap\": %zu,\n                \"iter_secs\": [",
+                        steady.warmups, st->steady_cold_secs, st->steady_secs,
+                        st->steady_warm_heap);
+                for (int k = 0; k < st->steady_iters; k++) {
+                    fprintf(fp, "%s%.9f", k == 0 ? "" : ", ", st->steady_iter_secs[k]);
+                }
+                fprintf(fp, "],\n                \"iter_growth\": [");
+                for (int k = 0; k < st->steady_iters; k++) {
+                    fprintf(fp, "%s%zu", k == 0 ? "" : ", ", st->steady_iter_growth[k]);
+                }
+                fprintf(fp, "]}");
+            }
+            if (st->has_rss) {
+                fprintf(fp,
+                        ",\n     \"rss\": {\"heap_pages\": %ld, \"resident_pages\": %ld, "
+                        "\"metadata_pages\": %ld, \"end_resident_pages\": %ld, "
+                        "\"minor_faults\": %ld}",
+                        st->rss_heap_pages, st->rss_pages, st->rss_meta_pages, st->rss_end_pages,
+                        st->minor_faults);
+            }
+            if (st->has_cachesim) {
+                bool first = true;
+                fprintf(fp, ",\n     \"cachesim\": {");
+                for (int k = 0; k < CACHESIM_CLASSES; k++) {
+                    const cachesim_counts_t *c = &st->cachesim[k];
+                    if (st->cachesim_ops[k] == 0 && c->accesses == 0) continue;
+                    fprintf(fp,
+                            "%s\"%s\": {\"ops\": %" PRIu64 ", \"lines\": %" PRIu64
+                            ", \"l1_misses\": %" PRIu64 ", \"l2_misses\": %" PRIu64
+                            ", \"llc_misses\": %" PRIu64 ", \"tlb_misses\": %" PRIu64 "}",
+                            first ? "" : ",\n                  ", cachesim_class_names[k],
+                            st->cachesim_ops[k], c->accesses, c->misses[0], c->misses[1],
+                            c->misses[2], c->tlb_misses);
+                    first = false;
+                }
+                fprintf(fp, "}");
+            }
+        }
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ]");
+}
+
+/*
+ * write_json - write the results of the run to path ("-" for stdout)
+ */
+static void write_json(const char *path, int n, const stats_t *mm_stats,
+                       const stats_t *libc_stats, const perf_t *perf) {
+    FILE *fp = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+
+    if (fp == NULL) unix_error("Could not open %s in write_json", path);
+
+    fprintf(fp, "{\n  \"version\": 1,\n  \"clock\": \"%s\",\n  \"reps\": %d,\n",
+            timing_clock_name(), timing_config.reps);
+    if (sbrk_cost.on) {
+        fprintf(fp, "  \"sbrk_cost\": {\"call_nsecs\": %lu, \"page_nsecs\": %lu},\n",
+                sbrk_cost.call_nsecs, sbrk_cost.page_nsecs);
+    }
+    fprintf(fp, "  \"mm\": ");
+    print_json_stats(fp, n, mm_stats);
+    if (libc_stats != NULL) {
+        fprintf(fp, ",\n  \"libc\": ");
+        print_json_stats(fp, n, libc_stats);
+    }
+    fprintf(fp,
+            ",\n  \"total\": {\"util\": %.6f, \"kops\": %.3f, \"p1\": %.6f, "
+            "\"p2\": %.6f, \"perf_index\": %.3f, \"errors\": %d}\n}\n",
+            perf->avg_util, perf->avg_throughput / 1e3, perf->p1, perf->p2,
+            perf->perfindex, errors);
+
+    if (fp != stdout) fclose(fp);
+}
+
+/*
+ * find_baseline_trace - find the baseline entry for a trace, matching
+ *     on the file name only so that baselines survive moving the traces
+ */
+static const json_value_t *find_baseline_trace(const json_value_t *traces,
+                                               const char *filename) {
+    size_t i;
+
+    for (i = 0; i < traces->num_members; i++) {
+        const char *name = json_get_string(&traces->members[i], "trace");
+        if (name != NULL && strcmp(path_basename(name), path_basename(filename)) == 0) {
+            return &traces->members[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * compare_baseline - compare the results against a baseline results
+ *     file and return the number of checks that failed: metrics that
+ *     regressed, traces that were valid in the baseline but aren't now,
+ *     and traces that are in only one of the two runs, since a renamed or
+ *     dropped trace would otherwise go ungated.
+ *
+ *     Utilization is deterministic, so every trace is gated on it. Timing
+ *     is noisy: a single trace is only gated on throughput if both runs
+ *     took long enough to time reliably and the drop exceeds NOISE_MADS
+ *     times the combined spread of the two runs. The throughput of the run
+ *     as a whole is gated on the geometric mean of the per-trace ratios,
+ *     which one noisy trace cannot move much.
+ */
+static int compare_baseline(const char *path, int n, const stats_t *stats,
+                            const perf_t *perf) {
+    char err[MAXLINE];
+    json_value_t *baseline;
+    const json_value_t *traces, *total;
+    int i, regressions = 0, num_ratios = 0;
+    size_t j;
+    double log_ratios = 0;
+
+    if ((baseline = json_parse_file(path, err, sizeof(err))) == NULL) {
+        app_error("Could not read baseline %s: %s\n", path, err);
+    }
+    traces = json_get(baseline, "mm");
+    total = json_get(baseline, "total");
+    if (traces == NULL || traces->type != JSON_ARRAY || total == NULL) {
+        app_error("Baseline %s is not an mdriver results file\n", path);
+    }
+
+    printf("\nComparison against baseline %s:\n", path);
+    printf("%8s%8s%10s%10s%8s  %s\n", "util", "base", "Kops", "base", "ratio", "trace");
+    for (i = 0; i < n; i++) {
+        const json_value_t *base = find_baseline_trace(traces, stats[i].filename);
+        double kops, base_kops, base_secs, base_mad, ratio, noise;
+        bool util_regressed, kops_regressed;
+
+        if (!stats[i].valid || base == NULL || !json_get_number(base, "valid", 0)) {
+            bool became_invalid =
+                base != NULL && !stats[i].valid && json_get_number(base, "valid", 0);
+            printf("%8s%8s%10s%10s%8s  %s%s\n", "-", "-", "-", "-", "-", stats[i].filename,
+                   base == NULL     ? "  [not in baseline]"
+                   : became_invalid ? "  [became invalid]"
+                                    : "");
+            regressions += (base == NULL) + became_invalid;
+            continue;
+        }
+
+        kops = (stats[i].ops / 1e3) / stats[i].secs;
+        base_kops = json_get_number(base, "kops", 0);
+        base_secs = json_get_number(base, "secs", 0);
+        base_mad = json_get_number(base, "secs_mad", 0);
+        ratio = (base_kops == 0) ? 1 : kops / base_kops;
+        noise = (base_secs == 0) ? 0
+                                 : NOISE_MADS * hypot(stats[i].secs_mad / stats[i].secs,
+                                                      base_mad / base_secs);
+        if (ratio > 0) {
+            log_ratios += log(ratio);
+            num_ratios++;
+        }
+
+        util_regressed =
+            stats[i].util < json_get_number(base, "util", 0) - util_tolerance;
+        kops_regressed = ratio < 1 - kops_tolerance && ratio < 1 - noise &&
+                         stats[i].secs >= MIN_GATED_SECS && base_secs >= MIN_GATED_SECS;
+        regressions += util_regressed + kops_regressed;
+
+        printf("%7.1f%%%7.1f%%%10.0f%10.0f%8.3f  %s%s%s\n", stats[i].util * 100,
+               json_get_number(base, "util", 0) * 100, kops, base_kops, ratio,
+               stats[i].filename, util_regressed ? "  [util regressed]" : "",
+               kops_regressed ? "  [Kops regressed]" : "");
+    }
+
+    for (j = 0; j < traces->num_members; j++) {
+        const char *name = json_get_string(&traces->members[j], "trace");
+        for (i = 0; i < n && name != NULL; i++) {
+            if (strcmp(path_basename(name), path_basename(stats[i].filename)) == 0) break;
+        }
+        if (name != NULL && i == n) {
+            printf("%8s%8s%10s%10s%8s  %s  [not in this run]\n", "-", "-", "-", "-", "-", name);
+            regressions++;
+        }
+    }
+
+    /* Aggregate metrics */
+    if (num_ratios > 0) {
+        double geomean = exp(log_ratios / num_ratios);
+        bool regressed = geomean < 1 - kops_tolerance;
+        printf("Geometric mean Kops ratio: %.3f%s\n", geomean,
+               regressed ? "  [regressed]" : "");
+        regressions += regressed;
+    }
+    if (perf->avg_util < json_get_number(total, "util", 0) - util_tolerance) {
+        printf("Average util regressed: %.1f%% (baseline %.1f%%)\n", perf->avg_util * 100,
+               json_get_number(total, "util", 0) * 100);
+        regressions++;
+    }
+    if (perf->perfindex < json_get_number(total, "perf_index", 0) - perf_tolerance) {
+        printf("Perf index regressed: %.1f (baseline %.1f)\n", perf->perfindex,
+               json_get_number(total, "perf_index", 0));
+        regressions++;
+    }
+    printf("\n");
+
+    json_free(baseline);
+    return regressions;
+}
+
+/*
+ * parse_tolerances - parse a list like "util=0.01,kops=0.05,perf=2"
+ */
+static void parse_tolerances(char *spec) {
+    char *item;
+
+    for (item = strtok(spec, ","); item != NULL; item = strtok(NULL, ",")) {
+        char *eq = strchr(item, '=');
+        double value;
+
+        if (eq == NULL) app_error("Bad tolerance %s (expected metric=value)\n", item);
+        *eq = '\0';
+        value = atof(eq + 1);
+        if (strcmp(item, "util") == 0)
+            util_tolerance = value;
+        else if (strcmp(item, "kops") == 0)
+            kops_tolerance = value;
+        else if (strcmp(item, "perf") == 0)
+            perf_tolerance = value;
+        else
+            app_error("Unknown tolerance metric %s (util, kops or perf)\n", item);
+    }
+}
+
+/*
+ * parse_touch - parse a --touch list such as alloc,scan=1000,chase=5000
+ */
+static void parse_touch(char *spec) {
+    char *item;
+
+    for (item = strtok(spec, ","); item != NULL; item = strtok(NULL, ",")) {
+        char *eq = strchr(item, '=');
+        int value = 0;
+
+        if (eq != NULL) {
+            *eq = '\0';
+            if ((value = atoi(eq + 1)) <= 0)
+                app_error("Bad touch interval %s for %s\n", eq + 1, item);
+        }
+        if (strcmp(item, "alloc") == 0 && eq == NULL)
+            touch.on_alloc = true;
+        else if (strcmp(item, "scan") == 0 && eq != NULL)
+            touch.scan_interval = value;
+        else if (strcmp(item, "chase") == 0 && eq != NULL)
+            touch.chase_interval = value;
+        else
+            app_error("Unknown touch pattern %s (alloc, scan=<k> or chase=<k>)\n", item);
+    }
+}
+
+/*
+ * parse_checkheap - parse a --checkheap spec such as full, incremental,blocks=64 or
+ *     sampled,blocks=64,period=100
+ */
+static void parse_checkheap(char *spec) {
+    char *item;
+
+    checkheap.on = true;
+    for (item = strtok(spec, ","); item != NULL; item = strtok(NULL, ",")) {
+        char *eq = strchr(item, '=');
+        long value = 0;
+
+        if (eq != NULL) {
+            *eq = '\0';
+            if ((value = atol(eq + 1)) <= 0)
+                app_error("Bad checkheap value %s for %s\n", eq + 1, item);
+        }
+        if (strcmp(item, "full") == 0 && eq == NULL)
+            checkheap.mode = MM_CHECK_FULL;
+        else if (strcmp(item, "incremental") == 0 && eq == NULL)
+            checkheap.mode = MM_CHECK_INCREMENTAL;
+        else if (strcmp(item, "sampled") == 0 && eq == NULL)
+            checkheap.mode = MM_CHECK_SAMPLED;
+        else if (strcmp(item, "blocks") == 0 && eq != NULL)
+            checkheap.blocks = value;
+        else if (strcmp(item, "period") == 0 && eq != NULL)
+            checkheap.period = value;
+        else
+            app_error("Unknown checkheap setting %s (full, incremental, sampled, blocks=<n> "
+                      "or period=<n>)\n",
+                      item);
+    }
+}
+
+/*
+ * parse_size - parse a size such as 4096, 32k, 1m or 16m
+ */
+static bool parse_size(const char *text, size_t *size) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 0);
+
+    switch (*end) {
+        case 'k':
+        case 'K':
+            value <<= 10;
+            end++;
+            break;
+        case 'm':
+        case 'M':
+            value <<= 20;
+            end++;
+            break;
+        case 'g':
+        case 'G':
+            value <<= 30;
+            end++;
+            break;
+    }
+    *size = value;
+    return end != text && *end == '\0' && value > 0;
+}
+
+/*
+ * parse_cachesim - parse a --cachesim geometry such as
+ *     l1=32k:8,l2=1m:16,llc=16m:16,tlb=64:4,line=64,page=4k
+ *     where <size>:<ways> gives a cache's size and associativity. Anything
+ *     left out keeps its default.
+ */
+static void parse_cachesim(char *spec) {
+    static const char *levels[CACHESIM_LEVELS] = {"l1", "l2", "llc"};
+    char *item;
+
+    cachesim_report = 1;
+    cachesim_config = cachesim_default_config;
+    if (spec == NULL) return;
+
+    for (item = strtok(spec, ","); item != NULL; item = strtok(NULL, ",")) {
+        char *eq = strchr(item, '=');
+        char *colon;
+        size_t size, ways = 0;
+        int l;
+
+        if (eq == NULL) app_error("Bad cachesim setting %s\n", item);
+        *eq = '\0';
+        if ((colon = strchr(eq + 1, ':')) != NULL) {
+            *colon = '\0';
+            if (!parse_size(colon + 1, &ways)) app_error("Bad associativity %s\n", colon + 1);
+        }
+        if (!parse_size(eq + 1, &size)) app_error("Bad size %s for %s\n", eq + 1, item);
+
+        for (l = 0; l < CACHESIM_LEVELS && strcmp(item, levels[l]) != 0; l++)
+            ;
+        if (l < CACHESIM_LEVELS) {
+            cachesim_config.size[l] = size;
+            if (ways > 0) cachesim_config.ways[l] = ways;
+        }
+        else if (strcmp(item, "tlb") == 0) {
+            cachesim_config.tlb_entries = size;
+            if (ways > 0) cachesim_config.tlb_ways = ways;
+        }
+        else if (strcmp(item, "line") == 0 && colon == NULL)
+            cachesim_config.line = size;
+        else if (strcmp(item, "page") == 0 && colon == NULL)
+            cachesim_config.page = size;
+        else
+            app_error("Unknown cachesim setting %s (l1, l2, llc, tlb, line or page)\n", item);
+    }
+}
+
+/*
+ * parse_sbrk_cost - parse a --sbrk-cost model such as call=500,page=250,
+ *     in nanoseconds per mem_sbrk call and per page it maps. Anything left
+ *     out keeps its default.
+ */
+static void parse_sbrk_cost(char *spec) {
+    char *item;
+
+    sbrk_cost.on = true;
+    if (spec == NULL) return;
+
+    for (item = strtok(spec, ","); item != NULL; item = strtok(NULL, ",")) {
+        char *eq = strchr(item, '=');
+        char *end;
+        unsigned long value;
+
+        if (eq == NULL) app_error("Bad sbrk-cost setting %s\n", item);
+        *eq = '\0';
+        value = strtoul(eq + 1, &end, 10);
+        if (end == eq + 1 || *end != '\0') app_error("Bad time %s for %s\n", eq + 1, item);
+        if (strcmp(item, "call") == 0)
+            sbrk_cost.call_nsecs = value;
+        else if (strcmp(item, "page") == 0)
+            sbrk_cost.page_nsecs = value;
+        else
+            app_error("Unknown sbrk-cost setting %s (call or page)\n", item);
+    }
+}
+
+/*
+ * parse_steady - parse a --steady setting such as 20 or 20,warmup=5: the
+ *     number of replays to measure on a warm heap, and of those before them
+ */
+static void parse_steady(char *spec) {
+    char *item = strtok(spec, ",");
+
+    if (item == NULL || (steady.iters = atoi(item)) <= 0 || steady.iters > MAX_STEADY_ITERS)
+        app_error("--steady takes 1 to %d replays\n", MAX_STEADY_ITERS);
+    while ((item = strtok(NULL, ",")) != NULL) {
+        if (strncmp(item, "warmup=", 7) == 0 && (steady.warmups = atoi(item + 7)) >= 0)
+            continue;
+        app_error("Unknown steady setting %s (warmup=<n>)\n", item);
+    }
+}
+
+/*
+ * load_plugin - load an allocator plugin and check that we understand its ABI
+ */
+static const mm_plugin_t *load_plugin(const char *path) {
+    void *handle;
+    const mm_plugin_t *plugin;
+
+    /* A bare file name would make dlopen search the library path */
+    char full_path[MAXLINE + 2];
+    snprintf(full_path, sizeof(full_path), "%s%s", strchr(path, '/') ? "" : "./", path);
+
+    if ((handle = dlopen(full_path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+        app_error("Could not load plugin %s: %s\n", path, dlerror());
+    }
+    if ((plugin = dlsym(handle, MM_PLUGIN_SYMBOL)) == NULL) {
+        app_error("%s does not export " MM_PLUGIN_SYMBOL "\n", path);
+    }
+    if (plugin->abi_version != MM_PLUGIN_ABI_VERSION ||
+        plugin->size < offsetof(mm_plugin_t, checkheap)) {
+        app_error("%s was built for plugin ABI version %u, expected %d\n", path,
+                  plugin->abi_version, MM_PLUGIN_ABI_VERSION);
+    }
+    if (plugin->init == NULL || plugin->malloc == NULL || plugin->free == NULL ||
+        plugin->realloc == NULL || plugin->calloc == NULL) {
+        app_error("%s is missing required entry points\n", path);
+    }
+    return plugin;
+}
+
+/*
+ * printcomparison - prints the util and throughput of several malloc
+ *     packages side by side, one column per package
+ */
+static void printcomparison(int n, int num_pkgs, const mm_plugin_t **pkgs, stats_t **stats) {
+    int i, k;
+
+    printf("\nComparison of malloc packages (util, Kops):\n");
+    for (k = 0; k < num_pkgs; k++) {
+        printf("%16.16s", pkgs[k]->name);
+    }
+    printf("  trace\n");
+
+    for (i = 0; i < n; i++) {
+        for (k = 0; k < num_pkgs; k++) {
+            const stats_t *st = &stats[k][i];
+            if (!st->valid) {
+                printf("%7s%9s", "-", "invalid");
+            }
+            else if (!(pkgs[k]->flags & MM_PLUGIN_USES_MEMLIB)) {
+                printf("%7s%9.0f", "-", (st->ops / 1e3) / st->secs);
+            }
+            else {
+                printf("%6.0f%%%9.0f", st->util * 100.0, (st->ops / 1e3) / st->secs);
+            }
+        }
+        printf("  %s\n", stats[0][i].filename);
+    }
+
+    /* Weighted totals, computed the same way as for the performance index */
+    for (k = 0; k < num_pkgs; k++) {
+        perf_t perf;
+        compute_perf_index(n, stats[k], &perf);
+        if (!(pkgs[k]->flags & MM_PLUGIN_USES_MEMLIB)) {
+            printf("%7s%9.0f", "-", perf.avg_throughput / 1e3);
+        }
+        else {
+            printf("%6.0f%%%9.0f", perf.avg_util * 100.0, perf.avg_throughput / 1e3);
+        }
     }
+    printf("  (weighted total)\n");
 }
 
 /*
@@ -1189,7 +3761,17 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...) {
  */
 static void usage(void) {
     fprintf(stderr,
-            "Usage: mdriver [-hlD] [-d <i>] [-t <dir>] [-c <file>] [-f <file>]\n"
+            "Usage: mdriver [-hlD] [-d <i>] [-t <dir>] [-c <file>] [-f <file>] [-j <n>]\n"
+            "               [--timeline=<k>] [--timeline-format=csv|json]\n"
+            "               [--timeline-dir=<dir>] [--frag] [--stats]\n"
+            "               [--json=<file>]\n"
+            "               [--baseline=<file>] [--tolerance=<metric>=<x>,...]\n"
+            "               [--reps=<n>] [--warmup=<n>] [--cpu=<n>] [--detect-freq]\n"
+            "               [--plugin=<file.so>]... [--no-calibrate] [--touch=<list>]\n"
+            "               [--checkheap=<mode>] [--cachesim[=<geometry>]]\n"
+            "               [--heap-dump=<dir>] [--events=<file>] [--rss]\n"
+            "               [--sbrk-cost[=call=<ns>,page=<ns>]]\n"
+            "               [--steady=<n>[,warmup=<k>]]\n"
             "Options\n"
             "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n"
             "\t-D         Equivalent to -d2.\n"
@@ -1197,5 +3779,53 @@ static void usage(void) {
             "\t-t <dir>   Directory to find default traces.\n"
             "\t-h         Print this message.\n"
             "\t-l         Run libc malloc as well.\n"
-            "\t-f <file>  Use <file> as the trace file.\n");
+            "\t-f <file>  Use <file> as the trace file.\n"
+            "\t-j <n>     Check traces for correctness and utilization in <n>\n"
+            "\t           parallel processes; speed is still measured serially.\n"
+            "\t--timeline=<k>         Sample the heap every <k> ops of each trace.\n"
+            "\t--timeline-format=<f>  Write timeline samples as csv (default) or json.\n"
+            "\t--timeline-dir=<dir>   Write timeline files to <dir> (default ./).\n"
+            "\t--frag                 Break the heap down into payload, metadata,\n"
+            "\t                       padding, slack and free space per trace.\n"
+            "\t--stats                Print the allocator's own statistics per trace\n"
+            "\t                       (see mm_get_stats).\n"
+            "\t--json=<file>          Write the results as JSON to <file> (- for stdout).\n"
+            "\t--baseline=<file>      Compare against the JSON results in <file> and\n"
+            "\t                       fail on regressions.\n"
+            "\t--tolerance=<list>     Allowed regressions, e.g. util=0.005,kops=0.1,perf=1\n"
+            "\t                       (absolute util, relative Kops, perf index points).\n"
+            "\t--reps=<n>             Time <n> runs of each trace (default 11).\n"
+            "\t--warmup=<n>           Run each trace <n> times before timing (default 2).\n"
+            "\t--cpu=<n>              Pin to CPU <n> while timing (-1: don't pin;\n"
+            "\t                       default: the CPU mdriver starts on).\n"
+            "\t--detect-freq          Flag runs during which the CPU frequency changed.\n"
+            "\t--plugin=<file.so>     Also run an allocator plugin (see mm_plugin.h) and\n"
+            "\t                       compare it with mm; may be repeated.\n"
+            "\t--no-calibrate         Don't subtract the replay overhead, measured with a\n"
+            "\t                       null allocator, from the times.\n"
+            "\t--touch=<list>         Touch the blocks while timing, e.g. alloc,scan=1000,\n"
+            "\t                       chase=5000: write each block when it is allocated,\n"
+            "\t                       read all live blocks and chase pointers through\n"
+            "\t                       them every <k> ops.\n"
+            "\t--checkheap=<mode>     Check the heap before every op of the correctness\n"
+            "\t                       pass: full, incremental,blocks=<n> or\n"
+            "\t                       sampled,blocks=<n>,period=<n> (see mm.h).\n"
+            "\t--cachesim[=<list>]    Replay each trace through a simulated L1/L2/LLC\n"
+            "\t                       and TLB and report miss rates per trace and op\n"
+            "\t                       type, e.g. l1=32k:8,l2=1m:16,llc=16m:16,tlb=64:4,\n"
+            "\t                       line=64,page=4k. Touches with --touch.\n"
+            "\t--heap-dump=<dir>      Write heap snapshots (see mm_dump.h) at the peak\n"
+            "\t                       and the end of each trace to <dir>.\n"
+            "\t--events=<file>        Record every allocator call in shared-memory\n"
+            "\t                       rings in <file>, to be followed with mevents.\n"
+            "\t--rss                  Count the heap pages each trace makes resident,\n"
+            "\t                       those holding only metadata at its peak, and its\n"
+            "\t                       minor faults.\n"
+            "\t--sbrk-cost[=<list>]   Make each mem_sbrk call take as long as growing\n"
+            "\t                       a real heap, e.g. call=500,page=250 (ns per call\n"
+            "\t                       and per page mapped), and report heap growth.\n"
+            "\t--steady=<n>[,warmup=<k>]\n"
+            "\t                       Also replay each trace <k> (default 3) and then\n"
+            "\t                       <n> more times on the same heap, and report the\n"
+            "\t                       throughput and heap growth of the last <n>.\n");
 }
@@ -0,0 +1,296 @@
+/*
+ * mevents.c - Follow the allocator event rings of a running process
+ *
+ * Maps the file written by evring_open (see evring.h), e.g. by
+ * `mdriver --events=<file>`, and tails every thread's ring without
+ * stopping or slowing the process that writes it. By default each event
+ * is printed as it arrives:
+ *
+ *     <secs since the file was created> <pid>/<tid> <op> <size> <addr> <ns>
+ *
+ * With -s <secs>, a summary of the calls of each type (count, rate, mean
+ * and worst latency) is printed every <secs> seconds instead. Events that
+ * were overwritten before they could be read are counted as lost.
+ *
+ *     gcc -O2 -Iinclude mevents.c -o mevents
+ *     ./mevents -s 1 /dev/shm/mm.events
+ *
+ * mevents stops when the writing process has exited and its events have
+ * been read, or on SIGINT.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "include/evring.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define POLL_NSECS (1000 * 1000) /* sleep between polls that found nothing */
+#define WAIT_SECS 5              /* how long to wait for a new file to be set up */
+
+/* What one ring's reader has seen */
+typedef struct {
+    uint64_t cursor; /* events read or skipped */
+    uint64_t lost;   /* events overwritten before they were read */
+} reader_t;
+
+/* Calls of one type seen in a summary interval */
+typedef struct {
+    uint64_t count;
+    uint64_t cycles;
+    uint64_t max_cycles;
+} op_summary_t;
+
+/*******************
+ * Global variables
+ ******************/
+
+static const char *op_names[EVRING_NUM_OPS] = {"malloc", "free", "realloc", "sbrk"};
+static double summary_secs = 0; /* 0: print every event */
+static bool follow = true;
+static volatile sig_atomic_t interrupted = 0;
+
+static const evring_header_t *header;
+static evring_event_t *copy; /* events copied out of a ring */
+static op_summary_t summary[EVRING_NUM_OPS];
+static uint64_t summary_first = UINT64_MAX, summary_last = 0; /* ticks of the events */
+
+/*********************
+ * Function prototypes
+ *********************/
+
+static void app_error(const char *fmt, ...) __attribute__((format(printf, 1, 2), noreturn));
+static void usage(void);
+
+static void on_sigint(int sig) {
+    (void) sig;
+    interrupted = 1;
+}
+
+/* Returns the seconds on CLOCK_MONOTONIC */
+static double now_secs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * map_events - map the event file at path, waiting a little for a writer
+ *     that has only just created it to set it up
+ */
+static const evring_header_t *map_events(const char *path) {
+    const evring_header_t *h;
+    struct stat st;
+    size_t size;
+    int fd, tries;
+
+    if ((fd = open(path, O_RDONLY)) < 0) app_error("%s: %s", path, strerror(errno));
+    for (tries = 0; tries < WAIT_SECS * 100; tries++) {
+        if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(evring_header_t)) {
+            h = mmap(NULL, sizeof(*h), PROT_READ, MAP_SHARED, fd, 0);
+            if (h == MAP_FAILED) app_error("%s: %s", path, strerror(errno));
+            if (h->magic == EVRING_MAGIC) break;
+            munmap((void *) h, sizeof(*h));
+        }
+        usleep(10000);
+    }
+    if (tries == WAIT_SECS * 100) app_error("%s: not an event file", path);
+    atomic_thread_fence(memory_order_acquire);
+    if (h->version != EVRING_VERSION || h->event_size != sizeof(evring_event_t))
+        app_error("%s: event file version %u, expected %u", path, h->version, EVRING_VERSION);
+
+    size = (char *) evring_thread(h, h->max_threads) - (char *) h;
+    munmap((void *) h, sizeof(*h));
+    h = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED) app_error("%s: %s", path, strerror(errno));
+    close(fd);
+    return h;
+}
+
+/*
+ * handle_event - print or summarize one event
+ */
+static void handle_event(const evring_thread_t *ring, const evring_event_t *e) {
+    unsigned op = (e->op < EVRING_NUM_OPS) ? e->op : EVRING_MALLOC;
+
+    if (summary_secs > 0) {
+        summary[op].count++;
+        summary[op].cycles += e->cycles;
+        if (e->cycles > summary[op].max_cycles) summary[op].max_cycles = e->cycles;
+        if (e->ticks < summary_first) summary_first = e->ticks;
+        if (e->ticks > summary_last) summary_last = e->ticks;
+        return;
+    }
+    printf("%.9f %u/%u %s %" PRIu64 " 0x%" PRIx64 " %.0f\n",
+           (double) (e->ticks - header->start_ticks) / header->ticks_per_sec, ring->pid, ring->tid,
+           op_names[op], e->size, e->addr, e->cycles * 1e9 / header->ticks_per_sec);
+}
+
+/*
+ * drain - read the events of a ring that haven't been read yet. Returns
+ *     how many there were, lost ones included.
+ */
+static uint64_t drain(evring_thread_t *ring, reader_t *reader) {
+    uint64_t slots = header->num_slots;
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t copied, first, reserved, i;
+
+    if (head == reader->cursor) return 0;
+    copied = (head - reader->cursor > slots) ? head - slots : reader->cursor;
+    for (i = copied; i < head; i++) {
+        copy[i - copied] = evring_events(ring)[i & (slots - 1)];
+    }
+
+    // Whatever the writer has started to overwrite since is thrown away
+    atomic_thread_fence(memory_order_acquire);
+    reserved = atomic_load_explicit(&ring->reserved, memory_order_relaxed);
+    first = (reserved > slots && reserved - slots > copied) ? reserved - slots : copied;
+    for (i = first; i < head; i++) {
+        handle_event(ring, &copy[i - copied]);
+    }
+    reader->lost += first - reader->cursor;
+
+    i = head - reader->cursor;
+    reader->cursor = head;
+    return i;
+}
+
+/*
+ * print_summary - print and clear the summary of the last `secs` seconds.
+ *     With -n, the rates are over the time the events span instead.
+ */
+static void print_summary(double secs, uint64_t lost) {
+    if (!follow && summary_last > summary_first) {
+        secs = (summary_last - summary_first) / header->ticks_per_sec;
+    }
+    printf("%-8s %12s %12s %10s %10s\n", "op", "calls", "calls/s", "mean ns", "max ns");
+    for (int op = 0; op < EVRING_NUM_OPS; op++) {
+        const op_summary_t *s = &summary[op];
+        if (s->count == 0) continue;
+        printf("%-8s %12" PRIu64 " %12.0f %10.1f %10.0f\n", op_names[op], s->count,
+               s->count / secs, s->cycles * 1e9 / header->ticks_per_sec / s->count,
+               s->max_cycles * 1e9 / header->ticks_per_sec);
+    }
+    if (lost > 0) printf("lost     %12" PRIu64 "\n", lost);
+    printf("\n");
+    fflush(stdout);
+    memset(summary, 0, sizeof(summary));
+    summary_first = UINT64_MAX;
+    summary_last = 0;
+}
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv) {
+    reader_t *readers;
+    uint64_t lost_reported = 0;
+    double last_summary;
+    int c;
+
+    while ((c = getopt(argc, argv, "s:nh")) != EOF) {
+        switch (c) {
+            case 's': /* Summarize every <secs> seconds */
+                summary_secs = atof(optarg);
+                if (summary_secs <= 0) app_error("The summary interval must be positive");
+                break;
+
+            case 'n': /* Read what is there and stop */
+                follow = false;
+                break;
+
+            case 'h':
+                usage();
+                exit(0);
+
+            default:
+                usage();
+                exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        exit(1);
+    }
+
+    header = map_events(argv[optind]);
+    readers = calloc(header->max_threads, sizeof(*readers));
+    copy = malloc(header->num_slots * sizeof(*copy));
+    if (readers == NULL || copy == NULL) app_error("Out of memory");
+    signal(SIGINT, on_sigint);
+    last_summary = now_secs();
+
+    while (!interrupted) {
+        unsigned num_threads = atomic_load(&((evring_header_t *) header)->num_threads);
+        bool writer_gone = kill(header->pid, 0) < 0 && errno == ESRCH;
+        uint64_t seen = 0, lost = 0;
+
+        if (num_threads > header->max_threads) num_threads = header->max_threads;
+        for (unsigned t = 0; t < num_threads; t++) {
+            seen += drain(evring_thread(header, t), &readers[t]);
+            lost += readers[t].lost;
+        }
+
+        if (summary_secs > 0 && now_secs() - last_summary >= summary_secs) {
+            print_summary(now_secs() - last_summary, lost - lost_reported);
+            lost_reported = lost;
+            last_summary = now_secs();
+        }
+        if (seen == 0) {
+            struct timespec pause = {0, POLL_NSECS};
+            if (!follow || writer_gone) break;
+            nanosleep(&pause, NULL);
+        }
+    }
+
+    if (summary_secs > 0) {
+        uint64_t lost = 0;
+        for (unsigned t = 0; t < header->max_threads; t++) lost += readers[t].lost;
+        print_summary(now_secs() - last_summary, lost - lost_reported);
+    }
+    if (atomic_load(&((evring_header_t *) header)->lost_threads) > 0) {
+        fprintf(stderr, "mevents: %u threads found no free ring\n",
+                atomic_load(&((evring_header_t *) header)->lost_threads));
+    }
+    return 0;
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "mevents: ");
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr,
+            "Usage: mevents [-hn] [-s <secs>] <file>\n"
+            "Options\n"
+            "\t-h         Print this message.\n"
+            "\t-n         Read the events already there and stop, instead of\n"
+            "\t           following the file.\n"
+            "\t-s <secs>  Print a summary of the calls every <secs> seconds\n"
+            "\t           instead of every event.\n");
+}
@@ -0,0 +1,420 @@
+/*
+ * mheap.c - Inspect heap snapshots offline
+ *
+ * Reads the snapshots written by mm_heap_dump (see mm_dump.h), e.g. by
+ * `mdriver --heap-dump=<dir>` or by a program calling it from a signal
+ * handler or a debugger, and reports for each one:
+ *
+ *   summary    payload, metadata and free bytes, the largest free hole and
+ *              the external fragmentation, plus any inconsistencies: gaps
+ *              or overlaps between blocks, free blocks missing from the
+ *              free list and allocated blocks on it
+ *   holes      the free blocks by power-of-two size
+ *   regions    the share of each fixed-size region of the heap that is
+ *              payload, metadata and free
+ *   map        the heap drawn one character per cell:
+ *                  '#' at least 90% payload, '+' at least half payload,
+ *                  '-' some payload, '.' free, ':' metadata only
+ *
+ *     gcc -O2 mheap.c -o mheap
+ *     ./mheap amptjp.rep.peak.heap
+ *
+ * The snapshot holds no payload data, only the layout, so it can be read
+ * on any machine with the byte order of the one that wrote it.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "include/mm_dump.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define DEFAULT_REGIONS 16  /* regions in the default occupancy report */
+#define MIN_REGION 4096     /* smallest default region size */
+#define DEFAULT_COLUMNS 64  /* characters per line of the map */
+#define MAX_MAP_ROWS 16     /* lines in the map */
+#define HOLE_CLASSES 48     /* power-of-two free hole size classes */
+#define BAR_WIDTH 40        /* characters in the longest histogram bar */
+#define MAP_GRAIN 16        /* map cells are a multiple of this many bytes */
+
+/* How the bytes of a block are used */
+enum { USE_PAYLOAD, USE_META, USE_FREE, NUM_USES };
+
+/* A heap divided into equal cells, each with its bytes by use */
+typedef struct {
+    uint64_t cell_size;
+    size_t num_cells;
+    uint64_t (*bytes)[NUM_USES];
+} cells_t;
+
+/*******************
+ * Global variables
+ ******************/
+
+static uint64_t region_size = 0; /* 0: pick one from the heap size */
+static int map_columns = DEFAULT_COLUMNS;
+
+/*********************
+ * Function prototypes
+ *********************/
+
+static void app_error(const char *fmt, ...) __attribute__((format(printf, 1, 2), noreturn));
+static void usage(void);
+
+/*
+ * read_dump - read the snapshot at path into header and a new array of
+ *     blocks. Returns false, after saying why, if it isn't a snapshot.
+ */
+static bool read_dump(const char *path, mm_dump_header_t *header, mm_dump_block_t **blocks) {
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    if (fread(header, sizeof(*header), 1, fp) != 1) {
+        fprintf(stderr, "%s: too short for a heap snapshot\n", path);
+        fclose(fp);
+        return false;
+    }
+    if (header->magic != MM_DUMP_MAGIC) {
+        fprintf(stderr, "%s: %s\n", path,
+                __builtin_bswap64(header->magic) == MM_DUMP_MAGIC
+                    ? "written on a machine with the other byte order"
+                    : "not a heap snapshot");
+        fclose(fp);
+        return false;
+    }
+    if (header->version != MM_DUMP_VERSION) {
+        fprintf(stderr, "%s: snapshot version %u, expected %u\n", path, header->version,
+                MM_DUMP_VERSION);
+        fclose(fp);
+        return false;
+    }
+
+    *blocks = malloc((header->num_blocks + 1) * sizeof(**blocks));
+    if (*blocks == NULL) app_error("Out of memory reading %s", path);
+    if (fread(*blocks, sizeof(**blocks), header->num_blocks, fp) != header->num_blocks) {
+        fprintf(stderr, "%s: truncated, expected %" PRIu64 " blocks\n", path, header->num_blocks);
+        free(*blocks);
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+    return true;
+}
+
+/*
+ * cells_init - divide a heap of heap_size bytes into cells of cell_size
+ */
+static void cells_init(cells_t *cells, uint64_t heap_size, uint64_t cell_size) {
+    cells->cell_size = (cell_size > 0) ? cell_size : 1;
+    cells->num_cells = (heap_size + cells->cell_size - 1) / cells->cell_size;
+    if (cells->num_cells == 0) cells->num_cells = 1;
+    cells->bytes = calloc(cells->num_cells, sizeof(*cells->bytes));
+    if (cells->bytes == NULL) app_error("Out of memory");
+}
+
+/*
+ * cells_charge - charge the len bytes at offset to use, split over the
+ *     cells they cover
+ */
+static void cells_charge(cells_t *cells, uint64_t offset, uint64_t len, int use) {
+    uint64_t end = offset + len;
+
+    while (offset < end) {
+        size_t cell = offset / cells->cell_size;
+        uint64_t cell_end = (cell + 1) * cells->cell_size;
+        uint64_t n = ((end < cell_end) ? end : cell_end) - offset;
+
+        if (cell >= cells->num_cells) break;
+        cells->bytes[cell][use] += n;
+        offset += n;
+    }
+}
+
+/*
+ * cells_charge_block - charge a block's payload, metadata or free bytes
+ */
+static void cells_charge_block(cells_t *cells, const mm_dump_block_t *b) {
+    uint64_t payload = b->offset + b->payload_delta;
+
+    if (!(b->flags & MM_DUMP_ALLOCATED)) {
+        cells_charge(cells, b->offset, b->size, USE_FREE);
+        return;
+    }
+    cells_charge(cells, b->offset, b->payload_delta, USE_META);
+    cells_charge(cells, payload, b->payload_size, USE_PAYLOAD);
+    if (b->payload_delta + b->payload_size < b->size) {
+        cells_charge(cells, payload + b->payload_size,
+                     b->size - b->payload_delta - b->payload_size, USE_META);
+    }
+}
+
+/* Returns part as a percentage of whole */
+static double percent(uint64_t part, uint64_t whole) {
+    return (whole == 0) ? 0.0 : 100.0 * part / whole;
+}
+
+/* Returns the smallest power of two of at least n */
+static uint64_t pow2_ceil(uint64_t n) {
+    uint64_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+/*
+ * print_summary - totals, external fragmentation and inconsistencies
+ */
+static void print_summary(const mm_dump_header_t *h, const mm_dump_block_t *blocks) {
+    uint64_t alloc_blocks = 0, payload = 0, meta = 0;
+    uint64_t free_blocks = 0, free_bytes = 0, largest = 0;
+    uint64_t gaps = 0, overlaps = 0, unlisted = 0, misplaced = 0, adjacent = 0;
+    uint64_t listed = 0, covered = 0;
+    uint64_t expected = (h->num_blocks > 0) ? blocks[0].offset : 0;
+
+    for (uint64_t i = 0; i < h->num_blocks; i++) {
+        const mm_dump_block_t *b = &blocks[i];
+
+        if (b->offset > expected && i > 0) gaps++;
+        if (b->offset < expected) overlaps++;
+        expected = b->offset + b->size;
+        covered += b->size;
+        if (b->flags & MM_DUMP_LISTED) listed++;
+
+        if (b->flags & MM_DUMP_ALLOCATED) {
+            alloc_blocks++;
+            payload += b->payload_size;
+            meta += b->size - b->payload_size;
+            if (b->flags & MM_DUMP_LISTED) misplaced++;
+        }
+        else {
+            free_blocks++;
+            free_bytes += b->size;
+            if (b->size > largest) largest = b->size;
+            if ((h->flags & MM_DUMP_HAS_FREE_LIST) && !(b->flags & MM_DUMP_LISTED)) unlisted++;
+            if (i > 0 && !(blocks[i - 1].flags & MM_DUMP_ALLOCATED)) adjacent++;
+        }
+    }
+
+    printf("heap       %" PRIu64 " bytes at 0x%" PRIx64 ", %" PRIu64 " blocks\n", h->heap_size,
+           h->heap_lo, h->num_blocks);
+    printf("allocated  %" PRIu64 " blocks, %" PRIu64 " payload bytes (%.1f%% of the heap)\n",
+           alloc_blocks, payload, percent(payload, h->heap_size));
+    printf("metadata   %" PRIu64 " bytes in allocated blocks, %" PRIu64
+           " outside any block (%.1f%%)\n",
+           meta, h->heap_size - covered, percent(meta + h->heap_size - covered, h->heap_size));
+    printf("free       %" PRIu64 " blocks, %" PRIu64 " bytes (%.1f%%), largest %" PRIu64 "\n",
+           free_blocks, free_bytes, percent(free_bytes, h->heap_size), largest);
+    printf("external fragmentation %.1f%% (1 - largest free / free)\n",
+           (free_bytes == 0) ? 0.0 : 100.0 - percent(largest, free_bytes));
+
+    if (gaps > 0) printf("warning: %" PRIu64 " gaps between blocks\n", gaps);
+    if (overlaps > 0) printf("warning: %" PRIu64 " overlapping blocks\n", overlaps);
+    if (adjacent > 0) printf("note: %" PRIu64 " free blocks follow another free block\n", adjacent);
+    if (h->flags & MM_DUMP_HAS_FREE_LIST) {
+        if (unlisted > 0) printf("warning: %" PRIu64 " free blocks not on the free list\n", unlisted);
+        if (misplaced > 0) printf("warning: %" PRIu64 " allocated blocks on the free list\n", misplaced);
+        if (h->num_listed > listed) {
+            printf("warning: %" PRIu64 " free list entries aren't blocks on the heap\n",
+                   h->num_listed - listed);
+        }
+    }
+}
+
+/*
+ * print_holes - the free blocks by power-of-two size
+ */
+static void print_holes(const mm_dump_header_t *h, const mm_dump_block_t *blocks) {
+    uint64_t count[HOLE_CLASSES], bytes[HOLE_CLASSES], free_bytes = 0, max_count = 0;
+    int lo = HOLE_CLASSES, hi = -1;
+
+    memset(count, 0, sizeof(count));
+    memset(bytes, 0, sizeof(bytes));
+    for (uint64_t i = 0; i < h->num_blocks; i++) {
+        const mm_dump_block_t *b = &blocks[i];
+        int k;
+
+        if ((b->flags & MM_DUMP_ALLOCATED) || b->size == 0) continue;
+        k = 63 - __builtin_clzll(b->size);
+        if (k >= HOLE_CLASSES) k = HOLE_CLASSES - 1;
+        count[k]++;
+        bytes[k] += b->size;
+        free_bytes += b->size;
+        if (count[k] > max_count) max_count = count[k];
+        if (k < lo) lo = k;
+        if (k > hi) hi = k;
+    }
+
+    printf("\nFree holes by size:\n");
+    if (hi < 0) {
+        printf("  (none)\n");
+        return;
+    }
+    printf("%12s %12s %10s %12s %7s\n", "from", "to", "holes", "bytes", "bytes%");
+    for (int k = lo; k <= hi; k++) {
+        int bar = (int) ((count[k] * BAR_WIDTH + max_count - 1) / max_count);
+
+        printf("%12" PRIu64 " %12" PRIu64 " %10" PRIu64 " %12" PRIu64 " %6.1f%% ", (uint64_t) 1 << k,
+               ((uint64_t) 2 << k) - 1, count[k], bytes[k], percent(bytes[k], free_bytes));
+        for (int j = 0; j < bar; j++) putchar('#');
+        putchar('\n');
+    }
+}
+
+/*
+ * print_regions - the use of each region of the heap
+ */
+static void print_regions(const mm_dump_header_t *h, const mm_dump_block_t *blocks) {
+    uint64_t size = region_size;
+    cells_t regions;
+
+    if (size == 0) {
+        size = pow2_ceil((h->heap_size + DEFAULT_REGIONS - 1) / DEFAULT_REGIONS);
+        if (size < MIN_REGION) size = MIN_REGION;
+    }
+    cells_init(&regions, h->heap_size, size);
+    for (uint64_t i = 0; i < h->num_blocks; i++) {
+        cells_charge_block(&regions, &blocks[i]);
+    }
+
+    printf("\nOccupancy by %" PRIu64 "-byte region:\n", regions.cell_size);
+    printf("%12s %9s %9s %9s\n", "offset", "payload", "metadata", "free");
+    for (size_t r = 0; r < regions.num_cells; r++) {
+        uint64_t start = r * regions.cell_size;
+        uint64_t len = (start + regions.cell_size < h->heap_size) ? regions.cell_size
+                                                                  : h->heap_size - start;
+        const uint64_t *b = regions.bytes[r];
+
+        printf("%12" PRIu64 " %8.1f%% %8.1f%% %8.1f%%\n", start, percent(b[USE_PAYLOAD], len),
+               percent(b[USE_META] + len - b[USE_PAYLOAD] - b[USE_META] - b[USE_FREE], len),
+               percent(b[USE_FREE], len));
+    }
+    free(regions.bytes);
+}
+
+/*
+ * print_map - draw the heap one character per cell
+ */
+static void print_map(const mm_dump_header_t *h, const mm_dump_block_t *blocks) {
+    uint64_t cells_wanted = (uint64_t) map_columns * MAX_MAP_ROWS;
+    uint64_t size = (h->heap_size + cells_wanted - 1) / cells_wanted;
+    cells_t map;
+
+    size = (size + MAP_GRAIN - 1) / MAP_GRAIN * MAP_GRAIN;
+    cells_init(&map, h->heap_size, size);
+    for (uint64_t i = 0; i < h->num_blocks; i++) {
+        cells_charge_block(&map, &blocks[i]);
+    }
+
+    printf("\nMap, %" PRIu64 " bytes per character ('#' >=90%% payload, '+' >=50%%, "
+           "'-' some, '.' free, ':' metadata):\n",
+           map.cell_size);
+    for (size_t c = 0; c < map.num_cells; c++) {
+        const uint64_t *b = map.bytes[c];
+        uint64_t used = b[USE_PAYLOAD] + b[USE_META] + b[USE_FREE];
+        char ch;
+
+        if (c % map_columns == 0) printf("%12" PRIu64 " ", c * map.cell_size);
+        if (used == 0)
+            ch = ' ';
+        else if (b[USE_PAYLOAD] * 10 >= used * 9)
+            ch = '#';
+        else if (b[USE_PAYLOAD] * 2 >= used)
+            ch = '+';
+        else if (b[USE_PAYLOAD] > 0)
+            ch = '-';
+        else if (b[USE_FREE] > 0)
+            ch = '.';
+        else
+            ch = ':';
+        putchar(ch);
+        if (c % map_columns == (size_t) map_columns - 1 || c == map.num_cells - 1) putchar('\n');
+    }
+    free(map.bytes);
+}
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv) {
+    int c, status = 0;
+
+    while ((c = getopt(argc, argv, "r:w:h")) != EOF) {
+        switch (c) {
+            case 'r': /* Region size */
+                region_size = strtoull(optarg, NULL, 0);
+                if (region_size == 0) app_error("The region size must be positive");
+                break;
+
+            case 'w': /* Map width */
+                map_columns = atoi(optarg);
+                if (map_columns < 1) app_error("The map width must be positive");
+                break;
+
+            case 'h':
+                usage();
+                exit(0);
+
+            default:
+                usage();
+                exit(1);
+        }
+    }
+    if (optind == argc) {
+        usage();
+        exit(1);
+    }
+
+    for (int i = optind; i < argc; i++) {
+        mm_dump_header_t header;
+        mm_dump_block_t *blocks;
+
+        if (!read_dump(argv[i], &header, &blocks)) {
+            status = 1;
+            continue;
+        }
+        if (argc - optind > 1) printf("%s%s:\n", (i > optind) ? "\n" : "", argv[i]);
+        print_summary(&header, blocks);
+        print_holes(&header, blocks);
+        print_regions(&header, blocks);
+        print_map(&header, blocks);
+        free(blocks);
+    }
+    return status;
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr,
+            "Usage: mheap [-h] [-r <bytes>] [-w <columns>] <snapshot>...\n"
+            "Options\n"
+            "\t-h             Print this message.\n"
+            "\t-r <bytes>     Report occupancy in regions of <bytes> (default: the\n"
+            "\t               heap in about %d regions).\n"
+            "\t-w <columns>   Draw the map <columns> characters wide (default %d).\n",
+            DEFAULT_REGIONS, DEFAULT_COLUMNS);
+}
@@ -0,0 +1,444 @@
+/*
+ * msizes.c - Tune size classes to the requests in mdriver traces
+ *
+ * Reads one or more trace files and picks the size classes that waste the
+ * fewest bytes on the requests in them, for a segregated-fit or slab
+ * allocator with at most -k classes. Every request of up to -m bytes is
+ * served from the smallest class that holds it, so each one wastes the
+ * difference between its class and its size; requests above -m are left
+ * to the allocator's large-block path and don't count. Classes are
+ * multiples of ALIGNMENT, and the best ones are found exactly, by dynamic
+ * programming over the distinct request sizes rounded up to ALIGNMENT.
+ *
+ * msizes prints the classes with the requests and the waste of each,
+ * against power-of-two classes up to the same size for comparison. With
+ * -o <file> it also writes them as a header, with a table that maps a
+ * request size to its class in one load:
+ *
+ *     gcc -O2 msizes.c -o msizes
+ *     ./msizes -k 24 -o mm_size_classes.h amptjp.rep cccp.rep
+ *
+ * With -n, every trace carries the same weight however many requests it
+ * makes.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define ALIGNMENT 16         /* classes are multiples of this */
+#define DEFAULT_CLASSES 32   /* most classes to pick */
+#define DEFAULT_MAX 4096     /* largest request served from a class */
+#define MAX_CLASSES 255      /* the lookup table holds class numbers in a byte */
+#define MAX_SIZE (1 << 20)   /* largest -m */
+#define TABLE_COLUMNS 16     /* entries per line of the generated tables */
+
+/*******************
+ * Global variables
+ ******************/
+
+static int max_classes = DEFAULT_CLASSES;
+static size_t max_size = DEFAULT_MAX;
+static bool per_trace = false; /* weigh every trace the same */
+
+/* Requests by size in ALIGNMENT units: weight[u] is the weight of the
+   requests of (u - 1) * ALIGNMENT + 1 to u * ALIGNMENT bytes, and bytes[u]
+   their total size, weighted likewise */
+static double *weight;
+static double *bytes;
+static double large_requests; /* above max_size, weighted likewise */
+
+/*********************
+ * Function prototypes
+ *********************/
+
+static void app_error(const char *fmt, ...) __attribute__((format(printf, 1, 2), noreturn));
+static void usage(void);
+
+/*
+ * read_trace - add the requests of the trace at path to the histogram.
+ *     Returns false, after saying why, if it can't be read.
+ */
+static bool read_trace(const char *path) {
+    FILE *fp = fopen(path, "r");
+    double *w, *b;
+    unsigned index, arg, size;
+    double count = 0;
+    char type[32];
+    int header[4];
+    size_t u;
+
+    if (fp == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (fscanf(fp, "%d", &header[i]) != 1) {
+            fprintf(stderr, "%s: not a trace file\n", path);
+            fclose(fp);
+            return false;
+        }
+    }
+
+    /* Collect this trace's requests apart, so that -n can scale them */
+    w = calloc(max_size / ALIGNMENT + 1, sizeof(*w));
+    b = calloc(max_size / ALIGNMENT + 1, sizeof(*b));
+    if (w == NULL || b == NULL) app_error("Out of memory");
+
+    while (fscanf(fp, "%31s", type) == 1) {
+        uint64_t request;
+
+        switch (type[0]) {
+            case 'a': /* malloc */
+            case 'r': /* realloc */
+                if (fscanf(fp, "%u %u", &index, &size) != 2) goto bad;
+                request = size;
+                break;
+            case 'c': /* calloc */
+                if (fscanf(fp, "%u %u %u", &index, &arg, &size) != 3) goto bad;
+                request = (uint64_t) arg * size;
+                break;
+            case 'm': /* memalign */
+                if (fscanf(fp, "%u %u %u", &index, &arg, &size) != 3) goto bad;
+                request = size;
+                break;
+            case 'f': /* free */
+            case 'u': /* usable_size */
+                if (fscanf(fp, "%u", &index) != 1) goto bad;
+                continue;
+            case 's': /* free_sized */
+                if (fscanf(fp, "%u %u", &index, &size) != 2) goto bad;
+                continue;
+            default:
+                goto bad;
+        }
+        if (request == 0) continue;
+        count++;
+        if (request > max_size) {
+            w[0]++;
+            continue;
+        }
+        u = (request + ALIGNMENT - 1) / ALIGNMENT;
+        w[u]++;
+        b[u] += request;
+    }
+    fclose(fp);
+
+    /* Requests are never 0 bytes, so w[0] counted the large ones */
+    for (u = 0; u <= max_size / ALIGNMENT && count > 0; u++) {
+        double scale = per_trace ? 1 / count : 1;
+        if (u == 0)
+            large_requests += w[0] * scale;
+        else
+            weight[u] += w[u] * scale;
+        bytes[u] += b[u] * scale;
+    }
+    free(w);
+    free(b);
+    return true;
+
+bad:
+    fprintf(stderr, "%s: bad request \"%s\"\n", path, type);
+    fclose(fp);
+    free(w);
+    free(b);
+    return false;
+}
+
+/*
+ * pick_classes - choose at most max_classes classes that minimize the
+ *     bytes wasted on the requests, and store them in class_units (in
+ *     ALIGNMENT units, ascending). Returns how many there are.
+ *
+ *     Only sizes that some request rounds up to need be considered, and
+ *     the largest of them must be a class. With W and B the prefix sums of
+ *     weight and bytes over those sizes, the requests between classes i
+ *     and j (i < j) waste unit_j * ALIGNMENT * (W[j] - W[i]) - (B[j] - B[i]),
+ *     so the best k classes up to size j are found from the best k - 1 up
+ *     to each smaller size in O(k n^2) for n sizes.
+ */
+static int pick_classes(size_t *class_units) {
+    size_t *units, n = 0, i, j;
+    double *W, *B, *best, *prev;
+    size_t *from;
+    int k, num;
+
+    units = malloc((max_size / ALIGNMENT + 1) * sizeof(*units));
+    if (units == NULL) app_error("Out of memory");
+    for (size_t u = 1; u <= max_size / ALIGNMENT; u++) {
+        if (weight[u] > 0) units[n++] = u;
+    }
+    if (n == 0) {
+        free(units);
+        return 0;
+    }
+    num = (n < (size_t) max_classes) ? (int) n : max_classes;
+
+    /* Prefix sums, with W[0] = B[0] = 0 standing for "no smaller class" */
+    W = calloc(n + 1, sizeof(*W));
+    B = calloc(n + 1, sizeof(*B));
+    best = malloc((n + 1) * sizeof(*best));
+    prev = malloc((n + 1) * sizeof(*prev));
+    from = malloc((size_t) num * (n + 1) * sizeof(*from));
+    if (W == NULL || B == NULL || best == NULL || prev == NULL || from == NULL)
+        app_error("Out of memory");
+    for (i = 0; i < n; i++) {
+        W[i + 1] = W[i] + weight[units[i]];
+        B[i + 1] = B[i] + bytes[units[i]];
+    }
+
+    /* best[j]: the least waste on the requests up to units[j - 1] with k
+       classes, the largest being units[j - 1]; from[k][j] the class before */
+    for (j = 1; j <= n; j++) {
+        best[j] = (double) units[j - 1] * ALIGNMENT * W[j] - B[j];
+        from[j] = 0;
+    }
+    for (k = 1; k < num; k++) {
+        memcpy(prev, best, (n + 1) * sizeof(*best));
+        for (j = 1; j <= n; j++) {
+            double size = (double) units[j - 1] * ALIGNMENT;
+            size_t arg = from[(size_t) (k - 1) * (n + 1) + j];
+            double least = prev[j];
+            for (i = k; i < j; i++) {
+                double waste = prev[i] + size * (W[j] - W[i]) - (B[j] - B[i]);
+                if (waste < least) {
+                    least = waste;
+                    arg = i;
+                }
+            }
+            best[j] = least;
+            from[(size_t) k * (n + 1) + j] = arg;
+        }
+    }
+
+    /* Walk back from the largest size */
+    int count = 0;
+    size_t *picked = malloc(num * sizeof(*picked));
+    if (picked == NULL) app_error("Out of memory");
+    for (k = num - 1, j = n; j > 0 && k >= 0; k--) {
+        picked[count++] = units[j - 1];
+        j = from[(size_t) k * (n + 1) + j];
+    }
+    for (i = 0; i < (size_t) count; i++) class_units[i] = picked[count - 1 - i];
+
+    free(picked);
+    free(units);
+    free(W);
+    free(B);
+    free(best);
+    free(prev);
+    free(from);
+    return count;
+}
+
+/*
+ * waste_of - the weighted bytes wasted by classes, and the weighted bytes
+ *     requested, over every request that fits the largest class
+ */
+static void waste_of(const size_t *class_units, int num, double *wasted, double *requested) {
+    int c = 0;
+
+    *wasted = *requested = 0;
+    for (size_t u = 1; u <= max_size / ALIGNMENT; u++) {
+        while (c < num && class_units[c] < u) c++;
+        if (c == num) break;
+        *wasted += (double) class_units[c] * ALIGNMENT * weight[u] - bytes[u];
+        *requested += bytes[u];
+    }
+}
+
+/*
+ * print_classes - print each class with the requests it serves and what
+ *     they waste, then the totals against power-of-two classes
+ */
+static void print_classes(const size_t *class_units, int num) {
+    size_t pow2[64];
+    int num_pow2 = 0, c;
+    double wasted, requested, pow2_wasted, pow2_requested, served = 0;
+    size_t u = 1;
+
+    for (u = 1; u <= class_units[num - 1]; u++) served += weight[u];
+    printf("%7s%10s%10s%9s\n", "class", "size", "requests", "waste");
+    u = 1;
+    for (c = 0; c < num; c++) {
+        double w = 0, b = 0;
+        for (; u <= class_units[c]; u++) {
+            w += weight[u];
+            b += bytes[u];
+        }
+        printf("%7d%10zu%9.1f%%%8.1f%%\n", c, class_units[c] * ALIGNMENT, 100.0 * w / served,
+               (b == 0) ? 0.0 : 100.0 * ((double) class_units[c] * ALIGNMENT * w - b) / b);
+    }
+
+    for (size_t size = ALIGNMENT; size < class_units[num - 1] * ALIGNMENT; size *= 2) {
+        pow2[num_pow2++] = size / ALIGNMENT;
+    }
+    pow2[num_pow2++] = class_units[num - 1];
+    waste_of(class_units, num, &wasted, &requested);
+    waste_of(pow2, num_pow2, &pow2_wasted, &pow2_requested);
+
+    printf("\n%.1f%% of the requests are served from %d classes, the rest are larger than "
+           "%zu bytes\n",
+           100.0 * served / (served + large_requests), num, max_size);
+    printf("internal fragmentation: %.2f%% of the bytes requested (%d power-of-two "
+           "classes: %.2f%%)\n",
+           100.0 * wasted / requested, num_pow2, 100.0 * pow2_wasted / pow2_requested);
+}
+
+/*
+ * write_header - write the classes, and a table from a request size in
+ *     ALIGNMENT units to its class, as a C header
+ */
+static void write_header(const char *path, const size_t *class_units, int num, int argc,
+                         char **argv) {
+    size_t max_units = class_units[num - 1];
+    FILE *fp = fopen(path, "w");
+    int c = 0;
+
+    if (fp == NULL) app_error("%s: %s", path, strerror(errno));
+    fprintf(fp, "#ifndef MM_SIZE_CLASSES_H\n#define MM_SIZE_CLASSES_H\n\n");
+    fprintf(fp, "/*\n * Generated by msizes -k %d -m %zu%s from:\n", max_classes, max_size,
+            per_trace ? " -n" : "");
+    for (int i = 0; i < argc; i++) fprintf(fp, " *     %s\n", argv[i]);
+    fprintf(fp,
+            " * Don't edit it; run msizes again. A request of up to MM_SIZE_CLASS_MAX\n"
+            " * bytes is served from class mm_size_class(size), of mm_size_classes[]\n"
+            " * bytes.\n */\n\n");
+    fprintf(fp, "#include <stddef.h>\n#include <stdint.h>\n\n");
+    fprintf(fp, "#define MM_NUM_SIZE_CLASSES %d\n", num);
+    fprintf(fp, "#define MM_SIZE_CLASS_MAX %zu\n", max_units * ALIGNMENT);
+    fprintf(fp, "#define MM_SIZE_CLASS_GRAIN %d\n\n", ALIGNMENT);
+
+    fprintf(fp, "static const uint32_t mm_size_classes[MM_NUM_SIZE_CLASSES] = {");
+    for (c = 0; c < num; c++) {
+        fprintf(fp, "%s%zu", (c % TABLE_COLUMNS == 0) ? "\n    " : " ",
+                class_units[c] * ALIGNMENT);
+        if (c < num - 1) fputc(',', fp);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "/* The class of sizes from (i - 1) * MM_SIZE_CLASS_GRAIN + 1 to\n"
+                "   i * MM_SIZE_CLASS_GRAIN bytes */\n");
+    fprintf(fp, "static const uint8_t mm_size_class_table[MM_SIZE_CLASS_MAX / "
+                "MM_SIZE_CLASS_GRAIN + 1] = {");
+    c = 0;
+    for (size_t u = 0; u <= max_units; u++) {
+        while (class_units[c] < u) c++;
+        fprintf(fp, "%s%d", (u % TABLE_COLUMNS == 0) ? "\n    " : " ", c);
+        if (u < max_units) fputc(',', fp);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "/** Returns the class of a request of `size` bytes, or -1 if it's larger "
+                "than\n    every class */\n");
+    fprintf(fp, "static inline int mm_size_class(size_t size) {\n"
+                "    if (size > MM_SIZE_CLASS_MAX) {\n"
+                "        return -1;\n"
+                "    }\n"
+                "    return mm_size_class_table[(size + MM_SIZE_CLASS_GRAIN - 1) / "
+                "MM_SIZE_CLASS_GRAIN];\n"
+                "}\n\n");
+    fprintf(fp, "#endif /* MM_SIZE_CLASSES_H */\n");
+    if (fclose(fp) != 0) app_error("%s: %s", path, strerror(errno));
+}
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv) {
+    const char *header_path = NULL;
+    size_t class_units[MAX_CLASSES];
+    int c, num, status = 0;
+
+    while ((c = getopt(argc, argv, "k:m:no:h")) != EOF) {
+        switch (c) {
+            case 'k': /* Most classes */
+                max_classes = atoi(optarg);
+                if (max_classes < 1 || max_classes > MAX_CLASSES)
+                    app_error("The number of classes must be from 1 to %d", MAX_CLASSES);
+                break;
+
+            case 'm': /* Largest request served from a class */
+                max_size = strtoul(optarg, NULL, 0);
+                if (max_size < ALIGNMENT || max_size > MAX_SIZE)
+                    app_error("The largest class must be from %d to %d bytes", ALIGNMENT,
+                              MAX_SIZE);
+                break;
+
+            case 'n': /* Weigh the traces the same */
+                per_trace = true;
+                break;
+
+            case 'o': /* Write a header */
+                header_path = optarg;
+                break;
+
+            case 'h':
+                usage();
+                exit(0);
+
+            default:
+                usage();
+                exit(1);
+        }
+    }
+    if (optind == argc) {
+        usage();
+        exit(1);
+    }
+
+    weight = calloc(max_size / ALIGNMENT + 1, sizeof(*weight));
+    bytes = calloc(max_size / ALIGNMENT + 1, sizeof(*bytes));
+    if (weight == NULL || bytes == NULL) app_error("Out of memory");
+    for (int i = optind; i < argc; i++) {
+        if (!read_trace(argv[i])) status = 1;
+    }
+
+    if ((num = pick_classes(class_units)) == 0) app_error("No requests of up to %zu bytes",
+                                                          max_size);
+    print_classes(class_units, num);
+    if (header_path != NULL) {
+        write_header(header_path, class_units, num, argc - optind, argv + optind);
+        printf("wrote %s\n", header_path);
+    }
+    return status;
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "msizes: ");
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr,
+            "Usage: msizes [-hn] [-k <classes>] [-m <bytes>] [-o <header>] <trace>...\n"
+            "Options\n"
+            "\t-h             Print this message.\n"
+            "\t-k <classes>   Pick at most <classes> size classes (default %d).\n"
+            "\t-m <bytes>     Serve requests of up to <bytes> from the classes\n"
+            "\t               (default %d); larger ones don't count.\n"
+            "\t-n             Weigh every trace the same, however many requests\n"
+            "\t               it makes.\n"
+            "\t-o <header>    Write the classes and a lookup table to <header>.\n",
+            DEFAULT_CLASSES, DEFAULT_MAX);
+}
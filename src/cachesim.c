@@ -0,0 +1,251 @@
+/*
+ * cachesim.c - a set-associative cache and TLB simulator for judging the
+ *     locality of allocator placement decisions without the noise of the
+ *     machine the drivers run on.
+ *
+ * Every access goes through L1, then L2, then the last-level cache, each
+ * with LRU replacement and filled on a miss, and every cache line touched
+ * is looked up in the TLB. Accesses are charged to the class set with
+ * cachesim_set_class, e.g. the kind of request being served.
+ *
+ * Allocators feed it every load and store they make when they are compiled
+ * with GCC's kernel-address instrumentation, which calls a hook before each
+ * memory access without needing a sanitizer runtime:
+ *
+ *   gcc -fsanitize=kernel-address --param asan-instrumentation-with-call-threshold=0 \
+ *       --param asan-stack=0 --param asan-globals=0 -include include/cachesim_hooks.h ...
+ *
+ * The hooks are defined below, and cachesim_hooks.h sends the memcpy and
+ * memset calls the instrumentation doesn't see through here as well.
+ */
+#include "cachesim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* A cache line or TLB entry */
+typedef struct {
+    uint64_t tag;   /* line or page number; UINT64_MAX if empty */
+    uint64_t stamp; /* time of the last use, for LRU */
+} way_t;
+
+/* A set-associative cache of tags, used both for the caches and the TLB */
+typedef struct {
+    way_t *ways;
+    unsigned num_ways;
+    uint64_t set_mask;
+} cache_t;
+
+/* Public (see cachesim.h) */
+bool cachesim_on = false;
+const cachesim_config_t cachesim_default_config = {
+    .line = 64,
+    .page = 4096,
+    .size = {32 << 10, 1 << 20, 16 << 20},
+    .ways = {8, 16, 16},
+    .tlb_entries = 64,
+    .tlb_ways = 4,
+};
+
+/* private variables */
+static cachesim_config_t config;
+static cache_t caches[CACHESIM_LEVELS];
+static cache_t tlb;
+static int line_shift, page_shift;
+static uint64_t clock_stamp;
+static int current_class;
+static cachesim_counts_t counts[CACHESIM_CLASSES];
+
+static bool is_pow2(uint64_t x) {
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+static int log2_of(uint64_t x) {
+    return 63 - __builtin_clzll(x);
+}
+
+/*
+ * cache_init - set up a cache of `entries` entries in sets of `num_ways`.
+ *     Returns false if the geometry isn't a power of two.
+ */
+static bool cache_init(cache_t *cache, uint64_t entries, unsigned num_ways) {
+    if (num_ways == 0 || entries % num_ways != 0 || !is_pow2(entries / num_ways)) {
+        return false;
+    }
+    cache->num_ways = num_ways;
+    cache->set_mask = entries / num_ways - 1;
+    cache->ways = malloc(entries * sizeof(way_t));
+    return cache->ways != NULL;
+}
+
+static void cache_clear(cache_t *cache) {
+    uint64_t n = (cache->set_mask + 1) * cache->num_ways;
+    for (uint64_t i = 0; i < n; i++) {
+        cache->ways[i].tag = UINT64_MAX;
+        cache->ways[i].stamp = 0;
+    }
+}
+
+/*
+ * cache_lookup - look tag up in its set, filling it in on a miss over the
+ *     least recently used way. Returns true on a hit.
+ */
+static bool cache_lookup(cache_t *cache, uint64_t tag) {
+    way_t *set = &cache->ways[(tag & cache->set_mask) * cache->num_ways];
+    way_t *victim = set;
+
+    for (unsigned w = 0; w < cache->num_ways; w++) {
+        if (set[w].tag == tag) {
+            set[w].stamp = ++clock_stamp;
+            return true;
+        }
+        if (set[w].stamp < victim->stamp) victim = &set[w];
+    }
+    victim->tag = tag;
+    victim->stamp = ++clock_stamp;
+    return false;
+}
+
+/*
+ * cachesim_init - set up the caches and TLB. Returns false if the geometry
+ *     is impossible.
+ */
+bool cachesim_init(const cachesim_config_t *cfg) {
+    cachesim_deinit();
+    config = *cfg;
+    if (!is_pow2(config.line) || !is_pow2(config.page) || config.page < config.line) {
+        return false;
+    }
+    line_shift = log2_of(config.line);
+    page_shift = log2_of(config.page);
+    for (int l = 0; l < CACHESIM_LEVELS; l++) {
+        if (config.size[l] % config.line != 0 ||
+            !cache_init(&caches[l], config.size[l] / config.line, config.ways[l])) {
+            cachesim_deinit();
+            return false;
+        }
+    }
+    if (!cache_init(&tlb, config.tlb_entries, config.tlb_ways)) {
+        cachesim_deinit();
+        return false;
+    }
+    cachesim_reset();
+    return true;
+}
+
+void cachesim_deinit(void) {
+    for (int l = 0; l < CACHESIM_LEVELS; l++) {
+        free(caches[l].ways);
+        caches[l].ways = NULL;
+    }
+    free(tlb.ways);
+    tlb.ways = NULL;
+    cachesim_on = false;
+}
+
+/*
+ * cachesim_reset - empty the caches and TLB and zero the counts, e.g. at
+ *     the start of a trace
+ */
+void cachesim_reset(void) {
+    for (int l = 0; l < CACHESIM_LEVELS; l++) {
+        cache_clear(&caches[l]);
+    }
+    cache_clear(&tlb);
+    clock_stamp = 0;
+    current_class = 0;
+    memset(counts, 0, sizeof(counts));
+}
+
+/*
+ * cachesim_set_class - charge the accesses that follow to class cls
+ */
+void cachesim_set_class(int cls) {
+    current_class = (cls >= 0 && cls < CACHESIM_CLASSES) ? cls : 0;
+}
+
+/*
+ * cachesim_access - simulate an access to the size bytes at addr
+ */
+void cachesim_access(const void *addr, size_t size) {
+    uint64_t first = (uintptr_t) addr >> line_shift;
+    uint64_t last = ((uintptr_t) addr + (size ? size - 1 : 0)) >> line_shift;
+    cachesim_counts_t *c = &counts[current_class];
+
+    if (caches[0].ways == NULL) {
+        return;
+    }
+    for (uint64_t line = first; line <= last; line++) {
+        c->accesses++;
+        if (!cache_lookup(&tlb, line >> (page_shift - line_shift))) {
+            c->tlb_misses++;
+        }
+        for (int l = 0; l < CACHESIM_LEVELS; l++) {
+            if (cache_lookup(&caches[l], line)) {
+                break;
+            }
+            c->misses[l]++;
+        }
+    }
+}
+
+void cachesim_get_counts(int cls, cachesim_counts_t *out) {
+    *out = counts[(cls >= 0 && cls < CACHESIM_CLASSES) ? cls : 0];
+}
+
+/*
+ * Stand-ins for memcpy, memmove and memset in instrumented code (see
+ * cachesim_hooks.h)
+ */
+void *cachesim_memcpy(void *dst, const void *src, size_t n) {
+    if (cachesim_on && n > 0) {
+        cachesim_access(src, n);
+        cachesim_access(dst, n);
+    }
+    return memcpy(dst, src, n);
+}
+
+void *cachesim_memmove(void *dst, const void *src, size_t n) {
+    if (cachesim_on && n > 0) {
+        cachesim_access(src, n);
+        cachesim_access(dst, n);
+    }
+    return memmove(dst, src, n);
+}
+
+void *cachesim_memset(void *dst, int c, size_t n) {
+    if (cachesim_on && n > 0) {
+        cachesim_access(dst, n);
+    }
+    return memset(dst, c, n);
+}
+
+/*
+ * The hooks called by -fsanitize=kernel-address instrumentation. A program
+ * built with the real AddressSanitizer gets them from its runtime instead.
+ */
+#ifndef __SANITIZE_ADDRESS__
+#define CACHESIM_HOOK(size)                                                              \
+    void __asan_load##size##_noabort(unsigned long addr) {                               \
+        if (cachesim_on) cachesim_access((const void *) addr, size);                     \
+    }                                                                                    \
+    void __asan_store##size##_noabort(unsigned long addr) {                              \
+        if (cachesim_on) cachesim_access((const void *) addr, size);                     \
+    }
+CACHESIM_HOOK(1)
+CACHESIM_HOOK(2)
+CACHESIM_HOOK(4)
+CACHESIM_HOOK(8)
+CACHESIM_HOOK(16)
+
+void __asan_loadN_noabort(unsigned long addr, size_t size) {
+    if (cachesim_on) cachesim_access((const void *) addr, size);
+}
+
+void __asan_storeN_noabort(unsigned long addr, size_t size) {
+    if (cachesim_on) cachesim_access((const void *) addr, size);
+}
+
+void __asan_handle_no_return(void) {
+}
+#endif
@@ -0,0 +1,179 @@
+/*
+ * evring.c - the per-thread shared-memory event rings behind MM_EVENT (see
+ *     evring.h).
+ *
+ * Each ring has a single writer, its thread, which works like a seqlock:
+ * it stores reserved = head + 1, fences, fills in the slot of event
+ * `head`, and then publishes it by storing head + 1 with release order. A
+ * reader loads head with acquire order, copies the events it hasn't seen,
+ * fences and loads reserved: any event before reserved - num_slots may
+ * have been overwritten while it was copied and is thrown away. So the
+ * writer never waits, and the reader never keeps a torn event.
+ */
+#define _GNU_SOURCE
+#include "evring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Public (see evring.h) */
+bool evring_on = false;
+
+/* private variables */
+static evring_header_t *header = NULL;
+static size_t mapped_size;
+static unsigned generation; /* bumped whenever the rings change hands */
+
+static __thread evring_thread_t *my_ring __attribute__((tls_model("initial-exec")));
+static __thread unsigned my_generation __attribute__((tls_model("initial-exec")));
+
+/*
+ * measure_tick_rate - the rate of evring_ticks against CLOCK_MONOTONIC,
+ *     over about 10ms
+ */
+static double measure_tick_rate(void) {
+    struct timespec t0, t1, pause = {0, 10 * 1000 * 1000};
+    uint64_t ticks0, ticks1;
+    double secs;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    ticks0 = evring_ticks();
+    nanosleep(&pause, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ticks1 = evring_ticks();
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    return (ticks1 - ticks0) / secs;
+}
+
+/*
+ * forget_ring - a child after fork must not write to its parent's ring,
+ *     so every thread claims a new one after a fork
+ */
+static void forget_ring(void) {
+    generation++;
+}
+
+static void register_atfork(void) {
+    pthread_atfork(NULL, NULL, forget_ring);
+}
+
+/*
+ * evring_open - create the event file at path, with rings of num_slots
+ *     events (rounded up to a power of two) for up to max_threads threads,
+ *     and start recording. Returns false, with errno set, on failure.
+ */
+bool evring_open(const char *path, unsigned max_threads, size_t num_slots) {
+    static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+    size_t slots = 1, offset, ring_size;
+    void *base;
+    int fd;
+
+    evring_close();
+    while (slots < num_slots) slots <<= 1;
+    if (max_threads == 0) max_threads = 1;
+    offset = (sizeof(evring_header_t) + 63) / 64 * 64;
+    ring_size = sizeof(evring_thread_t) + slots * sizeof(evring_event_t);
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+        return false;
+    }
+    mapped_size = offset + max_threads * ring_size;
+    if (ftruncate(fd, mapped_size) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return false;
+    }
+    base = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    header = base;
+    header->version = EVRING_VERSION;
+    header->event_size = sizeof(evring_event_t);
+    header->max_threads = max_threads;
+    header->num_slots = slots;
+    header->ticks_per_sec = measure_tick_rate();
+    header->start_ticks = evring_ticks();
+    header->pid = getpid();
+    atomic_init(&header->num_threads, 0);
+    atomic_init(&header->lost_threads, 0);
+    // Readers check the magic number last
+    atomic_thread_fence(memory_order_release);
+    header->magic = EVRING_MAGIC;
+
+    pthread_once(&atfork_once, register_atfork);
+    generation++;
+    evring_on = true;
+    return true;
+}
+
+/*
+ * evring_close - stop recording and unmap the file, which stays behind for
+ *     readers
+ */
+void evring_close(void) {
+    evring_on = false;
+    if (header != NULL) {
+        munmap(header, mapped_size);
+        header = NULL;
+    }
+}
+
+/*
+ * claim_ring - give the calling thread a ring of its own, or NULL if
+ *     they have all been claimed
+ */
+static evring_thread_t *claim_ring(void) {
+    unsigned t = atomic_fetch_add(&header->num_threads, 1);
+    evring_thread_t *ring;
+
+    my_generation = generation;
+    if (t >= header->max_threads) {
+        atomic_fetch_add(&header->lost_threads, 1);
+        return my_ring = NULL;
+    }
+    ring = evring_thread(header, t);
+    ring->tid = (uint32_t) syscall(SYS_gettid);
+    ring->pid = (uint32_t) getpid();
+    return my_ring = ring;
+}
+
+/*
+ * evring_record - append an event for a call that started at `start` to
+ *     the calling thread's ring
+ */
+void evring_record(int op, size_t size, const void *addr, uint64_t start) {
+    uint64_t now = evring_ticks();
+    evring_thread_t *ring = my_ring;
+    evring_event_t *event;
+    uint64_t head;
+
+    if (my_generation != generation) {
+        ring = claim_ring();
+    }
+    if (ring == NULL || header == NULL) {
+        return;
+    }
+    // A call that started before recording did is timed from now
+    if (start == 0) {
+        start = now;
+    }
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->reserved, head + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    event = &evring_events(ring)[head & (header->num_slots - 1)];
+    event->ticks = start;
+    event->addr = (uintptr_t) addr;
+    event->size = size;
+    event->cycles = (now - start > UINT32_MAX) ? UINT32_MAX : (uint32_t) (now - start);
+    event->op = op;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
@@ -0,0 +1,318 @@
+/*
+ * json.c - a minimal JSON reader and writing helpers for the drivers.
+ *          It reads back the result files that the drivers write, e.g.
+ *          for comparing a run against a stored baseline, so it favours
+ *          simplicity over speed.
+ */
+#include "json.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The state of a parse in progress */
+typedef struct {
+    const char *text;
+    const char *pos;
+    char *err;
+    size_t errlen;
+    bool failed;
+} parser_t;
+
+static bool parse_value(parser_t *p, json_value_t *value);
+static void free_members(json_value_t *value);
+
+/*
+ * parse_error - record the first error of a parse, with its byte offset
+ */
+static bool parse_error(parser_t *p, const char *fmt, ...) {
+    if (!p->failed) {
+        va_list ap;
+        int n = snprintf(p->err, p->errlen, "offset %ld: ", (long) (p->pos - p->text));
+        va_start(ap, fmt);
+        if (n >= 0 && (size_t) n < p->errlen) {
+            vsnprintf(p->err + n, p->errlen - n, fmt, ap);
+        }
+        va_end(ap);
+        p->failed = true;
+    }
+    return false;
+}
+
+static void skip_space(parser_t *p) {
+    while (isspace((unsigned char) *p->pos)) {
+        p->pos++;
+    }
+}
+
+/*
+ * parse_string - parse a string literal. Escapes other than \uXXXX are
+ *     decoded; \uXXXX is kept only for ASCII code points.
+ */
+static bool parse_string(parser_t *p, char **out) {
+    const char *start = ++p->pos; /* skip the opening quote */
+    char *s = malloc(strlen(start) + 1);
+    size_t len = 0;
+
+    if (s == NULL) return parse_error(p, "out of memory");
+    while (*p->pos != '"') {
+        char c = *p->pos++;
+        if (c == '\0') {
+            free(s);
+            return parse_error(p, "unterminated string");
+        }
+        if (c == '\\') {
+            c = *p->pos++;
+            switch (c) {
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u': {
+                    unsigned code = 0;
+                    for (int i = 0; i < 4; i++) {
+                        char h = p->pos[i];
+                        if (!isxdigit((unsigned char) h)) {
+                            free(s);
+                            return parse_error(p, "bad \\u escape");
+                        }
+                        code = code * 16 + (isdigit((unsigned char) h) ? h - '0'
+                                                                        : (h | 0x20) - 'a' + 10);
+                    }
+                    p->pos += 4;
+                    c = code < 0x80 ? (char) code : '?';
+                    break;
+                }
+                case '"':
+                case '\\':
+                case '/':
+                    break;
+                default:
+                    free(s);
+                    return parse_error(p, "bad escape \\%c", c);
+            }
+        }
+        s[len++] = c;
+    }
+    p->pos++; /* skip the closing quote */
+    s[len] = '\0';
+    *out = s;
+    return true;
+}
+
+/*
+ * parse_members - parse the elements of an array or the members of an
+ *     object, up to and including the closing bracket
+ */
+static bool parse_members(parser_t *p, json_value_t *value, char close) {
+    size_t capacity = 0;
+
+    p->pos++; /* skip the opening bracket */
+    skip_space(p);
+    if (*p->pos == close) {
+        p->pos++;
+        return true;
+    }
+
+    while (true) {
+        json_value_t member;
+        char *name = NULL;
+
+        skip_space(p);
+        if (close == '}') {
+            if (*p->pos != '"') return parse_error(p, "expected member name");
+            if (!parse_string(p, &name)) return false;
+            skip_space(p);
+            if (*p->pos++ != ':') {
+                free(name);
+                return parse_error(p, "expected ':'");
+            }
+        }
+        if (!parse_value(p, &member)) {
+            free_members(&member);
+            free(name);
+            return false;
+        }
+        member.name = name;
+
+        if (value->num_members == capacity) {
+            capacity = capacity == 0 ? 8 : 2 * capacity;
+            json_value_t *grown = realloc(value->members, capacity * sizeof(json_value_t));
+            if (grown == NULL) return parse_error(p, "out of memory");
+            value->members = grown;
+        }
+        value->members[value->num_members++] = member;
+
+        skip_space(p);
+        if (*p->pos == ',') {
+            p->pos++;
+        }
+        else if (*p->pos == close) {
+            p->pos++;
+            return true;
+        }
+        else {
+            return parse_error(p, "expected ',' or '%c'", close);
+        }
+    }
+}
+
+static bool parse_value(parser_t *p, json_value_t *value) {
+    memset(value, 0, sizeof(*value));
+    skip_space(p);
+    switch (*p->pos) {
+        case '{':
+            value->type = JSON_OBJECT;
+            return parse_members(p, value, '}');
+        case '[':
+            value->type = JSON_ARRAY;
+            return parse_members(p, value, ']');
+        case '"':
+            value->type = JSON_STRING;
+            return parse_string(p, &value->string);
+        case 't':
+        case 'f':
+        case 'n':
+            if (strncmp(p->pos, "true", 4) == 0) {
+                value->type = JSON_BOOL;
+                value->boolean = true;
+                p->pos += 4;
+            }
+            else if (strncmp(p->pos, "false", 5) == 0) {
+                value->type = JSON_BOOL;
+                p->pos += 5;
+            }
+            else if (strncmp(p->pos, "null", 4) == 0) {
+                value->type = JSON_NULL;
+                p->pos += 4;
+            }
+            else {
+                return parse_error(p, "unexpected literal");
+            }
+            return true;
+        default: {
+            char *end;
+            value->type = JSON_NUMBER;
+            value->number = strtod(p->pos, &end);
+            if (end == p->pos) return parse_error(p, "unexpected character");
+            p->pos = end;
+            return true;
+        }
+    }
+}
+
+/*
+ * json_parse_file - read and parse a JSON file. Returns NULL and fills in
+ *     err if the file cannot be read or is not valid JSON.
+ */
+json_value_t *json_parse_file(const char *path, char *err, size_t errlen) {
+    FILE *fp;
+    long size;
+    char *text;
+    json_value_t *value;
+    parser_t p;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        snprintf(err, errlen, "cannot open %s", path);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    if ((text = malloc(size + 1)) == NULL || (value = malloc(sizeof(*value))) == NULL) {
+        free(text);
+        fclose(fp);
+        snprintf(err, errlen, "out of memory");
+        return NULL;
+    }
+    text[fread(text, 1, size, fp)] = '\0';
+    fclose(fp);
+
+    p.text = p.pos = text;
+    p.err = err;
+    p.errlen = errlen;
+    p.failed = false;
+    if (parse_value(&p, value)) {
+        skip_space(&p);
+        if (*p.pos != '\0') parse_error(&p, "trailing characters");
+    }
+    free(text);
+    if (p.failed) {
+        json_free(value);
+        return NULL;
+    }
+    return value;
+}
+
+static void free_members(json_value_t *value) {
+    for (size_t i = 0; i < value->num_members; i++) {
+        free_members(&value->members[i]);
+    }
+    free(value->members);
+    free(value->string);
+    free(value->name);
+}
+
+/*
+ * json_free - free a value returned by json_parse_file
+ */
+void json_free(json_value_t *value) {
+    if (value != NULL) {
+        free_members(value);
+        free(value);
+    }
+}
+
+/*
+ * json_get - look up a member of an object by name, or NULL if there is none
+ */
+const json_value_t *json_get(const json_value_t *object, const char *name) {
+    if (object == NULL || object->type != JSON_OBJECT) return NULL;
+    for (size_t i = 0; i < object->num_members; i++) {
+        const json_value_t *m = &object->members[i];
+        if (m->name != NULL && strcmp(m->name, name) == 0) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * json_get_number - look up a numeric member, or fallback if there is none
+ */
+double json_get_number(const json_value_t *object, const char *name, double fallback) {
+    const json_value_t *m = json_get(object, name);
+    if (m == NULL) return fallback;
+    if (m->type == JSON_BOOL) return m->boolean;
+    return m->type == JSON_NUMBER ? m->number : fallback;
+}
+
+/*
+ * json_get_string - look up a string member, or NULL if there is none
+ */
+const char *json_get_string(const json_value_t *object, const char *name) {
+    const json_value_t *m = json_get(object, name);
+    return (m != NULL && m->type == JSON_STRING) ? m->string : NULL;
+}
+
+/*
+ * json_print_string - write s as a quoted JSON string literal
+ */
+void json_print_string(FILE *fp, const char *s) {
+    fputc('"', fp);
+    for (; *s != '\0'; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(fp, "\\%c", c);
+        }
+        else if (c < 0x20) {
+            fprintf(fp, "\\u%04x", c);
+        }
+        else {
+            fputc(c, fp);
+        }
+    }
+    fputc('"', fp);
+}
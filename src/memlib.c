@@ -10,12 +10,21 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "evring.h"
+#include "mm_probes.h"
 
 #define MAX_HEAP (100 * (1 << 20)) /* 100 MB */
 
 /* private variables */
 static uint8_t *heap;
 static uint8_t *mem_brk;
+static size_t page_size;
+static mem_sbrk_stats_t sbrk_stats;  /* since the last mem_reset_brk */
+static uint64_t sbrk_call_nsecs = 0; /* modelled cost of each mem_sbrk call... */
+static uint64_t sbrk_page_nsecs = 0; /* ... and of each page it maps */
 
 /*
  * mem_init - initialize the memory system model
@@ -28,6 +37,7 @@ void mem_init() {
                 -1,                          /* fd (unused) */
                 0                            /* offset (unused) */
     );
+    page_size = sysconf(_SC_PAGESIZE);
 
     /* Heap is initially empty. */
     mem_reset_brk(true);
@@ -45,6 +55,7 @@ void mem_deinit() {
  */
 void mem_reset_brk(bool clear) {
     mem_brk = heap;
+    memset(&sbrk_stats, 0, sizeof(sbrk_stats));
 
     /* Fill heap with garbage since it is uninitialized. */
     if (clear) {
@@ -52,13 +63,81 @@ void mem_reset_brk(bool clear) {
     }
 }
 
+/*
+ * mem_release_pages - give all the heap's pages back to the kernel, so that
+ *    the pages a trace touches can be counted afterwards. They read as zero
+ *    until mem_reset_brk(true) fills them with garbage again.
+ */
+void mem_release_pages(void) {
+    madvise(heap, MAX_HEAP, MADV_DONTNEED);
+}
+
+/*
+ * mem_resident_pages - set vec[i] to whether the i-th page of the heap, up
+ *    to the break, is resident. Returns the number of pages, or -1 if
+ *    mincore failed.
+ */
+long mem_resident_pages(unsigned char *vec) {
+    long pagesize = sysconf(_SC_PAGESIZE);
+    size_t len = mem_brk - heap;
+
+    if (len == 0) {
+        return 0;
+    }
+    if (mincore(heap, len, vec) < 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < (len + pagesize - 1) / pagesize; i++) {
+        vec[i] &= 1;
+    }
+    return (len + pagesize - 1) / pagesize;
+}
+
+/*
+ * mem_set_sbrk_cost - make every later mem_sbrk call take call_nsecs, plus
+ *    page_nsecs for every page that the break moves onto, as a system call
+ *    that maps and faults in the pages would. Both 0 (the default) makes
+ *    mem_sbrk a pointer bump again.
+ */
+void mem_set_sbrk_cost(unsigned long call_nsecs, unsigned long page_nsecs) {
+    sbrk_call_nsecs = call_nsecs;
+    sbrk_page_nsecs = page_nsecs;
+}
+
+/*
+ * mem_get_sbrk_stats - return the mem_sbrk calls since the last
+ *    mem_reset_brk
+ */
+void mem_get_sbrk_stats(mem_sbrk_stats_t *stats) {
+    *stats = sbrk_stats;
+}
+
+/* Returns the time on CLOCK_MONOTONIC in nanoseconds */
+static uint64_t now_nsecs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * spin - busy-wait for nsecs. A sleep would be far too coarse, and the
+ *    time a real system call takes is spent on the CPU anyway.
+ */
+static void spin(uint64_t nsecs) {
+    uint64_t end = now_nsecs() + nsecs;
+    while (now_nsecs() < end)
+        ;
+}
+
 /*
  * mem_sbrk - simple model of the sbrk function. Extends the heap
  *    by incr bytes and returns the start address of the new area. In
  *    this model, the heap cannot be shrunk.
  */
 void *mem_sbrk(ssize_t incr) {
+    uint64_t start = MM_EVENT_START();
     void *old_brk = mem_brk;
+    size_t old_pages, new_pages;
 
     if (incr < 0 || mem_brk + incr > heap + MAX_HEAP) {
         errno = ENOMEM;
@@ -66,7 +145,17 @@ void *mem_sbrk(ssize_t incr) {
         return (void *) -1;
     }
 
+    old_pages = (mem_brk - heap + page_size - 1) / page_size;
     mem_brk += incr;
+    new_pages = (mem_brk - heap + page_size - 1) / page_size;
+    sbrk_stats.calls++;
+    sbrk_stats.bytes += incr;
+    sbrk_stats.pages += new_pages - old_pages;
+    if (sbrk_call_nsecs > 0 || sbrk_page_nsecs > 0) {
+        spin(sbrk_call_nsecs + sbrk_page_nsecs * (new_pages - old_pages));
+    }
+    MM_EVENT(EVRING_SBRK, incr, old_brk, start);
+    MM_PROBE2(sbrk, incr, old_brk);
     return old_brk;
 }
 
@@ -7,8 +7,14 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "evring.h"
 #include "memlib.h"
 #include "mm.h"
+#include "mm_check.h"
+#include "mm_dump.h"
+#include "mm_probes.h"
+#include "mm_prof.h"
+#include "mm_stats.h"
 
 /** The required alignment of heap payloads */
 const size_t ALIGNMENT = 2 * sizeof(size_t);
@@ -44,6 +50,14 @@ typedef struct linked_node_t {
 linked_node_t *head = NULL;
 linked_node_t *tail = NULL;
 
+/** The statistics reported by mm_get_stats */
+static struct mm_stats stats;
+
+/** The heap checker, and the block its next incremental check starts at (NULL: the
+ * first block) */
+static mm_check_t check;
+static block_t *check_cursor = NULL;
+
 /** Rounds up `size` to the nearest multiple of `n` */
 static size_t round_up(size_t size, size_t n) {
     return (size + (n - 1)) / n * n;
@@ -74,6 +88,11 @@ static size_t get_size(block_t *block) {
     return block->header & ~1;
 }
 
+/** Extracts a block's allocation state from its header */
+static bool is_allocated(block_t *block) {
+    return block->header & 1;
+}
+
 /** Extracts previous block's  size from current block's footer */
 static size_t get_prev_size(block_t *block) {
     return block->footer & -1;
@@ -124,6 +143,7 @@ static void add_linked_node_to_block(block_t *block) {
     tail->prev->next = new_node;
     // Set the tail's previous pointer to the new node, since its now the new last node
     tail->prev = new_node;
+    MM_STAT_FREE_BLOCK(stats, get_size(block), 1);
 }
 
 /** Removes the linked_node_t in the block's payload */
@@ -133,6 +153,22 @@ static void remove_linked_node_from_block(block_t *block) {
     (temp->prev)->next = temp->next;
     // Set prev of next free node to prev of curr free node
     (temp->next)->prev = temp->prev;
+    MM_STAT_FREE_BLOCK(stats, get_size(block), -1);
+}
+
+/** Changes the size of a block in the free list, which stays where it is in the list */
+static void resize_free_block(block_t *block, size_t size) {
+    MM_STAT_FREE_BLOCK(stats, get_size(block), -1);
+    set_boundaries(block, size, false);
+    MM_STAT_FREE_BLOCK(stats, size, 1);
+}
+
+/** Notes that `gone` has been merged into `merged`, so the checker doesn't resume in the
+ * middle of a block */
+static void forget_block(block_t *gone, block_t *merged) {
+    if (gone == check_cursor) {
+        check_cursor = merged;
+    }
 }
 
 /**
@@ -155,6 +191,10 @@ static void remove_linked_node_from_block(block_t *block) {
  *       assumed to be multiples of the alignment requirement.
  */
 static void split(block_t *block, size_t size, size_t allocated_size) {
+    // Remove linked node from free list that was in current block, since it is now
+    // allocated. The new footer lies past the node, so this can happen first, while the
+    // block still has its free size.
+    remove_linked_node_from_block(block);
     // Current block set to allocated with allocated payload size given to user
     set_boundaries(block, allocated_size, true);
     // Get next block
@@ -164,9 +204,8 @@ static void split(block_t *block, size_t size, size_t allocated_size) {
     set_boundaries(da_next_block, size - allocated_size - ALIGNMENT, false);
     // Append a new free block (from the split) to the free list
     add_linked_node_to_block(da_next_block);
-    // Remove linked node from free list that was in current block, since it is now
-    // allocated
-    remove_linked_node_from_block(block);
+    MM_STAT_INC(stats, splits);
+    MM_PROBE3(split, block, allocated_size, get_size(da_next_block));
 }
 
 /**
@@ -189,11 +228,14 @@ static void coalesce(block_t *block) {
         // (header/footer)
         size += get_prev_size(block) + ALIGNMENT;
         // Set the new size of the previous block after coalescing
-        set_boundaries((block_t *) ((char *) block - get_prev_size(block) - ALIGNMENT),
-                       size, false);
+        block_t *prev_block = (block_t *) ((char *) block - get_prev_size(block) - ALIGNMENT);
+        resize_free_block(prev_block, size);
+        MM_STAT_INC(stats, coalesces);
+        MM_PROBE2(coalesce, prev_block, size);
         // Remove the current block from the free list as it is now part of the previous
         // block
         remove_linked_node_from_block(block);
+        forget_block(block, prev_block);
 
         // After coalescing with previous, check if we can also coalesce with the next
         // block
@@ -204,12 +246,13 @@ static void coalesce(block_t *block) {
             // (header/footer)
             size += get_size(da_next_block) + ALIGNMENT;
             // Set the new size of the coalesced block (which now includes the next block)
-            set_boundaries(
-                (block_t *) ((char *) block - get_prev_size(block) - ALIGNMENT), size,
-                false);
+            resize_free_block(prev_block, size);
+            MM_STAT_INC(stats, coalesces);
+            MM_PROBE2(coalesce, prev_block, size);
             // Remove the next block from the free list as it is now part of the coalesced
             // block
             remove_linked_node_from_block(da_next_block);
+            forget_block(da_next_block, prev_block);
             // Exit the function as coalescing is complete
             return;
         }
@@ -221,8 +264,11 @@ static void coalesce(block_t *block) {
         block_t *da_next_block =
             (block_t *) ((char *) block + get_size(block) + ALIGNMENT);
         size += get_size(da_next_block) + ALIGNMENT;
-        set_boundaries(block, size, false);
+        resize_free_block(block, size);
         remove_linked_node_from_block(da_next_block);
+        forget_block(da_next_block, block);
+        MM_STAT_INC(stats, coalesces);
+        MM_PROBE2(coalesce, block, size);
     }
 }
 
@@ -231,15 +277,19 @@ static void coalesce(block_t *block) {
  * If no block is large enough, returns NULL.
  */
 static block_t *find_fit(size_t size) {
+    size_t searched = 0;
     // Traverse the blocks in the heap using the explicit list
     // Iterate backwards from last block
     for (linked_node_t *curr = tail->prev; curr != head; curr = curr->prev) {
+        searched++;
         // Retrieve the block_t structure from the current free_node
         block_t *free_block = (block_t *) ((char *) curr - ALIGNMENT);
         // Determine the size of the current free block
         size_t block_size = get_size(free_block);
         // Check if the current block is large enough to satisfy the allocation request
         if (block_size >= size) {
+            MM_STAT_FIT_SEARCH(stats, searched);
+            MM_PROBE3(find_fit, size, free_block, searched);
             // Set the block as allocated by updating its header and footer
             set_boundaries(free_block, block_size, true);
             // Check if the remaining space after allocation is too small to create a new
@@ -254,6 +304,8 @@ static block_t *find_fit(size_t size) {
             return free_block;
         }
     }
+    MM_STAT_FIT_SEARCH(stats, searched);
+    MM_PROBE3(find_fit, size, NULL, searched);
     return NULL;
 }
 
@@ -261,10 +313,13 @@ static block_t *find_fit(size_t size) {
  * mm_init - Initializes the allocator state
  */
 bool mm_init(void) {
+    memset(&stats, 0, sizeof(stats));
     // Allocate space for the head and tail node of the free list using mem_sbrk,
     // which extends the heap by the size of ALIGNMENT
     head = (linked_node_t *) mem_sbrk(ALIGNMENT);
+    MM_STAT_INC(stats, sbrks);
     tail = (linked_node_t *) mem_sbrk(ALIGNMENT);
+    MM_STAT_INC(stats, sbrks);
     // Check if the heap extension failed
     if ((head == (void *) -1) || (tail == (void *) -1)) {
         return false;
@@ -278,7 +333,9 @@ bool mm_init(void) {
 
     // Allocated footer of prologue and header of epilogue of heap (boundaries)
     footer_t *prologue = (footer_t *) mem_sbrk(sizeof(size_t));
+    MM_STAT_INC(stats, sbrks);
     header_t *epilogue = (header_t *) mem_sbrk(sizeof(size_t));
+    MM_STAT_INC(stats, sbrks);
     if ((prologue == (void *) -1) || (epilogue == (void *) -1)) {
         return false;
     }
@@ -287,43 +344,63 @@ bool mm_init(void) {
         true; // Mark the start of the heap as used. (Sets allocated bit to 1, rest are 0)
     *epilogue = 0 | true; // Mark the end of the heap as used.
 
+    check_cursor = NULL;
+    mm_prof_forget_live();
     return true;
 }
 
 /**
- * mm_malloc - Allocates a block with the given size
+ * malloc_block - Allocates a block with the given size (see mm_malloc)
  */
-void *mm_malloc(size_t size) {
+static void *malloc_block(size_t size) {
+    size_t request_size = size;
     // Round up the requested size to meet the alignment requirements
     size = round_up(size, ALIGNMENT);
+    MM_STAT_INC(stats, mallocs);
     // Try to find a free block that fits the rounded-up size
     block_t *block = find_fit(size);
     // If a fitting block is found, return the payload address
     if (block != NULL) {
+        MM_STAT_ALLOC_BLOCK(stats, get_size(block), 1);
+        MM_PROF_MALLOC(block->payload, request_size);
         return block->payload;
     }
-    // If no fitting block is found, extend the heap by the requested size
-    // Adjust by ALIGNMENT to leave room for the header
-    void *set_location = mem_sbrk(size) - ALIGNMENT;
-    // Further extend the heap to make room for the footer
-    footer_t *footer = (footer_t *) mem_sbrk(sizeof(footer_t));
-    // Check if heap extension was successful, return NULL if not
-    if (footer == (void *) -1) {
+    // If no fitting block is found, extend the heap by the requested size plus
+    // a footer and a new epilogue header, in one call so that a failure leaves
+    // the heap as it was. The old epilogue becomes the new block's header.
+    void *set_location = mem_sbrk(size + sizeof(footer_t) + sizeof(header_t));
+    MM_STAT_INC(stats, sbrks);
+    if (set_location == (void *) -1) {
         return NULL;
     }
     // Set the extended heap space to block
-    block = (block_t *) set_location;
+    block = (block_t *) ((char *) set_location - ALIGNMENT);
     // Set the boundaries of the new block (header and footer) with the given size and
     // mark it as allocated
     set_boundaries(block, size, true);
-    // Extend the heap to add an epilogue header which marks the end of the heap
-    header_t *epilogue = (header_t *) mem_sbrk(sizeof(header_t));
+    // Add an epilogue header after the footer, which marks the end of the heap
+    header_t *epilogue = (header_t *) ((char *) set_location + size + sizeof(footer_t));
     // Set the epilogue header with size 0 and mark it as allocated
     *epilogue = 0 | true;
+    MM_STAT_ALLOC_BLOCK(stats, size, 1);
+    MM_PROF_MALLOC(block->payload, request_size);
     // Return the payload address of the allocated block (allocated memory for user)
     return block->payload;
 }
 
+/**
+ * mm_malloc - Allocates a block with the given size
+ */
+void *mm_malloc(size_t size) {
+    uint64_t start = MM_EVENT_START();
+    MM_PROF_ENTER();
+    void *ptr = malloc_block(size);
+    MM_PROF_LEAVE();
+    MM_EVENT(EVRING_MALLOC, size, ptr, start);
+    MM_PROBE2(malloc, size, ptr);
+    return ptr;
+}
+
 /**
  * mm_free - Releases a block to be reused for future allocations
  */
@@ -332,22 +409,32 @@ void mm_free(void *ptr) {
     if (ptr == NULL) {
         return;
     }
+    uint64_t start = MM_EVENT_START();
     block_t *block = block_from_payload(ptr);
+    size_t size = get_size(block);
+    uint64_t coalesces = stats.coalesces;
+    MM_STAT_INC(stats, frees);
+    MM_STAT_ALLOC_BLOCK(stats, size, -1);
+    MM_PROF_FREE(ptr);
     // Mark allocation as false
-    set_boundaries(block, get_size(block), false);
+    set_boundaries(block, size, false);
     // Add linked node to block's payload, indicating that it is free
     add_linked_node_to_block(block);
     // Coalesce prev and next of curr, coalesce function colesces neighboring blocks
     if (!is_prev_allocated(block) || !is_next_allocated(block)) {
         coalesce(block);
     }
+    MM_STAT_HIST(stats, free_merges, stats.coalesces - coalesces);
+    MM_EVENT(EVRING_FREE, size, ptr, start);
+    MM_PROBE2(free, ptr, size);
 }
 
 /**
- * mm_realloc - Change the size of the block by mm_mallocing a new block,
+ * realloc_block - Change the size of the block by mm_mallocing a new block,
  *      copying its data, and mm_freeing the old block.
  */
-void *mm_realloc(void *old_ptr, size_t size) {
+static void *realloc_block(void *old_ptr, size_t size) {
+    MM_STAT_INC(stats, reallocs);
     if (old_ptr == NULL) {
         return (mm_malloc(size));
     }
@@ -360,16 +447,32 @@ void *mm_realloc(void *old_ptr, size_t size) {
     size_t old_size = get_size(block_from_payload(old_ptr));
     size_t copy_size = old_size < size ? old_size : size;
     memcpy(new_ptr, old_ptr, copy_size);
+    MM_STAT_REALLOC(stats, size, true, copy_size);
     mm_free(old_ptr);
     return (new_ptr);
 }
 
+/**
+ * mm_realloc - Change the size of a block (see realloc_block)
+ */
+void *mm_realloc(void *old_ptr, size_t size) {
+    uint64_t start = MM_EVENT_START();
+    MM_PROF_ENTER();
+    void *new_ptr = realloc_block(old_ptr, size);
+    MM_PROF_LEAVE();
+    MM_EVENT(EVRING_REALLOC, size, new_ptr, start);
+    MM_PROBE3(realloc, old_ptr, size, new_ptr);
+    return new_ptr;
+}
+
 /**
  * mm_calloc - Allocate the block and set it to zero.
  */
 void *mm_calloc(size_t nmemb, size_t size) {
     size_t total_size = nmemb * size;
+    MM_PROF_ENTER();
     void *allocated = mm_malloc(total_size);
+    MM_PROF_LEAVE();
     if (allocated != NULL) {
         memset(allocated, 0, total_size);
     }
@@ -377,7 +480,335 @@ void *mm_calloc(size_t nmemb, size_t size) {
 }
 
 /**
- * mm_checkheap - So simple, it doesn't need a checker!
+ * memalign_block - Allocates a block whose payload is aligned to `alignment`, a power
+ *      of two, by over-allocating and handing the unaligned front back as a free block
+ */
+static void *memalign_block(size_t alignment, size_t size) {
+    if ((alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    if (alignment <= ALIGNMENT) {
+        return mm_malloc(size);
+    }
+
+    // A free block in front of the aligned one needs room for its boundaries and a
+    // linked node, so leave space to skip ahead by another `alignment` bytes
+    uint8_t *ptr = mm_malloc(size + alignment + 2 * ALIGNMENT);
+    if (ptr == NULL) {
+        return NULL;
+    }
+    block_t *block = block_from_payload(ptr);
+    size_t block_size = get_size(block);
+    size_t gap = round_up((uintptr_t) ptr, alignment) - (uintptr_t) ptr;
+    if (gap > 0 && gap < 2 * ALIGNMENT) {
+        gap += alignment;
+    }
+
+    block_t *aligned_block = (block_t *) ((char *) block + gap);
+    if (gap > 0) {
+        MM_STAT_ALLOC_BLOCK(stats, block_size, -1);
+        set_boundaries(aligned_block, block_size - gap, true);
+        set_boundaries(block, gap - ALIGNMENT, false);
+        MM_STAT_ALLOC_BLOCK(stats, block_size - gap, 1);
+        MM_STAT_INC(stats, splits);
+        MM_PROF_MOVE(ptr, aligned_block->payload);
+        add_linked_node_to_block(block);
+        if (!is_prev_allocated(block)) {
+            coalesce(block);
+        }
+    }
+
+    // Give back what is left over past the end of the payload, too
+    size = round_up(size, ALIGNMENT);
+    size_t rest = get_size(aligned_block) - size;
+    if (rest >= 2 * ALIGNMENT) {
+        MM_STAT_ALLOC_BLOCK(stats, get_size(aligned_block), -1);
+        set_boundaries(aligned_block, size, true);
+        block_t *next_block = (block_t *) ((char *) aligned_block + size + ALIGNMENT);
+        set_boundaries(next_block, rest - ALIGNMENT, false);
+        MM_STAT_ALLOC_BLOCK(stats, size, 1);
+        MM_STAT_INC(stats, splits);
+        add_linked_node_to_block(next_block);
+        if (!is_next_allocated(next_block)) {
+            coalesce(next_block);
+        }
+    }
+    return aligned_block->payload;
+}
+
+/**
+ * mm_memalign - Allocates a block with an aligned payload (see memalign_block)
+ */
+void *mm_memalign(size_t alignment, size_t size) {
+    MM_PROF_ENTER();
+    void *ptr = memalign_block(alignment, size);
+    MM_PROF_LEAVE();
+    return ptr;
+}
+
+/**
+ * mm_free_sized - Releases a block whose size the caller knows. The size is stored in
+ *      the header anyway, so it is not needed.
+ */
+void mm_free_sized(void *ptr, size_t size) {
+    (void) size;
+    mm_free(ptr);
+}
+
+/**
+ * mm_usable_size - Returns the number of bytes that can be used in an allocated block
+ */
+size_t mm_usable_size(void *ptr) {
+    if (ptr == NULL) {
+        return 0;
+    }
+    return get_size(block_from_payload(ptr));
+}
+
+/**
+ * mm_heap_walk - Calls `visit` on every block between the prologue and the epilogue
+ */
+void mm_heap_walk(mm_walk_fn visit, void *arg) {
+    // The first block's footer field is the prologue, right after the list sentinels
+    block_t *curr = (block_t *) ((char *) tail + ALIGNMENT);
+    // The epilogue header occupies the last word of the heap
+    char *epilogue = (char *) mem_heap_hi() + 1 - sizeof(header_t);
+    while ((char *) &curr->header < epilogue) {
+        // A block spans its header, payload and footer
+        mm_block_info_t info = {
+            .block = &curr->header,
+            .size = get_size(curr) + ALIGNMENT,
+            .payload = curr->payload,
+            .payload_size = get_size(curr),
+            .allocated = is_allocated(curr),
+        };
+        visit(&info, arg);
+        curr = (block_t *) ((char *) curr + get_size(curr) + ALIGNMENT);
+    }
+}
+
+/**
+ * mm_padded_size - Returns the payload size mm_malloc reserves for a request of
+ *      `size` bytes, before any unsplit remainder is added to the block
+ */
+size_t mm_padded_size(size_t size) {
+    return round_up(size, ALIGNMENT);
+}
+
+/**
+ * mm_heap_dump - Writes a snapshot of the heap layout to `path`, marking the blocks
+ *      on the free list. Returns false if the file couldn't be written.
+ */
+bool mm_heap_dump(const char *path) {
+    if (tail == NULL) {
+        return mm_dump_write(path, mem_heap_lo(), mem_heapsize(), MM_DUMP_HAS_FREE_LIST,
+                             NULL, 0);
+    }
+    // A free block takes at least a header, footer and list node, which bounds the
+    // walk even if the list has been corrupted into a cycle
+    size_t max_listed = mem_heapsize() / (2 * ALIGNMENT) + 1;
+    uintptr_t *listed = malloc(max_listed * sizeof(uintptr_t));
+    size_t num_listed = 0;
+    if (listed == NULL) {
+        return false;
+    }
+    for (linked_node_t *curr = tail->prev;
+         curr != head && curr != NULL && num_listed < max_listed; curr = curr->prev) {
+        listed[num_listed++] = (uintptr_t) curr;
+    }
+    bool ok = mm_dump_write(path, mem_heap_lo(), mem_heapsize(), MM_DUMP_HAS_FREE_LIST,
+                            listed, num_listed);
+    free(listed);
+    return ok;
+}
+
+/**
+ * mm_get_stats - Reports the allocator statistics. Only the largest free block isn't
+ *      kept up to date, so finding it walks the free list.
+ */
+void mm_get_stats(struct mm_stats *out) {
+#ifndef MM_NO_STATS
+    *out = stats;
+    out->largest_free = 0;
+    if (tail != NULL) {
+        for (linked_node_t *curr = tail->prev; curr != head; curr = curr->prev) {
+            size_t size = get_size((block_t *) ((char *) curr - ALIGNMENT));
+            if (size > out->largest_free) {
+                out->largest_free = size;
+            }
+        }
+    }
+#else
+    memset(out, 0, sizeof(*out));
+#endif
+    out->heap_size = mem_heapsize();
+}
+
+/** The first block on the heap; its footer field is the prologue */
+static block_t *first_block(void) {
+    return (block_t *) ((char *) tail + ALIGNMENT);
+}
+
+/** Is `node` a free-list sentinel or the linked node of a free block on the heap? */
+static bool is_list_node(linked_node_t *node, char *epilogue) {
+    if (node == head || node == tail) {
+        return true;
+    }
+    block_t *block = (block_t *) ((char *) node - ALIGNMENT);
+    return (char *) block >= (char *) first_block() && (char *) &block->header < epilogue &&
+           (uintptr_t) node % ALIGNMENT == 0 && !is_allocated(block);
+}
+
+/**
+ * check_block - Checks the invariants of a single block: its boundary tags, that free
+ *      blocks have been coalesced with their neighbours, and that free blocks are linked
+ *      into the free list both ways. Returns false if the block is so broken that the
+ *      blocks after it can't be found.
+ */
+static bool check_block(block_t *block, char *epilogue) {
+    size_t size = get_size(block);
+    block_t *next = (block_t *) ((char *) block + size + ALIGNMENT);
+
+    if ((uintptr_t) block->payload % ALIGNMENT != 0) {
+        mm_check_fail(&check, "payload of block %p is misaligned", (void *) block);
+    }
+    if (size % ALIGNMENT != 0 || (char *) &next->header > epilogue) {
+        mm_check_fail(&check, "block %p has a bad size %zu", (void *) block, size);
+        return false;
+    }
+    if (next->footer != block->header) {
+        mm_check_fail(&check, "header (%#zx) and footer (%#zx) of block %p differ",
+                      block->header, next->footer, (void *) block);
+        return false;
+    }
+    if (is_allocated(block)) {
+        return true;
+    }
+
+    if (size < sizeof(linked_node_t)) {
+        mm_check_fail(&check, "free block %p is too small (%zu) for its list node",
+                      (void *) block, size);
+        return false;
+    }
+    if (!is_prev_allocated(block) || !is_next_allocated(block)) {
+        mm_check_fail(&check, "free block %p wasn't coalesced with a free neighbour",
+                      (void *) block);
+    }
+    linked_node_t *node = (linked_node_t *) block->payload;
+    if (!is_list_node(node->prev, epilogue) || !is_list_node(node->next, epilogue)) {
+        mm_check_fail(&check, "free block %p links to %p and %p, which aren't free blocks",
+                      (void *) block, (void *) node->prev, (void *) node->next);
+    }
+    else if (node->prev->next != node || node->next->prev != node) {
+        mm_check_fail(&check, "free block %p isn't in the free list", (void *) block);
+    }
+    return true;
+}
+
+/**
+ * check_free_list - Walks the free list, for a full check. Every node must be a free
+ *      block, and there must be as many nodes as free blocks on the heap.
+ */
+static void check_free_list(size_t free_blocks, char *epilogue) {
+    size_t n = 0;
+
+    if (head->prev != NULL || tail->next != NULL) {
+        mm_check_fail(&check, "the free list sentinels link outside the list");
+    }
+    for (linked_node_t *curr = head->next; curr != tail; curr = curr->next) {
+        // Any more nodes than free blocks, and the list has a cycle
+        if (n++ > free_blocks || !is_list_node(curr, epilogue) || curr->next->prev != curr) {
+            mm_check_fail(&check, "the free list is broken at %p", (void *) curr);
+            return;
+        }
+    }
+    if (n != free_blocks) {
+        mm_check_fail(&check, "%zu blocks in the free list, but %zu free blocks", n,
+                      free_blocks);
+    }
+}
+
+/**
+ * check_totals - Checks the statistics against the block counts of a full check
+ */
+static void check_totals(const struct mm_stats *seen) {
+#ifndef MM_NO_STATS
+    if (seen->allocated_blocks != stats.allocated_blocks ||
+        seen->allocated_bytes != stats.allocated_bytes) {
+        mm_check_fail(&check, "%zu allocated blocks of %zu bytes, but the stats say %zu of %zu",
+                      seen->allocated_blocks, seen->allocated_bytes, stats.allocated_blocks,
+                      stats.allocated_bytes);
+    }
+    if (seen->free_bytes != stats.free_bytes) {
+        mm_check_fail(&check, "%zu free bytes, but the stats say %zu", seen->free_bytes,
+                      stats.free_bytes);
+    }
+    for (int k = 0; k < MM_STATS_CLASSES; k++) {
+        if (seen->free_blocks[k] != stats.free_blocks[k]) {
+            mm_check_fail(&check, "%zu free blocks in size class %d, but the stats say %zu",
+                          seen->free_blocks[k], k, stats.free_blocks[k]);
+        }
+    }
+#else
+    (void) seen;
+#endif
+}
+
+/**
+ * mm_checkheap - Checks the heap, as much of it as the mode set with mm_checkheap_mode
+ *      asks for. Problems are reported on stderr and counted in mm_checkheap_errors.
  */
 void mm_checkheap(void) {
+    size_t budget = mm_check_budget(&check);
+    if (budget == 0 || tail == NULL) {
+        return;
+    }
+    bool full = (budget == SIZE_MAX);
+    char *epilogue = (char *) mem_heap_hi() + 1 - sizeof(header_t);
+    size_t free_blocks = 0;
+    struct mm_stats seen;
+    memset(&seen, 0, sizeof(seen));
+
+    if (first_block()->footer != (0 | true) || *(header_t *) epilogue != (0 | true)) {
+        mm_check_fail(&check, "the prologue or epilogue has been overwritten");
+        return;
+    }
+
+    block_t *curr = (full || check_cursor == NULL) ? first_block() : check_cursor;
+    for (size_t n = 0; n < budget && (char *) &curr->header < epilogue; n++) {
+        if (!check_block(curr, epilogue)) {
+            check_cursor = NULL;
+            return;
+        }
+        if (is_allocated(curr)) {
+            MM_STAT_ALLOC_BLOCK(seen, get_size(curr), 1);
+        }
+        else {
+            MM_STAT_FREE_BLOCK(seen, get_size(curr), 1);
+            free_blocks++;
+        }
+        curr = (block_t *) ((char *) curr + get_size(curr) + ALIGNMENT);
+    }
+    // Wrap around to the first block once the epilogue is reached
+    check_cursor = ((char *) &curr->header < epilogue) ? curr : NULL;
+
+    if (full) {
+        check_free_list(free_blocks, epilogue);
+        check_totals(&seen);
+    }
+}
+
+/**
+ * mm_checkheap_mode - Sets how much of the heap each mm_checkheap call checks
+ */
+void mm_checkheap_mode(mm_check_mode_t mode, size_t budget, unsigned period) {
+    mm_check_configure(&check, mode, budget, period);
+    check_cursor = NULL;
+}
+
+/**
+ * mm_checkheap_errors - Returns the number of problems mm_checkheap has found
+ */
+uint64_t mm_checkheap_errors(void) {
+    return check.errors;
 }
@@ -6,8 +6,14 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "evring.h"
 #include "memlib.h"
 #include "mm.h"
+#include "mm_check.h"
+#include "mm_dump.h"
+#include "mm_probes.h"
+#include "mm_prof.h"
+#include "mm_stats.h"
 
 /** The required alignment of heap payloads */
 const size_t ALIGNMENT = 2 * sizeof(size_t);
@@ -28,6 +34,14 @@ typedef struct {
 static block_t *mm_heap_first = NULL;
 static block_t *mm_heap_last = NULL;
 
+/** The statistics reported by mm_get_stats */
+static struct mm_stats stats;
+
+/** The heap checker, and the block its next incremental check starts at (NULL: the
+ * first block) */
+static mm_check_t check;
+static block_t *check_cursor = NULL;
+
 /** Rounds up `size` to the nearest multiple of `n` */
 static size_t round_up(size_t size, size_t n) {
     return (size + (n - 1)) / n * n;
@@ -53,6 +67,11 @@ static block_t *block_from_payload(void *ptr) {
     return ptr - offsetof(block_t, payload);
 }
 
+/** Extracts a block's payload size from its header */
+static size_t get_payload_size(block_t *block) {
+    return get_size(block) - sizeof(block_t);
+}
+
 /**
  * mm_init - Initializes the allocator state
  */
@@ -66,24 +85,33 @@ bool mm_init(void) {
     // Initialize the heap with no blocks
     mm_heap_first = NULL;
     mm_heap_last = NULL;
+    check_cursor = NULL;
+    memset(&stats, 0, sizeof(stats));
+    MM_STAT_INC(stats, sbrks);
+    mm_prof_forget_live();
     return true;
 }
 
 /**
- * mm_malloc - Allocates a block with the given size
+ * malloc_block - Allocates a block with the given size (see mm_malloc)
  */
-void *mm_malloc(size_t size) {
+static void *malloc_block(size_t size) {
+    size_t request_size = size;
     // The block must have enough space for a header and be 16-byte aligned
     size = round_up(sizeof(block_t) + size, ALIGNMENT);
     size_t required_size = size;
+    MM_STAT_INC(stats, mallocs);
 
     // If there are no blocks yet, create the initial heap
     if (mm_heap_first == NULL) {
         block_t *block = mem_sbrk(required_size);
+        MM_STAT_INC(stats, sbrks);
         if (block == (void *) -1) {
             return NULL;
         }
         set_header(block, required_size, true);
+        MM_STAT_ALLOC_BLOCK(stats, get_payload_size(block), 1);
+        MM_PROF_MALLOC(block->payload, request_size);
         mm_heap_first = block;
         mm_heap_last = block;
         return block->payload;
@@ -93,17 +121,36 @@ void *mm_malloc(size_t size) {
     // the way
     block_t *curr = mm_heap_first;
     block_t *prev_free = NULL;
+    size_t searched = 0;
+    uint64_t coalesces = stats.coalesces;
     while (curr <= mm_heap_last) {
         size_t curr_size = get_size(curr);
+        searched++;
         // Check for coalescing with the previous free block
         if (!is_allocated(curr) && prev_free) {
             // Coalesce current block with previous free block
+            MM_STAT_FREE_BLOCK(stats, get_payload_size(prev_free), -1);
+            MM_STAT_FREE_BLOCK(stats, get_payload_size(curr), -1);
             curr_size += get_size(prev_free);
             set_header(prev_free, curr_size, false);
+            // The current block is gone, so nothing may point at it any more
+            if (curr == mm_heap_last) {
+                mm_heap_last = prev_free;
+            }
+            if (curr == check_cursor) {
+                check_cursor = prev_free;
+            }
             curr = prev_free;
+            MM_STAT_FREE_BLOCK(stats, get_payload_size(curr), 1);
+            MM_STAT_INC(stats, coalesces);
+            MM_PROBE2(coalesce, curr, curr_size);
         }
         // Check if the current block is a fit
         if (!is_allocated(curr) && curr_size >= required_size) {
+            MM_STAT_FIT_SEARCH(stats, searched);
+            MM_STAT_HIST(stats, malloc_merges, stats.coalesces - coalesces);
+            MM_PROBE3(find_fit, required_size, curr, searched);
+            MM_STAT_FREE_BLOCK(stats, get_payload_size(curr), -1);
             // If the current block can be split
             if (curr_size - required_size >= (sizeof(block_t) + ALIGNMENT)) {
                 set_header(curr, required_size, true);
@@ -111,6 +158,9 @@ void *mm_malloc(size_t size) {
                     (block_t *) ((char *) curr + required_size); // char * allows bytewise
                                                                  // pointer arithmetic
                 set_header(next_block, curr_size - required_size, false);
+                MM_STAT_FREE_BLOCK(stats, get_payload_size(next_block), 1);
+                MM_STAT_INC(stats, splits);
+                MM_PROBE3(split, curr, required_size, curr_size - required_size);
                 if (curr == mm_heap_last) {
                     mm_heap_last = next_block;
                 }
@@ -119,6 +169,8 @@ void *mm_malloc(size_t size) {
                 // Allocate the whole block
                 set_header(curr, curr_size, true);
             }
+            MM_STAT_ALLOC_BLOCK(stats, get_payload_size(curr), 1);
+            MM_PROF_MALLOC(curr->payload, request_size);
             return curr->payload;
         }
         // Update prev_free pointer if current block is free
@@ -132,15 +184,34 @@ void *mm_malloc(size_t size) {
         curr = (block_t *) ((char *) curr + curr_size);
     }
     // No fit found. Get more memory and place the block
+    MM_STAT_FIT_SEARCH(stats, searched);
+    MM_STAT_HIST(stats, malloc_merges, stats.coalesces - coalesces);
+    MM_PROBE3(find_fit, required_size, NULL, searched);
     block_t *new_block = mem_sbrk(required_size);
+    MM_STAT_INC(stats, sbrks);
     if (new_block == (void *) -1) {
         return NULL;
     }
     set_header(new_block, required_size, true);
+    MM_STAT_ALLOC_BLOCK(stats, get_payload_size(new_block), 1);
+    MM_PROF_MALLOC(new_block->payload, request_size);
     mm_heap_last = new_block;
     return new_block->payload;
 }
 
+/**
+ * mm_malloc - Allocates a block with the given size
+ */
+void *mm_malloc(size_t size) {
+    uint64_t start = MM_EVENT_START();
+    MM_PROF_ENTER();
+    void *ptr = malloc_block(size);
+    MM_PROF_LEAVE();
+    MM_EVENT(EVRING_MALLOC, size, ptr, start);
+    MM_PROBE2(malloc, size, ptr);
+    return ptr;
+}
+
 /**
  * mm_free - Releases a block to be reused for future allocations
  */
@@ -151,15 +222,23 @@ void mm_free(void *ptr) {
     }
 
     // Mark the block as unallocated
+    uint64_t start = MM_EVENT_START();
     block_t *block = block_from_payload(ptr);
     set_header(block, get_size(block), false);
+    MM_STAT_INC(stats, frees);
+    MM_STAT_ALLOC_BLOCK(stats, get_payload_size(block), -1);
+    MM_STAT_FREE_BLOCK(stats, get_payload_size(block), 1);
+    MM_PROF_FREE(ptr);
+    MM_EVENT(EVRING_FREE, get_payload_size(block), ptr, start);
+    MM_PROBE2(free, ptr, get_payload_size(block));
 }
 
 /**
- * mm_realloc - Change the size of the block by mm_mallocing a new block,
+ * realloc_block - Change the size of the block by mm_mallocing a new block,
  *      copying its data, and mm_freeing the old block.
  */
-void *mm_realloc(void *old_ptr, size_t size) {
+static void *realloc_block(void *old_ptr, size_t size) {
+    MM_STAT_INC(stats, reallocs);
     if (old_ptr == NULL) {
         return mm_malloc(size);
     }
@@ -177,6 +256,7 @@ void *mm_realloc(void *old_ptr, size_t size) {
 
     // If the size is the same, just return the old pointer
     if (size == old_size) {
+        MM_STAT_REALLOC(stats, size, false, 0);
         return old_ptr;
     }
 
@@ -188,6 +268,7 @@ void *mm_realloc(void *old_ptr, size_t size) {
     // Copy the data from the old block to the new block
     size_t copy_size = old_size < size ? old_size : size;
     memcpy(new_ptr, old_ptr, copy_size);
+    MM_STAT_REALLOC(stats, size, true, copy_size);
 
     // Free the old block
     mm_free(old_ptr);
@@ -195,12 +276,27 @@ void *mm_realloc(void *old_ptr, size_t size) {
     return new_ptr;
 }
 
+/**
+ * mm_realloc - Change the size of a block (see realloc_block)
+ */
+void *mm_realloc(void *old_ptr, size_t size) {
+    uint64_t start = MM_EVENT_START();
+    MM_PROF_ENTER();
+    void *new_ptr = realloc_block(old_ptr, size);
+    MM_PROF_LEAVE();
+    MM_EVENT(EVRING_REALLOC, size, new_ptr, start);
+    MM_PROBE3(realloc, old_ptr, size, new_ptr);
+    return new_ptr;
+}
+
 /**
  * mm_calloc - Allocate the block and set it to zero.
  */
 void *mm_calloc(size_t nmemb, size_t size) {
     size_t total_size = nmemb * size;
+    MM_PROF_ENTER();
     void *allocated = mm_malloc(total_size);
+    MM_PROF_LEAVE();
     if (allocated != NULL) {
         memset(allocated, 0, total_size);
     }
@@ -208,7 +304,254 @@ void *mm_calloc(size_t nmemb, size_t size) {
 }
 
 /**
- * mm_checkheap - So simple, it doesn't need a checker!
+ * memalign_block - Allocates a block whose payload is aligned to `alignment`, a power
+ *      of two, by over-allocating and handing the unaligned front back as a free block
+ */
+static void *memalign_block(size_t alignment, size_t size) {
+    if ((alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    if (alignment <= ALIGNMENT) {
+        return mm_malloc(size);
+    }
+
+    // Any aligned address within the first `alignment` bytes of the payload will do
+    uint8_t *ptr = mm_malloc(size + alignment);
+    if (ptr == NULL) {
+        return NULL;
+    }
+    block_t *block = block_from_payload(ptr);
+    size_t block_size = get_size(block);
+    size_t gap = round_up((uintptr_t) ptr, alignment) - (uintptr_t) ptr;
+
+    // The gap is a multiple of ALIGNMENT, so it is always big enough for a free block
+    block_t *aligned_block = (block_t *) ((char *) block + gap);
+    if (gap > 0) {
+        MM_STAT_ALLOC_BLOCK(stats, get_payload_size(block), -1);
+        set_header(block, gap, false);
+        set_header(aligned_block, block_size - gap, true);
+        MM_STAT_FREE_BLOCK(stats, get_payload_size(block), 1);
+        MM_STAT_ALLOC_BLOCK(stats, get_payload_size(aligned_block), 1);
+        MM_STAT_INC(stats, splits);
+        MM_PROF_MOVE(ptr, aligned_block->payload);
+        if (block == mm_heap_last) {
+            mm_heap_last = aligned_block;
+        }
+    }
+
+    // Give back what is left over past the end of the payload, too
+    size_t required_size = round_up(sizeof(block_t) + size, ALIGNMENT);
+    size_t rest = block_size - gap - required_size;
+    if (rest >= sizeof(block_t) + ALIGNMENT) {
+        MM_STAT_ALLOC_BLOCK(stats, get_payload_size(aligned_block), -1);
+        set_header(aligned_block, required_size, true);
+        block_t *next_block = (block_t *) ((char *) aligned_block + required_size);
+        set_header(next_block, rest, false);
+        MM_STAT_ALLOC_BLOCK(stats, get_payload_size(aligned_block), 1);
+        MM_STAT_FREE_BLOCK(stats, get_payload_size(next_block), 1);
+        MM_STAT_INC(stats, splits);
+        if (aligned_block == mm_heap_last) {
+            mm_heap_last = next_block;
+        }
+    }
+    return aligned_block->payload;
+}
+
+/**
+ * mm_memalign - Allocates a block with an aligned payload (see memalign_block)
+ */
+void *mm_memalign(size_t alignment, size_t size) {
+    MM_PROF_ENTER();
+    void *ptr = memalign_block(alignment, size);
+    MM_PROF_LEAVE();
+    return ptr;
+}
+
+/**
+ * mm_free_sized - Releases a block whose size the caller knows. The size is stored in
+ *      the header anyway, so it is not needed.
+ */
+void mm_free_sized(void *ptr, size_t size) {
+    (void) size;
+    mm_free(ptr);
+}
+
+/**
+ * mm_usable_size - Returns the number of bytes that can be used in an allocated block
+ */
+size_t mm_usable_size(void *ptr) {
+    if (ptr == NULL) {
+        return 0;
+    }
+    return get_payload_size(block_from_payload(ptr));
+}
+
+/**
+ * mm_heap_walk - Calls `visit` on every block from the start to the end of the heap
+ */
+void mm_heap_walk(mm_walk_fn visit, void *arg) {
+    if (mm_heap_first == NULL) {
+        return;
+    }
+    // Walk up to the break rather than to mm_heap_last, so every byte is covered
+    for (block_t *curr = mm_heap_first; (void *) curr <= mem_heap_hi();
+         curr = (block_t *) ((char *) curr + get_size(curr))) {
+        mm_block_info_t info = {
+            .block = curr,
+            .size = get_size(curr),
+            .payload = curr->payload,
+            .payload_size = get_size(curr) - sizeof(block_t),
+            .allocated = is_allocated(curr),
+        };
+        visit(&info, arg);
+    }
+}
+
+/**
+ * mm_padded_size - Returns the payload size mm_malloc reserves for a request of
+ *      `size` bytes, before any unsplit remainder is added to the block
+ */
+size_t mm_padded_size(size_t size) {
+    return round_up(sizeof(block_t) + size, ALIGNMENT) - sizeof(block_t);
+}
+
+/**
+ * mm_heap_dump - Writes a snapshot of the heap layout to `path`. There is no free
+ *      list to record. Returns false if the file couldn't be written.
+ */
+bool mm_heap_dump(const char *path) {
+    return mm_dump_write(path, mem_heap_lo(), mem_heapsize(), 0, NULL, 0);
+}
+
+/**
+ * mm_get_stats - Reports the allocator statistics. Only the largest free block isn't
+ *      kept up to date, so finding it walks the heap.
+ */
+void mm_get_stats(struct mm_stats *out) {
+#ifndef MM_NO_STATS
+    *out = stats;
+    out->largest_free = 0;
+    if (mm_heap_first != NULL) {
+        for (block_t *curr = mm_heap_first; (void *) curr <= mem_heap_hi();
+             curr = (block_t *) ((char *) curr + get_size(curr))) {
+            if (!is_allocated(curr) && get_payload_size(curr) > out->largest_free) {
+                out->largest_free = get_payload_size(curr);
+            }
+        }
+    }
+#else
+    memset(out, 0, sizeof(*out));
+#endif
+    out->heap_size = mem_heapsize();
+}
+
+/**
+ * check_block - Checks the invariants of a single block. Returns false if the block is
+ *      so broken that the blocks after it can't be found.
+ *
+ * Free blocks are only coalesced when mm_malloc scans past them, so neighbouring free
+ * blocks are allowed.
+ */
+static bool check_block(block_t *block, void *heap_end) {
+    size_t size = get_size(block);
+    void *next = (char *) block + size;
+
+    if ((uintptr_t) block->payload % ALIGNMENT != 0) {
+        mm_check_fail(&check, "payload of block %p is misaligned", (void *) block);
+    }
+    if (size < ALIGNMENT || size % ALIGNMENT != 0 || next > heap_end) {
+        mm_check_fail(&check, "block %p has a bad size %zu", (void *) block, size);
+        return false;
+    }
+    if (next == heap_end && block != mm_heap_last) {
+        mm_check_fail(&check, "mm_heap_last is %p, but the last block is %p",
+                      (void *) mm_heap_last, (void *) block);
+    }
+    if (next < heap_end && block == mm_heap_last) {
+        mm_check_fail(&check, "mm_heap_last (%p) isn't the last block", (void *) block);
+    }
+    return true;
+}
+
+/**
+ * check_totals - Checks the statistics against the block counts of a full check
+ */
+static void check_totals(const struct mm_stats *seen) {
+#ifndef MM_NO_STATS
+    if (seen->allocated_blocks != stats.allocated_blocks ||
+        seen->allocated_bytes != stats.allocated_bytes) {
+        mm_check_fail(&check, "%zu allocated blocks of %zu bytes, but the stats say %zu of %zu",
+                      seen->allocated_blocks, seen->allocated_bytes, stats.allocated_blocks,
+                      stats.allocated_bytes);
+    }
+    if (seen->free_bytes != stats.free_bytes) {
+        mm_check_fail(&check, "%zu free bytes, but the stats say %zu", seen->free_bytes,
+                      stats.free_bytes);
+    }
+    for (int k = 0; k < MM_STATS_CLASSES; k++) {
+        if (seen->free_blocks[k] != stats.free_blocks[k]) {
+            mm_check_fail(&check, "%zu free blocks in size class %d, but the stats say %zu",
+                          seen->free_blocks[k], k, stats.free_blocks[k]);
+        }
+    }
+#else
+    (void) seen;
+#endif
+}
+
+/**
+ * mm_checkheap - Checks the heap, as much of it as the mode set with mm_checkheap_mode
+ *      asks for. Problems are reported on stderr and counted in mm_checkheap_errors.
  */
 void mm_checkheap(void) {
+    size_t budget = mm_check_budget(&check);
+    if (budget == 0 || mm_heap_first == NULL) {
+        return;
+    }
+    bool full = (budget == SIZE_MAX);
+    void *heap_end = (char *) mem_heap_hi() + 1;
+    struct mm_stats seen;
+    memset(&seen, 0, sizeof(seen));
+
+    if ((char *) mm_heap_first != (char *) mem_heap_lo() + ALIGNMENT - sizeof(block_t)) {
+        mm_check_fail(&check, "the first block is at %p, not right after the padding",
+                      (void *) mm_heap_first);
+        return;
+    }
+
+    block_t *curr = (full || check_cursor == NULL) ? mm_heap_first : check_cursor;
+    for (size_t n = 0; n < budget && (void *) curr < heap_end; n++) {
+        if (!check_block(curr, heap_end)) {
+            check_cursor = NULL;
+            return;
+        }
+        if (is_allocated(curr)) {
+            MM_STAT_ALLOC_BLOCK(seen, get_payload_size(curr), 1);
+        }
+        else {
+            MM_STAT_FREE_BLOCK(seen, get_payload_size(curr), 1);
+        }
+        curr = (block_t *) ((char *) curr + get_size(curr));
+    }
+    // Wrap around to the first block once the end of the heap is reached
+    check_cursor = ((void *) curr < heap_end) ? curr : NULL;
+
+    if (full) {
+        check_totals(&seen);
+    }
+}
+
+/**
+ * mm_checkheap_mode - Sets how much of the heap each mm_checkheap call checks
+ */
+void mm_checkheap_mode(mm_check_mode_t mode, size_t budget, unsigned period) {
+    mm_check_configure(&check, mode, budget, period);
+    check_cursor = NULL;
+}
+
+/**
+ * mm_checkheap_errors - Returns the number of problems mm_checkheap has found
+ */
+uint64_t mm_checkheap_errors(void) {
+    return check.errors;
 }
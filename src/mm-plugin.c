@@ -0,0 +1,33 @@
+/*
+ * mm-plugin.c - Exports the mm_* functions of an allocator as a plugin
+ *      descriptor, so the allocator can be built as a shared object and
+ *      loaded by `mdriver --plugin`. See mm_plugin.h for how to build one.
+ */
+
+#include "mm_plugin.h"
+
+#ifndef MM_PLUGIN_NAME
+#define MM_PLUGIN_NAME "mm"
+#endif
+
+__attribute__((visibility("default"))) const mm_plugin_t mm_plugin = {
+    .abi_version = MM_PLUGIN_ABI_VERSION,
+    .size = sizeof(mm_plugin_t),
+    .name = MM_PLUGIN_NAME,
+    .flags = MM_PLUGIN_USES_MEMLIB,
+    .init = mm_init,
+    .malloc = mm_malloc,
+    .free = mm_free,
+    .realloc = mm_realloc,
+    .calloc = mm_calloc,
+    .checkheap = mm_checkheap,
+    .heap_walk = mm_heap_walk,
+    .padded_size = mm_padded_size,
+    .memalign = mm_memalign,
+    .free_sized = mm_free_sized,
+    .usable_size = mm_usable_size,
+    .get_stats = mm_get_stats,
+    .checkheap_mode = mm_checkheap_mode,
+    .checkheap_errors = mm_checkheap_errors,
+    .heap_dump = mm_heap_dump,
+};
@@ -0,0 +1,367 @@
+/*
+ * mm-prof.c - A sampling heap profiler for the allocators; see mm_prof.h.
+ *
+ * Sampled blocks are kept in a hash table keyed by their payload address,
+ * so that freeing one can take it out of the live profile, and call sites
+ * in a hash table keyed by their stack. Both live in libc's heap, never in
+ * the heap being profiled.
+ */
+#include "mm_prof.h"
+
+#include <execinfo.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Deepest stack recorded for a sample */
+#define MAX_DEPTH 32
+
+/* Frames above the allocator's caller that are looked for: mm_prof_sample,
+   and the allocator's own, which are more when a static helper isn't inlined
+   or mm_realloc, mm_calloc or mm_memalign calls mm_malloc */
+#define MAX_SKIPPED 16
+
+/* Hash table sizes, in buckets */
+#define SAMPLE_BUCKETS 4096
+#define SITE_BUCKETS 1024
+
+/* An allocation site: a distinct stack and what it allocated */
+typedef struct site_t {
+    struct site_t *next;
+    uint64_t hash;
+    int depth;
+    void *stack[MAX_DEPTH];
+    size_t live_count, live_bytes;   /* sampled blocks still allocated */
+    size_t total_count, total_bytes; /* all sampled blocks */
+    double live_est, total_est;      /* estimated bytes the samples stand for */
+} site_t;
+
+/* A sampled block that is still allocated */
+typedef struct sample_t {
+    struct sample_t *next;
+    void *ptr;
+    size_t size;
+    double est; /* estimated bytes this sample stands for */
+    site_t *site;
+} sample_t;
+
+/* Public (see mm_prof.h) */
+long mm_prof_countdown = LONG_MAX;
+size_t mm_prof_num_live = 0;
+void *mm_prof_caller = NULL;
+
+/* private variables */
+static size_t interval; /* mean bytes between samples */
+static bool sampling;   /* is the profiler on? */
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+static sample_t *samples[SAMPLE_BUCKETS];
+static site_t *sites[SITE_BUCKETS];
+static size_t num_sites;
+
+/*
+ * next_gap - draw the number of bytes until the next sample from an
+ *     exponential distribution with mean `interval`
+ */
+static long next_gap(void) {
+    double u;
+
+    /* xorshift64* */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    u = ((rng_state * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+    return (long) (-log(1.0 - u) * interval) + 1;
+}
+
+static size_t hash_ptr(const void *ptr) {
+    return (((uintptr_t) ptr >> 4) * 0x9e3779b97f4a7c15ULL) >> 52 & (SAMPLE_BUCKETS - 1);
+}
+
+static uint64_t hash_stack(void *const *stack, int depth) {
+    uint64_t h = 14695981039346656037ULL; /* FNV-1a */
+    for (int i = 0; i < depth; i++) {
+        h = (h ^ (uintptr_t) stack[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/*
+ * find_site - look up the site of a stack, creating it if it is new
+ */
+static site_t *find_site(void *const *stack, int depth) {
+    uint64_t h = hash_stack(stack, depth);
+    site_t **bucket = &sites[h % SITE_BUCKETS];
+    site_t *site;
+
+    for (site = *bucket; site != NULL; site = site->next) {
+        if (site->hash == h && site->depth == depth &&
+            memcmp(site->stack, stack, depth * sizeof(void *)) == 0) {
+            return site;
+        }
+    }
+    if ((site = calloc(1, sizeof(*site))) == NULL) return NULL;
+    site->hash = h;
+    site->depth = depth;
+    memcpy(site->stack, stack, depth * sizeof(void *));
+    site->next = *bucket;
+    *bucket = site;
+    num_sites++;
+    return site;
+}
+
+/*
+ * release_sample - take a sample that is no longer live out of its site's
+ *     live profile and free it
+ */
+static void release_sample(sample_t *s) {
+    site_t *site = s->site;
+
+    site->live_count--;
+    site->live_bytes -= s->size;
+    /* Don't let rounding leave a site that has nothing live with -0 bytes */
+    site->live_est = (site->live_count == 0) ? 0 : site->live_est - s->est;
+    free(s);
+}
+
+/*
+ * mm_prof_start - start sampling about one in every `mean_interval` bytes
+ */
+void mm_prof_start(size_t mean_interval) {
+    interval = (mean_interval > 0) ? mean_interval : 1;
+    sampling = true;
+    mm_prof_countdown = next_gap();
+}
+
+/*
+ * mm_prof_stop - stop sampling. The profile collected so far is kept, and
+ *     frees of sampled blocks are still accounted for.
+ */
+void mm_prof_stop(void) {
+    sampling = false;
+    mm_prof_countdown = LONG_MAX;
+}
+
+/*
+ * mm_prof_forget_live - drop every live sample without freeing it, e.g.
+ *     because the heap it was in has been reset
+ */
+void mm_prof_forget_live(void) {
+    if (mm_prof_num_live == 0) return;
+    for (int b = 0; b < SAMPLE_BUCKETS; b++) {
+        sample_t *s, *next;
+        for (s = samples[b]; s != NULL; s = next) {
+            next = s->next;
+            release_sample(s);
+        }
+        samples[b] = NULL;
+    }
+    mm_prof_num_live = 0;
+}
+
+/*
+ * mm_prof_reset - drop the whole profile
+ */
+void mm_prof_reset(void) {
+    mm_prof_forget_live();
+    for (int b = 0; b < SITE_BUCKETS; b++) {
+        site_t *site, *next;
+        for (site = sites[b]; site != NULL; site = next) {
+            next = site->next;
+            free(site);
+        }
+        sites[b] = NULL;
+    }
+    num_sites = 0;
+}
+
+/*
+ * mm_prof_sample - called by MM_PROF_MALLOC when the countdown runs out:
+ *     record the allocation of `size` bytes at `ptr` and draw the next gap
+ */
+void mm_prof_sample(void *ptr, size_t size) {
+    void *stack[MAX_DEPTH + MAX_SKIPPED];
+    int depth, skip;
+    site_t *site;
+    sample_t *s;
+
+    if (!sampling) {
+        mm_prof_countdown = LONG_MAX;
+        return;
+    }
+    mm_prof_countdown = next_gap();
+
+    /* Start at the frame the allocator returns to (see MM_PROF_ENTER), or
+       just below this one if the allocator doesn't say */
+    depth = backtrace(stack, MAX_DEPTH + MAX_SKIPPED);
+    for (skip = 1; skip < depth && stack[skip] != mm_prof_caller; skip++) {
+    }
+    if (skip >= depth) skip = (depth > 0) ? 1 : 0;
+    depth = (depth - skip > MAX_DEPTH) ? MAX_DEPTH : depth - skip;
+    if ((site = find_site(stack + skip, depth)) == NULL) return;
+    if ((s = malloc(sizeof(*s))) == NULL) return;
+
+    /* A block of `size` bytes is sampled with probability 1 - exp(-size / interval) */
+    s->ptr = ptr;
+    s->size = size;
+    s->est = (size == 0) ? 0 : size / (1 - exp(-(double) size / interval));
+    s->site = site;
+    s->next = samples[hash_ptr(ptr)];
+    samples[hash_ptr(ptr)] = s;
+    mm_prof_num_live++;
+
+    site->live_count++;
+    site->live_bytes += size;
+    site->live_est += s->est;
+    site->total_count++;
+    site->total_bytes += size;
+    site->total_est += s->est;
+}
+
+/*
+ * take_sample - unlink the live sample of the block at ptr, if it has one
+ */
+static sample_t *take_sample(void *ptr) {
+    sample_t **prevp = &samples[hash_ptr(ptr)];
+    sample_t *s;
+
+    for (s = *prevp; s != NULL; prevp = &s->next, s = s->next) {
+        if (s->ptr == ptr) {
+            *prevp = s->next;
+            return s;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * mm_prof_free - called by MM_PROF_FREE while there are live samples
+ */
+void mm_prof_free(void *ptr) {
+    sample_t *s = take_sample(ptr);
+
+    if (s != NULL) {
+        release_sample(s);
+        mm_prof_num_live--;
+    }
+}
+
+/*
+ * mm_prof_move - called by MM_PROF_MOVE while there are live samples
+ */
+void mm_prof_move(void *old_ptr, void *new_ptr) {
+    sample_t *s = take_sample(old_ptr);
+
+    if (s != NULL) {
+        s->ptr = new_ptr;
+        s->next = samples[hash_ptr(new_ptr)];
+        samples[hash_ptr(new_ptr)] = s;
+    }
+}
+
+/* Orders sites by estimated live bytes, then by estimated cumulative bytes */
+static int cmp_site(const void *a, const void *b) {
+    const site_t *x = *(const site_t *const *) a, *y = *(const site_t *const *) b;
+    if (x->live_est != y->live_est) return (x->live_est < y->live_est) ? 1 : -1;
+    if (x->total_est != y->total_est) return (x->total_est < y->total_est) ? 1 : -1;
+    return 0;
+}
+
+static void dump_text(FILE *fp, site_t **order) {
+    double live = 0, total = 0;
+
+    for (size_t i = 0; i < num_sites; i++) {
+        live += order[i]->live_est;
+        total += order[i]->total_est;
+    }
+    fprintf(fp, "Heap profile (estimated from samples every %zu bytes on average)\n",
+            interval);
+    fprintf(fp, "live: %.0f bytes, cumulative: %.0f bytes, %zu sites\n", live, total,
+            num_sites);
+
+    for (size_t i = 0; i < num_sites; i++) {
+        site_t *site = order[i];
+        char **symbols = backtrace_symbols(site->stack, site->depth);
+
+        fprintf(fp, "\nsite %zu: live %.0f bytes (%.1f%%) in %zu samples, ", i + 1,
+                site->live_est, (live == 0) ? 0 : 100 * site->live_est / live,
+                site->live_count);
+        fprintf(fp, "cumulative %.0f bytes (%.1f%%) in %zu samples\n", site->total_est,
+                (total == 0) ? 0 : 100 * site->total_est / total, site->total_count);
+        for (int d = 0; d < site->depth; d++) {
+            if (symbols != NULL)
+                fprintf(fp, "    #%-2d %s\n", d, symbols[d]);
+            else
+                fprintf(fp, "    #%-2d %p\n", d, site->stack[d]);
+        }
+        free(symbols);
+    }
+}
+
+static void dump_pprof(FILE *fp, site_t **order) {
+    size_t live_count = 0, live_bytes = 0, total_count = 0, total_bytes = 0;
+    FILE *maps;
+    char line[4096];
+
+    /* heap_v2 profiles hold the raw samples; pprof scales them itself */
+    for (size_t i = 0; i < num_sites; i++) {
+        live_count += order[i]->live_count;
+        live_bytes += order[i]->live_bytes;
+        total_count += order[i]->total_count;
+        total_bytes += order[i]->total_bytes;
+    }
+    fprintf(fp, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n", live_count, live_bytes,
+            total_count, total_bytes, interval);
+    for (size_t i = 0; i < num_sites; i++) {
+        site_t *site = order[i];
+        fprintf(fp, "%zu: %zu [%zu: %zu] @", site->live_count, site->live_bytes,
+                site->total_count, site->total_bytes);
+        for (int d = 0; d < site->depth; d++) {
+            fprintf(fp, " %p", site->stack[d]);
+        }
+        fprintf(fp, "\n");
+    }
+
+    /* pprof needs the memory map to symbolize the addresses */
+    fprintf(fp, "\nMAPPED_LIBRARIES:\n");
+    if ((maps = fopen("/proc/self/maps", "r")) != NULL) {
+        while (fgets(line, sizeof(line), maps) != NULL) {
+            fputs(line, fp);
+        }
+        fclose(maps);
+    }
+}
+
+/*
+ * mm_prof_dump - write the profile to path. Returns false if it cannot be
+ *     written.
+ */
+bool mm_prof_dump(const char *path, mm_prof_format_t format) {
+    site_t **order;
+    size_t n = 0;
+    FILE *fp;
+    bool ok;
+
+    if ((order = malloc((num_sites + 1) * sizeof(*order))) == NULL) return false;
+    for (int b = 0; b < SITE_BUCKETS; b++) {
+        for (site_t *site = sites[b]; site != NULL; site = site->next) {
+            order[n++] = site;
+        }
+    }
+    qsort(order, n, sizeof(*order), cmp_site);
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        free(order);
+        return false;
+    }
+    if (format == MM_PROF_PPROF)
+        dump_pprof(fp, order);
+    else
+        dump_text(fp, order);
+    ok = !ferror(fp);
+    ok = (fclose(fp) == 0) && ok;
+    free(order);
+    return ok;
+}
@@ -0,0 +1,265 @@
+/*
+ * timing.c - a benchmark timing harness for the drivers.
+ *
+ * Each benchmark is split into an untimed setup function and a timed body.
+ * After pinning the process to one CPU and running a few warm-up rounds,
+ * the body is timed a fixed number of times and summarized by its median
+ * and median absolute deviation, which unlike the mean are not dragged
+ * around by the occasional interrupted run.
+ *
+ * Times are taken from the TSC where it is known to tick at a constant
+ * rate, calibrated against CLOCK_MONOTONIC_RAW, and from clock_gettime
+ * everywhere else.
+ */
+#define _GNU_SOURCE
+#include "timing.h"
+
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+/* Calibration period for the TSC, in seconds */
+#define CALIBRATION_SECS 0.05
+
+/* A frequency reading that differs by more than this fraction is a change */
+#define FREQ_CHANGE 0.05
+
+/* private variables */
+static timing_config_t config;
+static bool use_tsc;
+static double ticks_per_sec = 1e9;
+static bool pinned;
+static cpu_set_t saved_affinity;
+
+/*
+ * monotonic_ns - nanoseconds from CLOCK_MONOTONIC_RAW
+ */
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * timing_ticks - read the clock. Ticks only mean something relative to
+ *     each other; convert differences with timing_ticks_to_secs.
+ */
+uint64_t timing_ticks(void) {
+#ifdef HAVE_TSC
+    if (use_tsc) {
+        /* Keep the read from drifting into or out of the timed region */
+        _mm_lfence();
+        uint64_t t = __rdtsc();
+        _mm_lfence();
+        return t;
+    }
+#endif
+    return monotonic_ns();
+}
+
+/*
+ * timing_ticks_to_secs - convert a number of ticks to seconds
+ */
+double timing_ticks_to_secs(uint64_t ticks) {
+    return (double) ticks / ticks_per_sec;
+}
+
+/*
+ * timing_clock_name - describe the clock in use, for reports
+ */
+const char *timing_clock_name(void) {
+    return use_tsc ? "tsc" : "clock_gettime";
+}
+
+/*
+ * tsc_is_invariant - does /proc/cpuinfo promise a constant-rate TSC that
+ *     keeps ticking in idle states?
+ */
+static bool tsc_is_invariant(void) {
+    char line[4096];
+    bool constant = false, nonstop = false;
+    FILE *fp = fopen("/proc/cpuinfo", "r");
+
+    if (fp == NULL) return false;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strncmp(line, "flags", 5) == 0) {
+            constant = strstr(line, " constant_tsc") != NULL;
+            nonstop = strstr(line, " nonstop_tsc") != NULL;
+            break;
+        }
+    }
+    fclose(fp);
+    return constant && nonstop;
+}
+
+/*
+ * calibrate_tsc - measure the TSC rate against the monotonic clock
+ */
+static void calibrate_tsc(void) {
+#ifdef HAVE_TSC
+    uint64_t ns0 = monotonic_ns();
+    uint64_t t0 = __rdtsc();
+    uint64_t ns1;
+
+    do {
+        ns1 = monotonic_ns();
+    } while (ns1 - ns0 < CALIBRATION_SECS * 1e9);
+    ticks_per_sec = (double) (__rdtsc() - t0) / ((ns1 - ns0) * 1e-9);
+#endif
+}
+
+/*
+ * read_cpu_freq - current frequency of the CPU we run on in kHz, or 0 if
+ *     the kernel does not tell us
+ */
+static long read_cpu_freq(void) {
+    char path[128];
+    long khz = 0;
+    FILE *fp;
+    int cpu = sched_getcpu();
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq",
+             cpu < 0 ? 0 : cpu);
+    if ((fp = fopen(path, "r")) == NULL) return 0;
+    if (fscanf(fp, "%ld", &khz) != 1) khz = 0;
+    fclose(fp);
+    return khz;
+}
+
+/*
+ * timing_init - pin to a CPU and set up the clock
+ */
+void timing_init(const timing_config_t *cfg) {
+    config = *cfg;
+    if (config.reps < 1) config.reps = 1;
+    if (config.warmups < 0) config.warmups = 0;
+
+    pinned = false;
+    if (config.cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(config.cpu, &set);
+        if (sched_getaffinity(0, sizeof(saved_affinity), &saved_affinity) == 0 &&
+            sched_setaffinity(0, sizeof(set), &set) == 0) {
+            pinned = true;
+        }
+        else {
+            fprintf(stderr, "WARNING: could not pin to CPU %d, timing unpinned\n",
+                    config.cpu);
+        }
+    }
+
+#ifdef HAVE_TSC
+    use_tsc = tsc_is_invariant();
+#endif
+    if (use_tsc) {
+        calibrate_tsc();
+    }
+    else {
+        ticks_per_sec = 1e9;
+    }
+}
+
+/*
+ * timing_deinit - undo the CPU pinning of timing_init
+ */
+void timing_deinit(void) {
+    if (pinned) {
+        sched_setaffinity(0, sizeof(saved_affinity), &saved_affinity);
+        pinned = false;
+    }
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Returns the median of n sorted values */
+static double sorted_median(const double *v, int n) {
+    return (n % 2 == 1) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+/*
+ * timing_measure - run setup and body config.warmups times untimed, then
+ *     config.reps times timing only body, and summarize the timed runs
+ */
+void timing_measure(timing_funct setup, timing_funct body, void *arg,
+                    timing_result_t *result) {
+    int n = config.reps;
+    double *secs = malloc(n * sizeof(double));
+    double *dev = malloc(n * sizeof(double));
+    long base_freq = 0;
+    int i;
+
+    if (secs == NULL || dev == NULL) {
+        fprintf(stderr, "ERROR: out of memory in timing_measure\n");
+        exit(1);
+    }
+
+    for (i = 0; i < config.warmups; i++) {
+        if (setup != NULL) setup(arg);
+        body(arg);
+    }
+
+    result->freq_changes = config.detect_freq ? 0 : -1;
+    if (config.detect_freq && (base_freq = read_cpu_freq()) == 0) {
+        result->freq_changes = -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        uint64_t start, end;
+        long before = 0;
+
+        if (setup != NULL) setup(arg);
+        if (base_freq != 0) before = read_cpu_freq();
+        start = timing_ticks();
+        body(arg);
+        end = timing_ticks();
+        secs[i] = timing_ticks_to_secs(end - start);
+
+        if (base_freq != 0) {
+            long after = read_cpu_freq();
+            if (fabs((double) before - base_freq) > FREQ_CHANGE * base_freq ||
+                fabs((double) after - base_freq) > FREQ_CHANGE * base_freq) {
+                result->freq_changes++;
+            }
+        }
+    }
+
+    qsort(secs, n, sizeof(double), cmp_double);
+    result->reps = n;
+    result->min = secs[0];
+    result->median = sorted_median(secs, n);
+    for (i = 0; i < n; i++) {
+        dev[i] = fabs(secs[i] - result->median);
+    }
+    qsort(dev, n, sizeof(double), cmp_double);
+    result->mad = sorted_median(dev, n);
+
+    /*
+     * Distribution-free confidence interval for the median: the ranks
+     * n/2 -+ 1.96 * sqrt(n) / 2 of the sorted runs
+     */
+    if (n >= 6) {
+        int lo = (int) floor(n / 2.0 - 0.98 * sqrt(n));
+        int hi = (int) ceil(n / 2.0 + 0.98 * sqrt(n));
+        result->ci_lo = secs[lo < 0 ? 0 : lo];
+        result->ci_hi = secs[hi > n - 1 ? n - 1 : hi];
+    }
+    else {
+        result->ci_lo = secs[0];
+        result->ci_hi = secs[n - 1];
+    }
+
+    free(secs);
+    free(dev);
+}